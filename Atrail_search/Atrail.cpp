@@ -18,6 +18,7 @@
 
 #include "boost_graph_helper.hpp"
 #include "Atrail.hpp"
+#include "pipeline_stats.hpp"
 
 // Do not define DEBUG if testing on large graphs. Some of the printing is during the exponential search and the printing can grow exponentially large even on moderately large graphs
 #define NDEBUG 
@@ -29,6 +30,10 @@
 
 using namespace boost;
 
+// Search tree statistics of split_and_check, reported by Atrail_search.
+static std::size_t num_search_nodes = 0;
+static std::size_t num_backtracks = 0;
+
 
 // A graph has an Eulerian trail ( a cycle which visits each edge exactly once ) iff all degrees are even and it is connected upto isolated vertices
 // Can be multigraph, must have no self loops
@@ -156,7 +161,11 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 	std::cout<<"INFO: Checking if the graph has an A-trail ..."<<std::endl;
 	std::cout << "---------------------------------------" << std::endl;
 	std::cout<<"INFO: First Checking if the graph has an Eulerian trail ..."<<std::endl;
-	if(!has_eulerian_trail(Gr)) {
+	pipeline_stats & stats = pipeline_stats::instance();
+	stats.begin_stage("eulerian_check");
+	const bool is_eulerian = has_eulerian_trail(Gr);
+	stats.end_stage();
+	if(!is_eulerian) {
 		std::cerr<<"ERROR! The graph does not have an Eulerian trail and thus cannot have an A-trail!"<<std::endl;
 		return false;
 	}
@@ -165,6 +174,7 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 		std::cout << "INFO: The graph has an Eulerian trail, now checking if it has an A-trail ..." << std::endl;
 	}
 
+	stats.begin_stage("rotation_build");
 	unsigned int n = num_vertices(Gr);
 	unsigned int m = num_edges(Gr);
 	std::vector<std::vector<Vertex> > P(n);
@@ -242,9 +252,15 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 		DEBUGPRINT(std::cout<<std::endl;)
 	}
 
+	stats.set_counter("subdivided_multiedges", subdiv_to_multiedge.size());
+	stats.end_stage();
+
 	std::vector<unsigned int> bn;
 	std::cout << "INFO: Enumerating the intersectable branching nodes (i.e. nodes with degree greater or equal to six) ..." << std::endl;
+	stats.begin_stage("branch_node_enumeration");
 	enumerate_intersectable_nodes(G, bn);
+	stats.end_stage();
+	stats.set_counter("branch_nodes", bn.size());
 	if (bn.empty())
 	{
 		std::cout<<"INFO: The graph has no branch nodes"<<std::endl;
@@ -261,6 +277,9 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 	std::vector<parity> parity_vec1;
 	std::vector<parity> parity_vec2;
 	bool has_Atrail = true;
+	num_search_nodes = 0;
+	num_backtracks = 0;
+	stats.begin_stage("Atrail_search");
 	if(!bn.empty())
 	{
 		std::cout << "INFO: Since there are branch nodes, the A-trail search may take a while ..." << std::endl;
@@ -274,11 +293,16 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 			}
 		}
 	}
+	stats.end_stage();
+	stats.set_counter("search_nodes", num_search_nodes);
+	stats.set_counter("backtracks", num_backtracks);
 
 	if( has_Atrail)
 	{
 		std::cout<<"INFO: The graph has an A-trail"<<std::endl;
+		stats.begin_stage("find_eulerian_trail");
 		std::list<Vertex> Trail = find_eulerian_trail(G);
+		stats.end_stage();
 		// In case the graph is a collection of isolated vertices, we have an empty trail.
 		if( Trail.size() == 0 )
 		{
@@ -308,6 +332,8 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 		DEBUGPRINT(std::cout<<"INFO: "; print_walk(Trail, "Trail (after remap) ");)
 
 		// Local fixing
+		stats.begin_stage("local_fixing");
+		std::size_t num_local_fixes = 0;
 		std::map<Vertex, bool> fixed;
 		Trail.pop_back(); // TODO: In the exceptional case where there is only a single node.
 		new_trail = Trail;
@@ -361,9 +387,12 @@ bool Atrail_search(Graph & Gr, std::vector<std::vector<std::size_t> > & edge_cod
 					new_trail.splice(first, to_rev);
 					DEBUGPRINT(print_walk(new_trail, "New trail: ");)
 					fixed[*it] = true;
+					++num_local_fixes;
 				}
 			}
 		}
+		stats.end_stage();
+		stats.set_counter("local_fixes", num_local_fixes);
 		new_trail.push_back(new_trail.front());
 		std::cout<<"INFO: "; print_walk(new_trail, "Trail (after local fixing): ");
 
@@ -431,6 +460,7 @@ bool split_and_check(Graph & G, const std::vector<std::vector<Vertex> > & P,
 		std::vector<unsigned int> bn, unsigned int dep, parity par,
 		std::map<Vertex, std::vector<Vertex> > & bn_new_nodes_map, std::vector<parity> parity_vec)
 {
+	++num_search_nodes;
 	parity_vec.push_back(par);
 	DEBUGPRINT(std::cout<<"DEBUG: Parity: ";)
 	for( unsigned int l=0; l < parity_vec.size(); l++)
@@ -563,6 +593,7 @@ bool split_and_check(Graph & G, const std::vector<std::vector<Vertex> > & P,
 			remove_vertex(split_vertices[kp], G);
 		}
 		parity_vec.pop_back();
+		++num_backtracks;
 		return false;
 	}else
 	{
@@ -603,6 +634,7 @@ bool split_and_check(Graph & G, const std::vector<std::vector<Vertex> > & P,
 						remove_vertex(split_vertices[kp], G);
 					}
 					parity_vec.pop_back();
+					++num_backtracks;
 					return false;
 				}
 			}
@@ -3,6 +3,9 @@
 * Argument 1: the edge code file.
 * Argument 2 (Optional): a trail file as a sequence of edge indices. This has an extension '.trail'.
 * Argument 3 (Optional): a trail file as a sequence of node indices(zero based). The trail ends with the vertice it began. The output file has extension `.ntrail'.
+* Trail files with the extensions '.btrail' and '.bntrail' are written in the binary format, see boost_graph_helper.hpp.
+* Optional: --stats=json or --stats=<filename> reports the time and memory spent per stage and the search counters, see pipeline_stats.hpp.
+* Optional: --cache=<directory> reuses the trails of an earlier search on the same edge code, see artifact_cache.hpp.
 */
 #include <iostream>
 #include <boost/graph/adjacency_list.hpp>
@@ -18,11 +21,16 @@
 #include <algorithm>    // std::find
 #include <fstream>
 #include "Atrail.hpp"
+#include "pipeline_stats.hpp"
+#include "artifact_cache.hpp"
 
 
 
 int main(int argc, char** argv)
 {
+	stats_report report("Atrail_search", argc, argv);
+	artifact_cache & cache = artifact_cache::instance();
+	cache.parse_arguments(argc, argv);
 	std::cout<<"INFO: Atrail_search, searchs for an Atrail for a given planar embedding."<<std::endl;
 	if(argc < 2)
 	{
@@ -43,10 +51,33 @@ int main(int argc, char** argv)
 			if(argc >= 5) std::cerr<<"WARNING: You have more arguments than required, ignoring the arguments after the third ..."<<std::endl;
 		}
 
+		// The search is the slowest stage of the pipeline, an edge code that was searched before is looked up first.
+		std::vector<std::string> outputs;
+		outputs.push_back(edgetrail_file);
+		outputs.push_back(nodetrail_file);
+		cache_key key("Atrail_search", 1);
+		bool keyed = false; // Nothing is stored unless every input was hashed.
+		if( cache.enabled() && !nodetrail_file.empty())
+		{
+			scoped_stage cache_stage("cache_lookup");
+			key.add(is_binary_filename(edgetrail_file) ? "binary" : "text");
+			key.add(is_binary_filename(nodetrail_file) ? "binary" : "text");
+			keyed = key.add_file(edgecode_file);
+			if( keyed && cache.fetch(key, outputs))
+			{
+				pipeline_stats::instance().set_counter("cache_hits", 1);
+				std::cout<<"INFO: Copied the cached A-trail of "<<edgecode_file<<" to "<<edgetrail_file<<" and "<<nodetrail_file<<std::endl;
+				return 0;
+			}
+		}
+
 		std::vector<std::vector<size_t> > edge_code;
 
 		// Attempt to read the edge code from the provided file and process if read was successful.
-		if(read_edge_code(std::string(edgecode_file), edge_code))
+		pipeline_stats::instance().begin_stage("read_edge_code");
+		const bool read = read_edge_code(std::string(edgecode_file), edge_code);
+		pipeline_stats::instance().end_stage();
+		if(read)
 		{
 			std::list<std::size_t> edge_trail;
 			Graph G(edge_code.size());
@@ -67,39 +98,21 @@ int main(int argc, char** argv)
 				add_edge(ind2pair[i][0], ind2pair[i][1], i, G);
 			}
 			std::cout<<"INFO: Read graph from the edgecode "<<edgecode_file<<std::endl;
+			pipeline_stats::instance().set_counter("vertices", num_vertices(G));
+			pipeline_stats::instance().set_counter("edges", m);
 			//std::cout<<"INFO: Graph "<<edgecode_file<<"\n"<<to_string_graph(G)<<std::endl;
 			std::list<Vertex> node_trail;
 			if(Atrail_search(G, edge_code, edge_trail, node_trail) == true)
 			{
 				std::cout<<"INFO: Found an A-trail for the graph"<<std::endl;
-				std::ofstream ofs(edgetrail_file.c_str(), std::ios::out);
-				if( !ofs.is_open())
-				{
-					std::cerr<<"ERROR! Unable to create file "<<edgetrail_file<<std::endl;
+				scoped_stage write_stage("write_trail");
+				std::cout<<"INFO: Writing the trail as edge list to file "<<edgetrail_file<<std::endl;
+				if( !write_trail(edgetrail_file, std::vector<std::size_t>(edge_trail.begin(), edge_trail.end())))
 					return 2;
-				}else
-				{
-					std::cout<<"INFO: Appending the trail as edge list to file "<<edgetrail_file<<std::endl;
-					for( std::list<std::size_t>::iterator it = edge_trail.begin(); it != edge_trail.end(); it++)
-					{
-							ofs<<*it<<" ";
-					}
-				}
-				ofs.close();
-				std::ofstream nfs(nodetrail_file.c_str(), std::ios::out);
-				if( !nfs.is_open())
-				{
-					std::cerr<<"ERROR! Unable to create file "<<nodetrail_file<<std::endl;
+				std::cout<<"INFO: Writing the trail as node list to file "<<nodetrail_file<<std::endl;
+				if( !write_trail(nodetrail_file, std::vector<std::size_t>(node_trail.begin(), node_trail.end())))
 					return 2;
-				}else
-				{
-					std::cout<<"INFO: Appending the trail as node list to file "<<nodetrail_file<<std::endl;
-					for( std::list<Vertex>::iterator it = node_trail.begin(); it != node_trail.end(); it++)
-					{
-							nfs<<*it<<" ";
-					}
-				}
-				nfs.close();
+				if( keyed) cache.store(key, outputs);
 				return 0;
 			}else
 			{
@@ -0,0 +1,266 @@
+/*
+ * artifact_cache.cpp
+ *
+ *  See artifact_cache.hpp.
+ */
+
+#include "artifact_cache.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const std::size_t kBufferSize = 1 << 16;
+
+// Renames from to to, replacing to if it exists.
+bool replace_file(const std::string & from, const std::string & to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Creates the cache directory, but not its parents. Failing because it exists is fine.
+void make_directory(const std::string & directory)
+{
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0777);
+#endif
+}
+
+int process_id()
+{
+#ifdef _WIN32
+	return _getpid();
+#else
+	return int(getpid());
+#endif
+}
+
+bool copy_file(const std::string & from, const std::string & to)
+{
+	std::ifstream in(from.c_str(), std::ios::binary);
+	if( !in.is_open()) return false;
+	std::ofstream out(to.c_str(), std::ios::binary | std::ios::trunc);
+	if( !out.is_open()) return false;
+	// Inserting an empty stream buffer sets the failbit.
+	if( in.peek() != std::ifstream::traits_type::eof())
+		out<<in.rdbuf();
+	out.close();
+	return !out.fail();
+}
+
+bool file_exists(const std::string & filename)
+{
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	return in.is_open();
+}
+
+}
+
+cache_key::cache_key(std::string tool, unsigned int version) : tool(tool)
+{
+	lanes[0] = 14695981039346656037ULL;
+	lanes[1] = 0x9e3779b97f4a7c15ULL;
+	add(tool);
+	add(uint64_t(version));
+}
+
+// Two independent 64 bit lanes, FNV-1a and a rotate and multiply hash, so that a collision needs both of them to collide.
+void cache_key::update(const char *data, std::size_t size)
+{
+	uint64_t a = lanes[0], b = lanes[1];
+	for( std::size_t i = 0; i < size; ++i)
+	{
+		const uint64_t byte = (unsigned char) data[i];
+		a = (a ^ byte) * 1099511628211ULL;
+		b = ((b << 5 | b >> 59) ^ byte) * 0xff51afd7ed558ccdULL;
+	}
+	lanes[0] = a;
+	lanes[1] = b;
+}
+
+void cache_key::add(uint64_t value)
+{
+	char bytes[8];
+	for( int i = 0; i < 8; ++i)
+		bytes[i] = char(value >> (8 * i));
+	update(bytes, sizeof(bytes));
+}
+
+// The length goes first so that a sequence of strings hashes differently from their concatenation.
+void cache_key::add(std::string value)
+{
+	add(uint64_t(value.size()));
+	update(value.data(), value.size());
+}
+
+bool cache_key::add_file(std::string filename)
+{
+	std::ifstream in(filename.c_str(), std::ios::binary);
+	if( !in.is_open()) return false;
+	std::vector<char> buffer(kBufferSize);
+	uint64_t size = 0;
+	while( in)
+	{
+		in.read(&buffer[0], buffer.size());
+		const std::size_t count = std::size_t(in.gcount());
+		update(&buffer[0], count);
+		size += count;
+	}
+	add(size);
+	return !in.bad();
+}
+
+// Reads the header like ply_reader, skips the vertex lines and hashes the index list of every face.
+bool cache_key::add_ply_topology(std::string filename)
+{
+	std::ifstream in(filename.c_str());
+	if( !in.is_open()) return false;
+	std::string line;
+	getline(in, line);
+	if( line.compare(0, 3, "ply") != 0) return false;
+	uint64_t number_nodes = 0, number_faces = 0;
+	bool header = false;
+	while( !header && getline(in, line))
+	{
+		if( line.compare(0, 6, "format") == 0 && line.find("ascii") == std::string::npos) return false;
+		if( line.compare(0, 14, "element vertex") == 0) number_nodes = strtoull(line.c_str() + 14, NULL, 10);
+		if( line.compare(0, 12, "element face") == 0) number_faces = strtoull(line.c_str() + 12, NULL, 10);
+		header = line.compare(0, 10, "end_header") == 0;
+	}
+	if( !header) return false;
+	add(std::string("ply_topology"));
+	add(number_nodes);
+	add(number_faces);
+	for( uint64_t i = 0; i < number_nodes; ++i)
+		if( !getline(in, line)) return false;
+	for( uint64_t i = 0; i < number_faces; ++i)
+	{
+		if( !getline(in, line)) return false;
+		const char *p = line.c_str();
+		char *end;
+		const uint64_t nodes_per_face = strtoull(p, &end, 10);
+		add(nodes_per_face);
+		for( uint64_t j = 0; j < nodes_per_face; ++j)
+		{
+			p = end;
+			add(uint64_t(strtoull(p, &end, 10)));
+			if( end == p) return false;
+		}
+	}
+	return true;
+}
+
+std::string cache_key::to_string() const
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string hex;
+	for( int lane = 0; lane < 2; ++lane)
+		for( int shift = 60; shift >= 0; shift -= 4)
+			hex += digits[(lanes[lane] >> shift) & 0xf];
+	return hex;
+}
+
+artifact_cache & artifact_cache::instance()
+{
+	static artifact_cache cache;
+	return cache;
+}
+
+void artifact_cache::parse_arguments(int & argc, char ** argv)
+{
+	const char *environment = getenv("BSCOR_CACHE");
+	if( environment) directory = environment;
+	int kept = 1;
+	for( int i = 1; i < argc; ++i)
+	{
+		const std::string argument(argv[i]);
+		if( argument.compare(0, 8, "--cache=") == 0 && argument.size() > 8)
+			directory = argument.substr(8);
+		else
+			argv[kept++] = argv[i];
+	}
+	argc = kept;
+	argv[argc] = NULL;
+	while( directory.size() > 1 && (directory[directory.size() - 1] == '/' || directory[directory.size() - 1] == '\\'))
+		directory.erase(directory.size() - 1);
+}
+
+std::string artifact_cache::entry(const cache_key & key, std::size_t index) const
+{
+	std::stringstream ss;
+	ss<<directory<<"/"<<key.get_tool()<<"-"<<key.to_string()<<"."<<index;
+	return ss.str();
+}
+
+bool artifact_cache::fetch(const cache_key & key, const std::vector<std::string> & outputs) const
+{
+	if( !enabled()) return false;
+	for( std::size_t i = 0; i < outputs.size(); ++i)
+		if( !file_exists(entry(key, i))) return false;
+	std::vector<std::string> temporaries;
+	for( std::size_t i = 0; i < outputs.size(); ++i)
+	{
+		std::stringstream temporary;
+		temporary<<outputs[i]<<".tmp"<<process_id();
+		temporaries.push_back(temporary.str());
+		if( !copy_file(entry(key, i), temporaries[i]))
+		{
+			std::cerr<<"WARNING: Could not copy the cached "<<entry(key, i)<<" to "<<temporaries[i]<<"."<<std::endl;
+			for( std::size_t j = 0; j <= i; ++j)
+				std::remove(temporaries[j].c_str());
+			return false;
+		}
+	}
+	for( std::size_t i = 0; i < outputs.size(); ++i)
+	{
+		if( !replace_file(temporaries[i], outputs[i]))
+		{
+			std::cerr<<"WARNING: Could not replace "<<outputs[i]<<" with the cached "<<entry(key, i)<<"."<<std::endl;
+			for( std::size_t j = i; j < outputs.size(); ++j)
+				std::remove(temporaries[j].c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+bool artifact_cache::store(const cache_key & key, const std::vector<std::string> & outputs) const
+{
+	if( !enabled()) return false;
+	make_directory(directory);
+	for( std::size_t i = 0; i < outputs.size(); ++i)
+	{
+		const std::string target = entry(key, i);
+		std::stringstream temporary;
+		temporary<<target<<".tmp"<<process_id();
+		if( !copy_file(outputs[i], temporary.str()) || !replace_file(temporary.str(), target))
+		{
+			std::remove(temporary.str().c_str());
+			if( file_exists(target)) continue;
+			std::cerr<<"WARNING: Could not store "<<outputs[i]<<" in the cache "<<directory<<"."<<std::endl;
+			return false;
+		}
+	}
+	return true;
+}
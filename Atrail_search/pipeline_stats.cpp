@@ -0,0 +1,156 @@
+/*
+ * pipeline_stats.cpp
+ *
+ *  See pipeline_stats.hpp.
+ */
+
+#include "pipeline_stats.hpp"
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+resource_usage current_resource_usage()
+{
+	resource_usage usage;
+	usage.wall = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernel_time.dwLowDateTime;
+	kernel.HighPart = kernel_time.dwHighDateTime;
+	user.LowPart = user_time.dwLowDateTime;
+	user.HighPart = user_time.dwHighDateTime;
+	usage.cpu = (kernel.QuadPart + user.QuadPart) * 1e-7; // 100 ns ticks
+	PROCESS_MEMORY_COUNTERS memory;
+	usage.peak_rss_kb = GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)) ? (uint64_t) memory.PeakWorkingSetSize / 1024 : 0;
+#else
+	struct rusage self;
+	getrusage(RUSAGE_SELF, &self);
+	usage.cpu = self.ru_utime.tv_sec + self.ru_stime.tv_sec + (self.ru_utime.tv_usec + self.ru_stime.tv_usec) * 1e-6;
+#ifdef __APPLE__
+	usage.peak_rss_kb = (uint64_t) self.ru_maxrss / 1024; // bytes on OS X
+#else
+	usage.peak_rss_kb = (uint64_t) self.ru_maxrss;
+#endif
+#endif
+	return usage;
+}
+
+pipeline_stats::pipeline_stats() : start(current_resource_usage())
+{
+}
+
+pipeline_stats & pipeline_stats::instance()
+{
+	static pipeline_stats stats;
+	return stats;
+}
+
+void pipeline_stats::parse_arguments(std::string tool, int & argc, char ** argv)
+{
+	this->tool = tool;
+	int kept = 1;
+	for( int i = 1; i < argc; ++i)
+	{
+		const std::string argument(argv[i]);
+		if( argument.compare(0, 8, "--stats=") == 0 && argument.size() > 8)
+			output = argument.substr(8);
+		else
+			argv[kept++] = argv[i];
+	}
+	argc = kept;
+	argv[argc] = NULL;
+}
+
+void pipeline_stats::begin_stage(std::string name)
+{
+	stage s;
+	s.name = name;
+	s.begin = current_resource_usage();
+	s.end = s.begin;
+	open_stages.push_back(stages.size());
+	stages.push_back(s);
+}
+
+void pipeline_stats::end_stage()
+{
+	if( open_stages.empty()) return;
+	stages[open_stages.back()].end = current_resource_usage();
+	open_stages.pop_back();
+}
+
+// Quotes and escapes str as a JSON string.
+static std::string json_string(const std::string & str)
+{
+	std::string quoted("\"");
+	for( std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+	{
+		if( *it == '"' || *it == '\\') quoted.push_back('\\');
+		if( (unsigned char) *it >= 0x20) quoted.push_back(*it);
+	}
+	quoted.push_back('"');
+	return quoted;
+}
+
+static void write_usage(std::ostream & os, const resource_usage & begin, const resource_usage & end)
+{
+	os<<"\"wall_ms\":"<<(end.wall - begin.wall) * 1000<<",\"cpu_ms\":"<<(end.cpu - begin.cpu) * 1000<<",\"peak_rss_kb\":"<<end.peak_rss_kb;
+}
+
+std::string pipeline_stats::to_json() const
+{
+	std::ostringstream os;
+	os<<std::fixed<<std::setprecision(3);
+	const resource_usage now = current_resource_usage();
+	os<<"{\"tool\":"<<json_string(tool)<<",\"stages\":[";
+	for( std::size_t i = 0; i < stages.size(); ++i)
+	{
+		// A stage left open, e.g. by an early return on an error, ends now.
+		const bool open = std::find(open_stages.begin(), open_stages.end(), i) != open_stages.end();
+		os<<(i ? "," : "")<<"{\"name\":"<<json_string(stages[i].name)<<",";
+		write_usage(os, stages[i].begin, open ? now : stages[i].end);
+		os<<"}";
+	}
+	os<<"],\"counters\":{";
+	for( std::map<std::string, uint64_t>::const_iterator it = counters.begin(); it != counters.end(); ++it)
+		os<<(it == counters.begin() ? "" : ",")<<json_string(it->first)<<":"<<it->second;
+	os<<"},\"total\":{";
+	write_usage(os, start, now);
+	os<<"}}";
+	return os.str();
+}
+
+bool pipeline_stats::write() const
+{
+	if( !enabled()) return true;
+	if( output == "json")
+	{
+		std::cout<<"STATS: "<<to_json()<<std::endl;
+		return true;
+	}
+	std::ofstream ofs(output.c_str(), std::ofstream::out);
+	if( !ofs.is_open())
+	{
+		std::cerr<<"ERROR! Unable to create the statistics file "<<output<<std::endl;
+		return false;
+	}
+	ofs<<to_json()<<"\n";
+	ofs.close();
+	std::cout<<"INFO: Wrote the statistics to "<<output<<std::endl;
+	return !ofs.fail();
+}
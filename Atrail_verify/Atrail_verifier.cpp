@@ -0,0 +1,149 @@
+/*
+ * Atrail_verifier.cpp
+ *
+ *  See Atrail_verifier.hpp.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "Atrail_verifier.hpp"
+
+// Walks the trail assuming that its first and second edges are joined at the node next. Every pair of consecutive edges
+// must be neighbours in the cyclic order around their joining node. The rotation of node v is edges[offsets[v] .. offsets[v+1]).
+// edge_ends and edge_locs hold, for every edge e, its two end nodes at 2e and 2e+1 and the position of e in the rotation around each of them.
+template<typename IndexT, typename TrailT>
+static bool is_Atrail_from(const IndexT * offsets, const IndexT * edges, const TrailT * trail_edgelist, std::size_t m,
+		const std::vector<std::size_t> & edge_ends, const std::vector<std::size_t> & edge_locs, std::size_t next)
+{
+	std::size_t loc, pre, suc, deg;
+	for( std::size_t k = 0; k < m; ++k)
+	{
+		const std::size_t e = trail_edgelist[k];
+		const std::size_t nextedge = trail_edgelist[(k + 1 == m) ? 0 : k + 1];
+		if( edge_ends[2*e] == next) loc = edge_locs[2*e];
+		else if( edge_ends[2*e + 1] == next) loc = edge_locs[2*e + 1];
+		else return false; // The edge does not end at the node the trail has reached
+		const IndexT * rotation = edges + offsets[next];
+		deg = offsets[next + 1] - offsets[next];
+		pre = ((loc == deg - 1)? 0 : (loc + 1));
+		suc = ((loc == 0) ? (deg - 1):(loc - 1));
+		if( rotation[pre] != nextedge
+				&& rotation[suc] != nextedge )
+		{
+			// The two consecutive edges are not neighbors in the cyclic order of edges around the joining node
+			return false;
+		}
+		next = (edge_ends[2*nextedge] == next ? edge_ends[2*nextedge + 1] : edge_ends[2*nextedge]);
+	}
+	return true;
+}
+
+// Verifies the trail against an edge code given in compressed sparse rows, see is_Atrail_from.
+template<typename IndexT, typename TrailT>
+static bool Atrail_verify_csr(std::size_t n, const IndexT * offsets, const IndexT * edges, const TrailT * trail_edgelist, std::size_t trail_size)
+{
+	const std::size_t m = offsets[n] / 2; // number of edges
+
+	if( m != trail_size) return false;
+	else if (trail_size == 0)
+	{
+		std::cerr<<"ERROR! The trail is empty!"<<std::endl;
+		return false;
+	}
+
+	// Index the end nodes of every edge and the position of the edge in the cyclic order around each end node.
+	std::vector<std::size_t> edge_ends(2*m);
+	std::vector<std::size_t> edge_locs(2*m);
+	std::vector<unsigned char> num_ends(m, 0);
+	for( std::size_t i = 0; i < n; ++i)
+	{
+		for( std::size_t j = 0; j < (std::size_t) (offsets[i + 1] - offsets[i]); ++j)
+		{
+			const std::size_t e = edges[offsets[i] + j];
+			if( e >= m || num_ends[e] == 2)
+			{
+				std::cerr<<"ERROR! The edge code is not a valid embedding, edge "<<e<<" is out of range or occurs more than twice!"<<std::endl;
+				return false;
+			}
+			edge_ends[2*e + num_ends[e]] = i;
+			edge_locs[2*e + num_ends[e]] = j;
+			++num_ends[e];
+		}
+	}
+	// Every edge joins two rotations, an edge listed around a single node has no end to walk on to.
+	for( std::size_t e = 0; e < m; ++e)
+	{
+		if( num_ends[e] != 2)
+		{
+			std::cerr<<"ERROR! The edge code is not a valid embedding, edge "<<e<<" occurs "<<(int) num_ends[e]<<" times instead of twice!"<<std::endl;
+			return false;
+		}
+	}
+
+	// Every edge must be visited exactly once, this does not depend on where the trail starts.
+	std::vector<bool> visited(m, false);
+	for( std::size_t k = 0; k < m; ++k)
+	{
+		if( trail_edgelist[k] >= m || visited[trail_edgelist[k]]) return false; // An edge is visited more than once
+		visited[trail_edgelist[k]] = true;
+	}
+
+	//If the trail list begins with parallel edges e1 and e2 (i.e e1 and e2 have the same end nodes u,v), 
+	//is the trail to be interpreted as u,e1,v,e2,u or v,e1,u,e2,v? The trail may be valid with one interpretation
+	//but invalid with the other. We use the optimistic interpretation and check both. Otherwise the joining node of
+	//e1 and e2 is unique and a single walk decides.
+	const std::size_t first = trail_edgelist[0];
+	const std::size_t second = trail_edgelist[(m > 1) ? 1 : 0];
+	for( int round = 1; round >= 0; --round)
+	{
+		const std::size_t start = edge_ends[2*first + round];
+		if( (edge_ends[2*second] == start || edge_ends[2*second + 1] == start)
+				&& is_Atrail_from(offsets, edges, trail_edgelist, m, edge_ends, edge_locs, start))
+			return true;
+	}
+	return false;
+}
+
+bool Atrail_verify(const std::vector<std::vector<std::size_t> > & edge_code,  const std::vector<std::size_t> & trail_edgelist)
+{
+	std::vector<std::size_t> offsets(edge_code.size() + 1, 0);
+	for( std::size_t i = 0; i < edge_code.size(); ++i ) offsets[i + 1] = offsets[i] + edge_code[i].size();
+	std::vector<std::size_t> edges;
+	edges.reserve(offsets.back());
+	for( std::size_t i = 0; i < edge_code.size(); ++i ) edges.insert(edges.end(), edge_code[i].begin(), edge_code[i].end());
+	return Atrail_verify_csr(edge_code.size(), &offsets[0], edges.empty() ? NULL : &edges[0],
+			trail_edgelist.empty() ? NULL : &trail_edgelist[0], trail_edgelist.size());
+}
+
+bool Atrail_verify(const mapped_edge_code & edge_code, const mapped_trail & trail_edgelist)
+{
+	return Atrail_verify_csr(edge_code.size(), edge_code.offsets(), edge_code.edges(), trail_edgelist.data(), trail_edgelist.size());
+}
+
+template<typename TrailT>
+static void print_trail(const TrailT * trail, std::size_t size)
+{
+	std::cout<<"INFO: Trail from file: ";
+	for( std::size_t k = 0; k < size; ++k)
+		std::cout<<trail[k]<<" ";
+	std::cout<<std::endl;
+}
+
+int Atrail_verify_files(std::string edgecode_file, std::string trail_file, bool print)
+{
+	binary_header header;
+	if( read_binary_header(edgecode_file, header) && read_binary_header(trail_file, header))
+	{
+		mapped_edge_code edge_code;
+		mapped_trail edge_trail;
+		if( !edge_code.open(edgecode_file) || !edge_trail.open(trail_file)) return -1;
+		if( print) print_trail(edge_trail.data(), edge_trail.size());
+		return Atrail_verify(edge_code, edge_trail) ? 1 : 0;
+	}
+	std::vector<std::vector<std::size_t> > edge_code;
+	std::vector<std::size_t> edge_trail;
+	if( !read_edge_code(edgecode_file, edge_code) || !read_trail(trail_file, edge_trail)) return -1;
+	if( print) print_trail(edge_trail.empty() ? NULL : &edge_trail[0], edge_trail.size());
+	return Atrail_verify(edge_code, edge_trail) ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * Atrail_verifier.hpp
+ *
+ *  Linear time verification of A-trails, shared by Atrail_verify and the microbenchmark.
+ */
+
+#ifndef ATRAIL_VERIFIER_HPP_
+#define ATRAIL_VERIFIER_HPP_
+
+#include <string>
+#include <vector>
+#include "boost_graph_helper.hpp"
+
+// Checks whether the trail trail_edgelist is an A-trail with respect to the embedding given by the edge code.
+// Precondition: The edge code is a valid embedding of a graph. The trail edgelist is a sequence of edge indices (unsigned integers from 0 to m-1)
+// Runs in O(n + m): the position of every edge in the cyclic order around its two end nodes is indexed once up front.
+bool Atrail_verify(const std::vector<std::vector<std::size_t> > & edge_code,  const std::vector<std::size_t> & trail_edgelist);
+// Same as above, verifying binary files in place from their memory mappings.
+bool Atrail_verify(const mapped_edge_code & edge_code, const mapped_trail & trail_edgelist);
+
+// Reads and verifies a single (edge code, trail) pair, both either in the text or in the binary format. Returns -1 if a file could not be read,
+// otherwise whether the trail is an A-trail. With print, the trail is printed once read.
+int Atrail_verify_files(std::string edgecode_file, std::string trail_file, bool print = false);
+
+#endif /* ATRAIL_VERIFIER_HPP_ */
@@ -6,6 +6,8 @@
  *  Verifies that an edge trail generated by an Atrail_search is in fact an A-trail with respect to the embedding given as an edge code.
  *  Argument 1: the edge code file.
  *  Argument 2: the edge trail file.
+ *  Batch mode: Atrail_verify --batch pairsfile [num_threads], where every line of pairsfile names an edge code file and an edge trail file.
+ *  Optional: --stats=json or --stats=<filename> reports the time and memory spent, see pipeline_stats.hpp.
  */
 
 #include <iostream>
@@ -15,127 +17,94 @@
 #include <string>
 #include <sstream>
 #include <fstream>
+#include <thread>
+#include <atomic>
 #include <stdio.h>
 #include "boost_graph_helper.hpp"
+#include "Atrail_verifier.hpp"
+#include "pipeline_stats.hpp"
 
-// Reads the edge trail in the file input_filename and outputs the resulting trail in the list structure.
-bool read_trail(std::string input_filename, std::list<std::size_t> & trail);
-
-// Checks whether the trail trail_edgelist is an A-trail with respect to the embedding given by the edge code.
-// Precondition: The edge code is a valid embedding of a graph. The trail edgelist is a sequence of edge indices (unsigned integers from 0 to m-1)
-bool Atrail_verify(const std::vector<std::vector<std::size_t> > & edge_code,  const std::list<std::size_t> & trail_edgelist);
+// Verifies every (edge code, trail) pair listed in the file batch_filename, one pair of filenames per line, using num_threads worker threads.
+// Returns false if any of the listed files could not be read.
+bool Atrail_verify_batch(std::string batch_filename, unsigned int num_threads);
 
 int main(int argc, char* argv[])
 {
+	stats_report report("Atrail_verify", argc, argv);
 	std::cout<<"INFO: Atrail_verify, verifies whether the given trail is a valid Atrail with respect to the given planar embedding."<<std::endl;
-	if(argc != 3)
+	if(argc >= 3 && std::string(argv[1]) == "--batch")
+	{
+		unsigned int num_threads = std::thread::hardware_concurrency();
+		if(argc >= 4) num_threads = (unsigned int) atoi(argv[3]);
+		if(num_threads == 0) num_threads = 1;
+		return Atrail_verify_batch(std::string(argv[2]), num_threads) ? 0 : 1;
+	}
+	else if(argc != 3)
 	{
 		std::cerr << "ERROR! Usage: Atrail_verify edgecodefile edgetrailfile" << std::endl;
+		std::cerr << "       Atrail_verify --batch pairsfile [num_threads]" << std::endl;
 		return 1;
 	}else
 	{
-		std::vector<std::vector<size_t> > edge_code;
-		std::list<std::size_t> edge_trail;
-		if(!read_edge_code(std::string(argv[1]), edge_code)) return 1;
 		std::cout<<"INFO: Reading trail from file "<<std::string(argv[2])<<std::endl;
-		if(!read_trail(std::string(argv[2]), edge_trail)) return 1;
-		print_walk(edge_trail, "INFO: Trail from file: ");
-		std::cout<<"INFO: "<<((Atrail_verify(edge_code, edge_trail) == true) 
+		pipeline_stats::instance().begin_stage("Atrail_verify");
+		const int result = Atrail_verify_files(std::string(argv[1]), std::string(argv[2]), true);
+		pipeline_stats::instance().end_stage();
+		if(result < 0) return 1;
+		pipeline_stats::instance().set_counter("trails_verified", 1);
+		pipeline_stats::instance().set_counter("valid_Atrails", result);
+		std::cout<<"INFO: "<<((result == 1) 
 				? "Yes, the given trail is a valid A-trail with respect to the embedding" : 
 				"No, the given trail is not a valid A-trail with respect to the embedding")<<std::endl;
 		return 0;
 	}
 }
 
-bool read_trail(std::string input_filename, std::list<std::size_t> & trail)
+bool Atrail_verify_batch(std::string batch_filename, unsigned int num_threads)
 {
-	std::ifstream ifs(input_filename.c_str(), std::ifstream::in);
+	std::ifstream ifs(batch_filename.c_str(), std::ifstream::in);
 	if( !ifs.is_open())
 	{
-		std::cerr<<"ERROR! Unable to read file "<<input_filename;
+		std::cerr<<"ERROR! Unable to read file "<<batch_filename<<std::endl;
 		return false;
-	}else
+	}
+	std::vector<std::pair<std::string, std::string> > pairs;
+	std::string line;
+	while(std::getline(ifs, line))
 	{
-		trail.clear();
-		//trail = std::list<std::size_t>(0);
-		std::string line;
-		std::getline(ifs, line);
 		std::istringstream iss(line);
-		std::size_t next_edge;
-		while(iss >> next_edge) {
-			trail.push_back(next_edge);
-		}
-		ifs.close();
-		return true;
+		std::string edgecode_file, trail_file;
+		if(iss >> edgecode_file >> trail_file) pairs.push_back(std::make_pair(edgecode_file, trail_file));
 	}
-}
+	ifs.close();
+	std::cout<<"INFO: Verifying "<<pairs.size()<<" trails from "<<batch_filename<<" using "<<num_threads<<" threads ..."<<std::endl;
 
-bool Atrail_verify(const std::vector<std::vector<std::size_t> > & edge_code,  const std::list<std::size_t> & trail_edgelist)
-{
-	std::size_t m = 0; // number of edges
-	for( unsigned int i = 0; i < edge_code.size(); ++i ) m += edge_code[i].size();
-	m = m / 2;
-	std::vector<unsigned short> num_visits(m, 0);
-	std::vector<std::vector<unsigned int> > ind2pair(m, std::vector<unsigned int>(0));
-	for( unsigned int i = 0; i < edge_code.size(); ++i)
+	// -1: unreadable input, 0: not an A-trail, 1: A-trail. Workers claim pairs through the shared counter.
+	std::vector<int> results(pairs.size(), -1);
+	pipeline_stats::instance().begin_stage("Atrail_verify_batch");
+	std::atomic<std::size_t> next_pair(0);
+	std::vector<std::thread> workers;
+	for( unsigned int t = 0; t < num_threads; ++t)
 	{
-		for( unsigned int j = 0; j < edge_code[i].size(); ++j)
-		{
-			ind2pair[edge_code[i][j]].push_back(i);
-		}
+		workers.push_back(std::thread([&pairs, &results, &next_pair]() {
+			for( std::size_t i = next_pair++; i < pairs.size(); i = next_pair++)
+				results[i] = Atrail_verify_files(pairs[i].first, pairs[i].second);
+		}));
 	}
+	for( std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it) it->join();
+	pipeline_stats::instance().end_stage();
 
-	if( m != trail_edgelist.size()) return false;
-	else if (trail_edgelist.size() == 0)
+	std::size_t num_valid = 0, num_unreadable = 0;
+	for( std::size_t i = 0; i < pairs.size(); ++i)
 	{
-		std::cerr<<"ERROR! The trail is empty!"<<std::endl;
-		return false;
-	}
-	else{
-		//If the trail list begins with parallel edges e1 and e2 (i.e e1 and e2 have the same end nodes u,v), 
-		//is the trail to be interpreted as u,e1,v,e2,u or v,e1,u,e2,v? The trail may be valid with one interpretation
-		//but invalid with the other. We use the optimistic interpretation and check both in two rounds.		
-		Vertex next = ind2pair[trail_edgelist.front()][1];		
-		unsigned char round = 0; 
-		bool is_valid_trail = true; // Is it a valid Eulerian trail?
-		bool is_valid_Atrail = true; // Is it a valid Atrail?
-		while(round < 2)
-		{
-			std::size_t loc, pre, suc;
-			std::list<std::size_t>::const_iterator nextedge;
-			is_valid_trail = true;
-			is_valid_Atrail = true;
-			for( std::list<std::size_t>::const_iterator it = trail_edgelist.begin(); it!= trail_edgelist.end(); ++it)
-			{
-				if((++num_visits[*it]) > 1)
-				{
-					is_valid_trail = false; // An edge is visited more than once
-				}
-				if( it != (--trail_edgelist.end()))
-				{
-					nextedge = ++it;
-					--it;
-				}else nextedge = trail_edgelist.begin();
-
-				loc = std::distance(edge_code[next].begin(), std::find(edge_code[next].begin(),edge_code[next].end(), *(it)));
-				pre = ((loc == edge_code[next].size() - 1)? 0 : (loc + 1));
-				suc = ((loc == 0) ? (edge_code[next].size() - 1):(loc - 1));
-				if( edge_code[next][pre] != *nextedge
-						&& edge_code[next][suc] != *nextedge )
-				{
-					// The two consecutive edges are not neighbors in the cyclic order of edges around the joining node
-					is_valid_Atrail = false;
-					break;
-				}
-				next = (ind2pair[*nextedge][0] == next ? ind2pair[*nextedge][1] : ind2pair[*nextedge][0]);
-			}
-			if(!is_valid_trail) break;
-			if( is_valid_trail && is_valid_Atrail) break;
-			round++;
-			next = ind2pair[trail_edgelist.front()][0]; // if it fails try the other interpretation.
-			num_visits = std::vector<unsigned short>(m,0);
-		}
-
-		return is_valid_trail && is_valid_Atrail;
+		std::cout<<"INFO: "<<pairs[i].first<<" "<<pairs[i].second<<": "
+				<<(results[i] == 1 ? "valid A-trail" : (results[i] == 0 ? "not a valid A-trail" : "unable to read"))<<std::endl;
+		if( results[i] == 1) ++num_valid;
+		else if( results[i] == -1) ++num_unreadable;
 	}
+	pipeline_stats::instance().set_counter("trails_verified", pairs.size());
+	pipeline_stats::instance().set_counter("valid_Atrails", num_valid);
+	pipeline_stats::instance().set_counter("unreadable_inputs", num_unreadable);
+	std::cout<<"INFO: "<<num_valid<<" of "<<pairs.size()<<" trails are valid A-trails with respect to their embeddings"<<std::endl;
+	return num_unreadable == 0;
 }
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# scaling_benchmark.sh
+#
+#  Runs every stage of the pipeline on synthetic meshes from mesh_generator at sizes from 10^2 to 10^6 edges and collects the
+#  --stats reports of the executables, so that time and memory can be tracked as the meshes grow.
+#  Usage: scaling_benchmark.sh [output_directory] [baseline_summary.tsv]
+#  Environment:
+#    BSCOR_BIN        directory holding the executables, by default the current directory.
+#    BSCOR_FAMILIES   mesh families to run, by default "sphere cube torus quadsheet trisheet degree6 degree8".
+#    BSCOR_SIZES      target edge counts, by default "100 1000 10000 100000 1000000".
+#    BSCOR_TIMEOUT    seconds allowed per stage, by default 600 (needs the timeout utility, otherwise unlimited).
+#    BSCOR_RECTIFIER  set to 1 to also run scaffold-routing-rectification, which needs PhysX and is by far the slowest stage.
+#    BSCOR_TOLERANCE  relative slowdown against the baseline that is reported as a regression, by default 0.2.
+#  Output:
+#    results.jsonl    one line per family, size and stage: {"family","target_edges","stage","exit_code","stats":{...}}
+#    summary.tsv      family, target_edges, stage, exit_code, wall_ms, cpu_ms and peak_rss_kb of every stage run, for plotting.
+#  If a baseline summary.tsv is given, stages whose wall time grew by more than the tolerance are listed and the exit code is 1.
+#
+
+BIN=${BSCOR_BIN:-.}
+FAMILIES=${BSCOR_FAMILIES:-"sphere cube torus quadsheet trisheet degree6 degree8"}
+SIZES=${BSCOR_SIZES:-"100 1000 10000 100000 1000000"}
+TIMEOUT=${BSCOR_TIMEOUT:-600}
+TOLERANCE=${BSCOR_TOLERANCE:-0.2}
+OUT=${1:-benchmark_results}
+BASELINE=$2
+
+mkdir -p "$OUT" || exit 1
+RESULTS="$OUT/results.jsonl"
+SUMMARY="$OUT/summary.tsv"
+: > "$RESULTS"
+printf 'family\ttarget_edges\tstage\texit_code\twall_ms\tcpu_ms\tpeak_rss_kb\n' > "$SUMMARY"
+
+if command -v timeout > /dev/null 2>&1; then
+	LIMIT="timeout $TIMEOUT"
+else
+	LIMIT=""
+fi
+
+# run_stage family size stage executable arguments...
+# Runs one executable with --stats=<file>, appends its report to the results and returns its exit code.
+run_stage() {
+	family=$1; size=$2; stage=$3; executable=$4
+	shift 4
+	stats="$OUT/$family-$size-$stage.json"
+	rm -f "$stats"
+	$LIMIT "$BIN/$executable" "$@" --stats="$stats" > "$OUT/$family-$size-$stage.log" 2>&1
+	code=$?
+	report=$(cat "$stats" 2> /dev/null)
+	[ -n "$report" ] || report="null"
+	printf '{"family":"%s","target_edges":%s,"stage":"%s","exit_code":%s,"stats":%s}\n' "$family" "$size" "$stage" "$code" "$report" >> "$RESULTS"
+	# The total is the last object of the report.
+	total=$(printf '%s' "$report" | sed -n 's/.*"total":{"wall_ms":\([0-9.]*\),"cpu_ms":\([0-9.]*\),"peak_rss_kb":\([0-9]*\)}}.*/\1\t\2\t\3/p')
+	[ -n "$total" ] || total="-	-	-"
+	printf '%s\t%s\t%s\t%s\t%s\n' "$family" "$size" "$stage" "$code" "$total" >> "$SUMMARY"
+	echo "INFO: $family $size $stage: exit code $code"
+	return $code
+}
+
+for family in $FAMILIES; do
+	for size in $SIZES; do
+		base="$OUT/$family-$size"
+		"$BIN/mesh_generator" "$family" "$size" "$base.ply" > "$base-mesh_generator.log" 2>&1 || { echo "ERROR! mesh_generator failed for $family $size"; continue; }
+		# Each stage only runs if the stages it depends on succeeded, a failure is recorded with its exit code.
+		run_stage "$family" "$size" ply_to_dimacs ply_to_dimacs "$base.ply" "$base.dimacs" &&
+		run_stage "$family" "$size" postman_tour postman_tour "$base.dimacs" "$base-multi.dimacs" &&
+		run_stage "$family" "$size" ply_to_embedding ply_to_embedding "$base.ply" "$base.vcode" &&
+		run_stage "$family" "$size" make_embedding_eulerian make_embedding_eulerian "$base.vcode" "$base-multi.dimacs" "$base.ecode" &&
+		run_stage "$family" "$size" Atrail_search Atrail_search "$base.ecode" "$base.trail" "$base.ntrail" &&
+		run_stage "$family" "$size" Atrail_verify Atrail_verify "$base.ecode" "$base.trail" &&
+		if [ "$BSCOR_RECTIFIER" = "1" ]; then
+			run_stage "$family" "$size" rectification scaffold-routing-rectification --input="$base.ply" --output="$base.rpoly"
+		fi
+	done
+done
+
+echo "INFO: Wrote the results to $RESULTS and $SUMMARY"
+
+if [ -n "$BASELINE" ]; then
+	# Compares the wall time of every stage that succeeded in both runs.
+	awk -F '\t' -v tolerance="$TOLERANCE" '
+		NR == FNR { if (FNR > 1 && $4 == 0) baseline[$1 "\t" $2 "\t" $3] = $5; next }
+		FNR > 1 && $4 == 0 && ($1 "\t" $2 "\t" $3) in baseline {
+			old = baseline[$1 "\t" $2 "\t" $3]
+			if (old > 0 && $5 > old * (1 + tolerance)) {
+				printf "REGRESSION: %s %s %s: %.3f ms -> %.3f ms\n", $1, $2, $3, old, $5
+				regressions++
+			}
+		}
+		END { if (regressions) exit 1; print "INFO: No regressions against the baseline." }' "$BASELINE" "$SUMMARY"
+fi
@@ -0,0 +1,65 @@
+/*
+ * artifact_cache.hpp
+ *
+ *  Content addressed cache of the files written by the tools of the pipeline. A tool run with --cache=<directory>, or with the
+ *  BSCOR_CACHE environment variable set to a directory, looks up the hash of its inputs in that directory before doing any work
+ *  and copies the cached outputs on a hit. The graph, Eulerization, embedding and A-trail only depend on the topology of the mesh,
+ *  so PLY files are hashed by their faces alone: rescaling or moving the vertices of a mesh reuses the outputs of an earlier run.
+ *  Entries are files named <tool>-<hash>.<output index> and are never evicted, remove the directory to clear the cache.
+ */
+
+#ifndef ARTIFACT_CACHE_HPP_
+#define ARTIFACT_CACHE_HPP_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// 128 bit hash of a tool, its version and its inputs. It is not cryptographic, the cache trusts the contents of its directory.
+class cache_key {
+public:
+	// The version is to be increased whenever the tool writes different outputs for the same inputs.
+	cache_key(std::string tool, unsigned int version);
+
+	void add(std::string value);
+	void add(uint64_t value);
+	// Hashes the contents of the file. Returns false if it can not be read.
+	bool add_file(std::string filename);
+	// Hashes the number of vertices and the face lists of an ascii PLY file, but not the vertex positions. Returns false if it can not be read.
+	bool add_ply_topology(std::string filename);
+
+	const std::string & get_tool() const { return tool; }
+	std::string to_string() const; // 32 hex digits.
+
+private:
+	void update(const char *data, std::size_t size);
+
+	std::string tool;
+	uint64_t lanes[2];
+};
+
+class artifact_cache {
+public:
+	// The cache of the running tool.
+	static artifact_cache & instance();
+
+	// Removes the --cache=<directory> argument from argv, if given, otherwise the directory is taken from BSCOR_CACHE. Caching is off without either.
+	void parse_arguments(int & argc, char ** argv);
+	bool enabled() const { return !directory.empty(); }
+
+	// Copies the outputs cached under the key to the given filenames. Returns false, and writes none of them, unless all of them are cached
+	// and could be copied. Each output is copied to a temporary name and only renamed once every copy has succeeded.
+	bool fetch(const cache_key & key, const std::vector<std::string> & outputs) const;
+	// Copies the outputs into the cache under the key. Every file is written under a temporary name and renamed,
+	// so that concurrent runs never fetch a partial entry.
+	bool store(const cache_key & key, const std::vector<std::string> & outputs) const;
+
+private:
+	artifact_cache() {}
+
+	std::string entry(const cache_key & key, std::size_t index) const;
+
+	std::string directory;
+};
+
+#endif /* ARTIFACT_CACHE_HPP_ */
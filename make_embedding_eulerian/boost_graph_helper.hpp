@@ -12,10 +12,13 @@
 #include <vector>
 #include <sstream>
 #include <string>
+#include <stdint.h>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/property_map/property_map.hpp>
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/properties.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 using namespace boost;
 
 typedef adjacency_list< listS, vecS, undirectedS,
@@ -43,11 +46,76 @@ void print_walk(std::list<Vertex> Trail, std::string label);
 std::string to_string_graph(const Graph & G, std::string lineheader = "", std::string liststart=": ", std::string adj_sep = " ", std::string line_sep ="\n");
 std::string to_string_graph_edgelist(const Graph & G, std::string pair_sep= ",", std::string edge_frame_left="{", std::string edge_frame_right="}", std::string list_sep = " ");
 
+// Binary file formats. The text formats (dimacs, vcode/ecode, trail/ntrail) stay the interchange formats, the binary
+// ones are selected by the output filename extension (see is_binary_filename) and recognized by the readers from the header.
+// Edge code (.becode) or vertex code (.bvcode): header, n+1 uint32 CSR offsets, then offsets[n] uint32 edge or vertex indices.
+// Trail (.btrail, .bntrail): header, then count uint32 edge or node indices.
+// Graph (.bdimacs): header, then count zero based uint32 (u, v) pairs, or (u, v, weight) triples for weighted graphs.
+const uint32_t binary_format_version = 1;
+const uint32_t binary_byte_order = 0x01020304;
+enum binary_kind { binary_edge_code = 1, binary_trail = 2, binary_graph = 3, binary_weighted_graph = 4, binary_vertex_code = 5 };
+struct binary_header {
+	char magic[4]; // "BSCB"
+	uint32_t version; // binary_format_version
+	uint32_t kind; // binary_kind
+	uint32_t byte_order; // binary_byte_order as written by the writer
+	uint64_t num_nodes; // number of vertices of an edge code or graph, zero for a trail
+	uint64_t count; // number of edge indices of an edge code, entries of a trail or edges of a graph
+};
+
+// True if the extension of filename is one of the binary ones: .becode, .bvcode, .btrail, .bntrail or .bdimacs.
+bool is_binary_filename(std::string filename);
+// Reads the header of a binary file, false if the file does not start with one.
+bool read_binary_header(std::string filename, binary_header & header);
+
+// A read only, memory mapped binary file. The indices are read in place from the mapping, nothing is copied.
+class mapped_binary_file {
+public:
+	mapped_binary_file() : header(NULL), payload(NULL) {}
+	const binary_header & get_header() const { return *header; }
+protected:
+	// Maps the file and checks its header against kind.
+	bool open(std::string filename, binary_kind kind);
+	// Checks that at least payload_words uint32 words follow the header.
+	bool check_payload_size(std::string filename, uint64_t payload_words) const;
+	const uint32_t * get_payload() const { return payload; }
+private:
+	boost::interprocess::file_mapping file;
+	boost::interprocess::mapped_region region;
+	const binary_header * header;
+	const uint32_t * payload;
+};
+
+// Zero-copy view of a binary edge code as compressed sparse rows: the rotation of vertex v is edges()[offsets()[v] .. offsets()[v+1]).
+// Opened with binary_vertex_code, it is a vertex code whose rotations list the neighbouring vertices instead.
+class mapped_edge_code : public mapped_binary_file {
+public:
+	bool open(std::string filename, binary_kind kind = binary_edge_code);
+	std::size_t size() const { return (std::size_t) get_header().num_nodes; }
+	const uint32_t * offsets() const { return get_payload(); }
+	const uint32_t * edges() const { return get_payload() + size() + 1; }
+	std::size_t degree(std::size_t v) const { return offsets()[v + 1] - offsets()[v]; }
+	const uint32_t * rotation_begin(std::size_t v) const { return edges() + offsets()[v]; }
+	const uint32_t * rotation_end(std::size_t v) const { return edges() + offsets()[v + 1]; }
+};
+
+// Zero-copy view of a binary edge or node trail.
+class mapped_trail : public mapped_binary_file {
+public:
+	bool open(std::string filename);
+	std::size_t size() const { return (std::size_t) get_header().count; }
+	const uint32_t * data() const { return get_payload(); }
+};
+
 bool read_dimacs(std::string input_filename, Graph & G);
 bool write_dimacs(std::string output_filename, Graph & G);
-bool read_weighed_dimacs(std::string input_filename, Graph & G);
 bool write_weighed_dimacs(std::string output_filename, Graph & G);
-bool read_edge_code(std::string input_filename, std::vector<std::vector<std::size_t> > & edge_code);
-bool write_edge_code(std::string filename, std::vector<std::vector<std::size_t> > edge_code);
+bool read_weighed_dimacs(std::string input_filename, Graph & G);
+// A vertex code has the text format of an edge code, its binary form is read with kind binary_vertex_code and written to .bvcode files.
+bool read_edge_code(std::string input_filename, std::vector<std::vector<std::size_t> > & edge_code, binary_kind kind = binary_edge_code);
+bool write_edge_code(std::string filename, const std::vector<std::vector<std::size_t> > & edge_code);
+// Reads and writes an edge trail (.trail) or node trail (.ntrail), a single line of indices in the text format.
+bool read_trail(std::string input_filename, std::vector<std::size_t> & trail);
+bool write_trail(std::string output_filename, const std::vector<std::size_t> & trail);
 
 #endif /* BOOST_GRAPH_HELPER_HPP_ */
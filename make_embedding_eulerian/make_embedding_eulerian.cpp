@@ -7,6 +7,8 @@
 *  Argument 1: filename of input embedding in vcode format.
 *  Argument 2: filename of input multigraph in dimacs format.
 *  Argument 3 (optional): filename of output edge code, if not given the input vcode filename with an extension .ecode is used.
+*  Optional: --stats=json or --stats=<filename> reports the time and memory spent per stage, see pipeline_stats.hpp.
+*  Optional: --cache=<directory> reuses the edge code of an earlier run on the same vcode and multigraph, see artifact_cache.hpp.
 */
 #include <iostream>
 #include <fstream>
@@ -18,6 +20,8 @@
 #include <boost/graph/connected_components.hpp>
 #include <boost/graph/johnson_all_pairs_shortest.hpp>
 #include "boost_graph_helper.hpp"
+#include "pipeline_stats.hpp"
+#include "artifact_cache.hpp"
 
 
 #define NDEBUG
@@ -37,6 +41,10 @@ typedef struct {
 
 int main(int argc, char* argv[])
 {
+	stats_report report("make_embedding_eulerian", argc, argv);
+	pipeline_stats & stats = pipeline_stats::instance();
+	artifact_cache & cache = artifact_cache::instance();
+	cache.parse_arguments(argc, argv);
 	std::cout << "INFO: make_embedding_eulerian, converts an embedding given as vcode (local rotation of vertices) to embedding as local rotation of edges. " << std::endl;
 	if (argc < 3)
 		std::cerr << "ERROR! Usage: make_embedding_eulerian input_vcode input_dimacs [output_ecode]" << std::endl;
@@ -49,15 +57,35 @@ int main(int argc, char* argv[])
 
 		if (argc >= 4) out_ecode = std::string(argv[3]);
 		else out_ecode = in_vcode.substr(0, in_vcode.find_last_of('.')).append(".ecode");
+		cache_key key("make_embedding_eulerian", 1);
+		bool keyed = false; // Nothing is stored unless every input was hashed.
+		if (cache.enabled())
+		{
+			scoped_stage cache_stage("cache_lookup");
+			key.add(is_binary_filename(out_ecode) ? "binary" : "text");
+			keyed = key.add_file(in_vcode) && key.add_file(in_dimacs);
+			if (keyed && cache.fetch(key, std::vector<std::string>(1, out_ecode)))
+			{
+				stats.set_counter("cache_hits", 1);
+				std::cout << "INFO: Copied the cached edge code of " << in_vcode << " and " << in_dimacs << " to " << out_ecode << std::endl;
+				return EXIT_SUCCESS;
+			}
+		}
 		embedding_t vcode;
 		Graph ingraph;
 		
-		if (!read_edge_code(in_vcode, vcode)) return 1; // vertex code is the same type as edge code and can be read as such ...
+		stats.begin_stage("read_vcode");
+		if (!read_edge_code(in_vcode, vcode, binary_vertex_code)) return 1; // vertex code is the same type as edge code and can be read as such ...
 		else
 			std::cout << "INFO: Successfully read vcode from " << in_vcode << "."<<std::endl;
+		stats.end_stage();
+		stats.begin_stage("read_dimacs");
 		if (!read_dimacs(in_dimacs, ingraph)) return 1;
 		else
 			std::cout << "INFO: Successfully read multigraph from " << in_dimacs << "." << std::endl;
+		stats.end_stage();
+		stats.set_counter("vertices", num_vertices(ingraph));
+		stats.set_counter("edges", num_edges(ingraph));
 		DEBUGPRINT(std::cout << to_string_graph(ingraph) << std::endl;)
 
 		
@@ -78,6 +106,8 @@ int main(int argc, char* argv[])
 		}
 
 		std::cout << "INFO: Creating the edge code from the given the vertex code and the multigraph ..." << std::endl;
+		stats.begin_stage("rotation_build");
+		std::size_t num_multiedges = 0;
 
 		EdgeIterator e_it, e_end;
 		boost::tie(e_it, e_end) = edges(ingraph);
@@ -100,6 +130,7 @@ int main(int argc, char* argv[])
 			}
 			else
 			{
+				++num_multiedges;
 				if (s < t)
 				{
 					vep.vertex = embedding_as_pair[s][i].vertex;
@@ -130,8 +161,13 @@ int main(int argc, char* argv[])
 			}
 		}
 
-		write_edge_code(out_ecode, ecode);
+		stats.end_stage();
+		stats.set_counter("multiedges", num_multiedges);
+		stats.begin_stage("write_ecode");
+		const bool written = write_edge_code(out_ecode, ecode);
+		stats.end_stage();
 		std::cout << "INFO: Wrote the embedding as an edge code to " << out_ecode << std::endl;
+		if (written && keyed) cache.store(key, std::vector<std::string>(1, out_ecode));
 		
 		
 		return EXIT_SUCCESS;
@@ -0,0 +1,308 @@
+/*
+ * mesh_generator.cpp
+ *
+ *  Generates synthetic meshes of a given size as PLY files, for benchmarking the pipeline on inputs from a hundred to millions of edges.
+ *  Argument 1: the mesh family, one of
+ *      sphere     geodesic sphere, an icosahedron with every face subdivided into triangles and projected on a sphere.
+ *      cube       subdivided polyhedron, a cube with every face subdivided into a grid of quads.
+ *      torus      torus of quads, note that its graph is not planar.
+ *      quadsheet  flat sheet of quads.
+ *      trisheet   flat sheet of triangles, all interior vertices have degree 6.
+ *      degree6    flat sheet of quads where a number of interior vertices are raised to degree 6 by splitting two opposite quads around them.
+ *      degree8    flat sheet of quads where a number of interior vertices are raised to degree 8 by splitting all four quads around them.
+ *  Argument 2: the approximate number of edges of the mesh. The nearest size the family allows is used.
+ *  Argument 3: filename of the output PLY.
+ *  Argument 4 (optional): for degree6 and degree8, the number of raised vertices, by default a tenth of the candidate vertices.
+ *  Argument 5 (optional): seed for picking the raised vertices, by default 1. The same seed always gives the same mesh.
+ *  The edge length of all families is about 20 (nm, as the PLY coordinates are read by the rectifier).
+ */
+
+#define _USE_MATH_DEFINES
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+static const double kEdgeLength = 20.0;
+
+struct point {
+	double x, y, z;
+};
+
+static point make_point(double x, double y, double z)
+{
+	point p = { x, y, z };
+	return p;
+}
+
+// Vertices and faces of a mesh, shared vertices are merged by their position when the faces are added.
+class mesh_builder {
+public:
+	std::size_t vertex(const point & p)
+	{
+		const key_t key(std::make_pair(std::llround(p.x * 1e6), std::make_pair(std::llround(p.y * 1e6), std::llround(p.z * 1e6))));
+		std::map<key_t, std::size_t>::const_iterator it = index.find(key);
+		if (it != index.end()) return it->second;
+		index.insert(std::make_pair(key, vertices.size()));
+		vertices.push_back(p);
+		return vertices.size() - 1;
+	}
+	// Faces are given counter clockwise as seen from the outside, or from +z for flat sheets.
+	void face(std::size_t a, std::size_t b, std::size_t c)
+	{
+		std::vector<std::size_t> f(3);
+		f[0] = a; f[1] = b; f[2] = c;
+		faces.push_back(f);
+	}
+	void face(std::size_t a, std::size_t b, std::size_t c, std::size_t d)
+	{
+		std::vector<std::size_t> f(4);
+		f[0] = a; f[1] = b; f[2] = c; f[3] = d;
+		faces.push_back(f);
+	}
+	std::size_t num_edges() const
+	{
+		std::size_t sum = 0;
+		for (std::size_t i = 0; i < faces.size(); ++i) sum += faces[i].size();
+		return (sum + boundary_edges) / 2;
+	}
+	std::vector<point> vertices;
+	std::vector<std::vector<std::size_t> > faces;
+	std::size_t boundary_edges = 0; // number of edges on the boundary of a flat sheet, they belong to a single face only
+private:
+	typedef std::pair<long long, std::pair<long long, long long> > key_t;
+	std::map<key_t, std::size_t> index;
+};
+
+// Geodesic sphere of frequency n: 10 n^2 + 2 vertices and 30 n^2 edges.
+static void make_sphere(std::size_t target_edges, mesh_builder & mesh)
+{
+	const std::size_t n = std::max<std::size_t>(1, (std::size_t) std::floor(std::sqrt(target_edges / 30.0) + 0.5));
+	const double t = (1.0 + std::sqrt(5.0)) / 2.0;
+	const point ico[12] = {
+		make_point(-1, t, 0), make_point(1, t, 0), make_point(-1, -t, 0), make_point(1, -t, 0),
+		make_point(0, -1, t), make_point(0, 1, t), make_point(0, -1, -t), make_point(0, 1, -t),
+		make_point(t, 0, -1), make_point(t, 0, 1), make_point(-t, 0, -1), make_point(-t, 0, 1) };
+	const int ico_faces[20][3] = {
+		{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+		{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+		{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+		{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 } };
+	// Subdivide every face on the icosahedron itself so that shared edges give identical points, project afterwards.
+	for (int f = 0; f < 20; ++f)
+	{
+		const point & a = ico[ico_faces[f][0]];
+		const point & b = ico[ico_faces[f][1]];
+		const point & c = ico[ico_faces[f][2]];
+		std::vector<std::vector<std::size_t> > row(n + 1);
+		for (std::size_t i = 0; i <= n; ++i)
+		{
+			for (std::size_t j = 0; j <= n - i; ++j)
+			{
+				const double u = double(i) / n, v = double(j) / n, w = 1.0 - u - v;
+				row[i].push_back(mesh.vertex(make_point(w * a.x + u * b.x + v * c.x, w * a.y + u * b.y + v * c.y, w * a.z + u * b.z + v * c.z)));
+			}
+		}
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			for (std::size_t j = 0; j < n - i; ++j)
+			{
+				mesh.face(row[i][j], row[i + 1][j], row[i][j + 1]);
+				if (j + 1 < n - i) mesh.face(row[i + 1][j], row[i + 1][j + 1], row[i][j + 1]);
+			}
+		}
+	}
+	// The chord between neighbouring vertices is about 1.05 / n of the circumradius.
+	const double radius = kEdgeLength * n / 1.05;
+	for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+	{
+		point & p = mesh.vertices[i];
+		const double s = radius / std::sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+		p.x *= s; p.y *= s; p.z *= s;
+	}
+}
+
+// Cube with every face subdivided into n x n quads: 6 n^2 + 2 vertices and 12 n^2 edges.
+static void make_cube(std::size_t target_edges, mesh_builder & mesh)
+{
+	const std::size_t n = std::max<std::size_t>(1, (std::size_t) std::floor(std::sqrt(target_edges / 12.0) + 0.5));
+	const double h = kEdgeLength * n / 2.0;
+	// For each face the normal axis, its side, and the two axes spanning it such that (u, v, normal) is right handed.
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		for (int side = -1; side <= 1; side += 2)
+		{
+			const int u_axis = (axis + (side > 0 ? 1 : 2)) % 3;
+			const int v_axis = (axis + (side > 0 ? 2 : 1)) % 3;
+			std::vector<std::vector<std::size_t> > grid(n + 1, std::vector<std::size_t>(n + 1));
+			for (std::size_t i = 0; i <= n; ++i)
+			{
+				for (std::size_t j = 0; j <= n; ++j)
+				{
+					double c[3];
+					c[axis] = side * h;
+					c[u_axis] = -h + kEdgeLength * i;
+					c[v_axis] = -h + kEdgeLength * j;
+					grid[i][j] = mesh.vertex(make_point(c[0], c[1], c[2]));
+				}
+			}
+			for (std::size_t i = 0; i < n; ++i)
+				for (std::size_t j = 0; j < n; ++j)
+					mesh.face(grid[i][j], grid[i + 1][j], grid[i + 1][j + 1], grid[i][j + 1]);
+		}
+	}
+}
+
+// Torus of m x 2m quads: 2 m^2 vertices and 4 m^2 edges.
+static void make_torus(std::size_t target_edges, mesh_builder & mesh)
+{
+	const std::size_t m = std::max<std::size_t>(3, (std::size_t) std::floor(std::sqrt(target_edges / 4.0) + 0.5));
+	const std::size_t n = 2 * m;
+	const double tube = kEdgeLength * m / (2 * M_PI), ring = kEdgeLength * n / (2 * M_PI);
+	std::vector<std::vector<std::size_t> > grid(n, std::vector<std::size_t>(m));
+	for (std::size_t i = 0; i < n; ++i)
+	{
+		const double phi = 2 * M_PI * i / n;
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			const double theta = 2 * M_PI * j / m;
+			const double r = ring + tube * std::cos(theta);
+			grid[i][j] = mesh.vertex(make_point(r * std::cos(phi), r * std::sin(phi), tube * std::sin(theta)));
+		}
+	}
+	for (std::size_t i = 0; i < n; ++i)
+		for (std::size_t j = 0; j < m; ++j)
+			mesh.face(grid[i][j], grid[(i + 1) % n][j], grid[(i + 1) % n][(j + 1) % m], grid[i][(j + 1) % m]);
+}
+
+// Flat sheet of m x m quads, 2 m (m + 1) edges. Split quads are triangulated through their corner closest to a raised vertex.
+// raise selects how many of the candidate interior vertices get degree 6 (split_two) or 8 (otherwise), candidates are spaced apart so their quads are disjoint.
+static void make_sheet(std::size_t target_edges, bool triangles, std::size_t raise, bool split_two, unsigned int seed, bool default_raise, mesh_builder & mesh)
+{
+	// Quads: E = 2 m^2 + 2 m, triangles: E = 3 m^2 + 2 m.
+	const double k = triangles ? 3.0 : 2.0;
+	const std::size_t m = std::max<std::size_t>(2, (std::size_t) std::floor((-2.0 + std::sqrt(4.0 + 4 * k * target_edges)) / (2 * k) + 0.5));
+	std::vector<std::vector<std::size_t> > grid(m + 1, std::vector<std::size_t>(m + 1));
+	for (std::size_t i = 0; i <= m; ++i)
+		for (std::size_t j = 0; j <= m; ++j)
+			grid[i][j] = mesh.vertex(make_point(kEdgeLength * i, kEdgeLength * j, 0));
+	mesh.boundary_edges = 4 * m;
+
+	// cell_split[i][j]: 0 not split, 1 split along the diagonal (i, j)-(i + 1, j + 1), 2 split along (i + 1, j)-(i, j + 1).
+	std::vector<std::vector<char> > cell_split(m, std::vector<char>(m, triangles ? 1 : 0));
+	if (!triangles)
+	{
+		std::vector<std::pair<std::size_t, std::size_t> > candidates;
+		for (std::size_t i = 1; i < m; i += 2)
+			for (std::size_t j = 1; j < m; j += 2)
+				candidates.push_back(std::make_pair(i, j));
+		if (default_raise) raise = candidates.size() / 10;
+		if (raise > candidates.size())
+		{
+			std::cerr << "WARNING: Only " << candidates.size() << " vertices can be raised in a sheet of this size." << std::endl;
+			raise = candidates.size();
+		}
+		std::mt19937 generator(seed);
+		std::shuffle(candidates.begin(), candidates.end(), generator);
+		for (std::size_t c = 0; c < raise; ++c)
+		{
+			const std::size_t i = candidates[c].first, j = candidates[c].second;
+			// The four cells around vertex (i, j), split through it.
+			cell_split[i - 1][j - 1] = 1;
+			cell_split[i][j] = 1;
+			if (!split_two)
+			{
+				cell_split[i][j - 1] = 2;
+				cell_split[i - 1][j] = 2;
+			}
+		}
+		std::cout << "INFO: Raised " << raise << " vertices to degree " << (split_two ? 6 : 8) << "." << std::endl;
+	}
+	for (std::size_t i = 0; i < m; ++i)
+	{
+		for (std::size_t j = 0; j < m; ++j)
+		{
+			const std::size_t a = grid[i][j], b = grid[i + 1][j], c = grid[i + 1][j + 1], d = grid[i][j + 1];
+			if (cell_split[i][j] == 0) mesh.face(a, b, c, d);
+			else if (cell_split[i][j] == 1)
+			{
+				mesh.face(a, b, c);
+				mesh.face(a, c, d);
+			}
+			else
+			{
+				mesh.face(a, b, d);
+				mesh.face(b, c, d);
+			}
+		}
+	}
+}
+
+// Writes the mesh in the ascii PLY format read by ply_to_dimacs and ply_to_embedding.
+static bool write_ply(const std::string & filename, const mesh_builder & mesh)
+{
+	std::ofstream ofs(filename.c_str(), std::ofstream::out);
+	if (!ofs.is_open())
+	{
+		std::cerr << "ERROR! Unable to create file " << filename << std::endl;
+		return false;
+	}
+	ofs << "ply\nformat ascii 1.0\n"
+		<< "element vertex " << mesh.vertices.size() << "\nproperty float x\nproperty float y\nproperty float z\n"
+		<< "element face " << mesh.faces.size() << "\nproperty list uchar int vertex_indices\nend_header\n";
+	ofs.precision(9);
+	for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+		ofs << mesh.vertices[i].x << " " << mesh.vertices[i].y << " " << mesh.vertices[i].z << "\n";
+	for (std::size_t i = 0; i < mesh.faces.size(); ++i)
+	{
+		ofs << mesh.faces[i].size();
+		for (std::size_t j = 0; j < mesh.faces[i].size(); ++j) ofs << " " << mesh.faces[i][j];
+		ofs << "\n";
+	}
+	ofs.close();
+	return !ofs.fail();
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "INFO: mesh_generator, generates synthetic PLY meshes of a given size for benchmarking." << std::endl;
+	if (argc < 4)
+	{
+		std::cerr << "ERROR! Usage: mesh_generator sphere|cube|torus|quadsheet|trisheet|degree6|degree8 target_edges output_ply [raised_vertices] [seed]" << std::endl;
+		return 1;
+	}
+	const std::string family(argv[1]);
+	const std::size_t target_edges = (std::size_t) strtoul(argv[2], NULL, 10);
+	const std::string outputply(argv[3]);
+	const bool default_raise = argc < 5;
+	const std::size_t raise = default_raise ? 0 : (std::size_t) strtoul(argv[4], NULL, 10);
+	const unsigned int seed = argc >= 6 ? (unsigned int) strtoul(argv[5], NULL, 10) : 1;
+	if (target_edges == 0)
+	{
+		std::cerr << "ERROR! The number of edges must be positive." << std::endl;
+		return 1;
+	}
+
+	mesh_builder mesh;
+	if (family == "sphere") make_sphere(target_edges, mesh);
+	else if (family == "cube") make_cube(target_edges, mesh);
+	else if (family == "torus") make_torus(target_edges, mesh);
+	else if (family == "quadsheet") make_sheet(target_edges, false, 0, false, seed, false, mesh);
+	else if (family == "trisheet") make_sheet(target_edges, true, 0, false, seed, false, mesh);
+	else if (family == "degree6") make_sheet(target_edges, false, raise, true, seed, default_raise, mesh);
+	else if (family == "degree8") make_sheet(target_edges, false, raise, false, seed, default_raise, mesh);
+	else
+	{
+		std::cerr << "ERROR! Unknown mesh family " << family << "." << std::endl;
+		return 1;
+	}
+
+	if (!write_ply(outputply, mesh)) return 1;
+	std::cout << "INFO: Wrote a " << family << " mesh with " << mesh.vertices.size() << " vertices, " << mesh.num_edges() << " edges and " << mesh.faces.size() << " faces to " << outputply << "." << std::endl;
+	return EXIT_SUCCESS;
+}
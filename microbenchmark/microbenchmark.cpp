@@ -0,0 +1,364 @@
+/*
+ * microbenchmark.cpp
+ *
+ *  Times the graph kernels of the pipeline in isolation, with warm-up runs, repetitions and percentiles of the run times.
+ *  The inputs are fixed: an octahedron with every face subdivided into triangles (all vertices have degree 4 or 6, so it is Eulerian
+ *  and has many branch nodes), its PLY and edge code files, an A-trail of it, and a seeded choice of vertices to match for the postman kernel.
+ *  Optional arguments:
+ *    --filter=<substring>   only run the kernels whose name contains the substring.
+ *    --warmup=<n>           untimed runs before the timed ones, by default 3.
+ *    --repetitions=<n>      timed runs, by default 30.
+ *    --frequency=<n>        subdivision frequency of the octahedron, giving 4 n^2 + 2 vertices and 12 n^2 edges, by default 12.
+ *    --depth=<n>            number of branch nodes split_and_check splits, by default 16.
+ *    --odd_vertices=<n>     number of vertices matched by the postman matching, by default 200.
+ *    --seed=<n>             seed for picking the matched vertices, by default 1.
+ *    --output=<filename>    also write the results as one JSON object per line.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <queue>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include "../Atrail_search/Atrail.hpp"
+#include "../Atrail_verify/Atrail_verifier.hpp"
+#include "../ply_to_dimacs/ply_reader.hpp"
+#include "../postman_tour/postman_matching.hpp"
+
+struct settings {
+	std::string filter, output;
+	unsigned int warmup, repetitions, frequency, depth, odd_vertices, seed;
+};
+
+// A kernel to time. setup runs untimed before every run, e.g. to restore an input the kernel modifies.
+struct kernel {
+	std::string name;
+	std::function<void()> setup;
+	std::function<void()> run;
+};
+
+// Fixed inputs of all kernels.
+struct inputs {
+	std::vector<double> coordinates; // x, y, z of every vertex
+	std::vector<std::vector<std::size_t> > faces;
+	std::vector<std::vector<std::size_t> > edge_code;
+	std::vector<std::vector<Vertex> > rotation; // adjacent vertices in the order of the edge code
+	Graph G;
+	std::vector<std::size_t> trail;
+	std::vector<std::vector<int> > D;
+	std::vector<Vertex> odd_vertices;
+	std::string ply_file, edgecode_file;
+};
+
+// Subdivides every face of the octahedron into frequency^2 triangles. The faces are oriented counter clockwise seen from outside.
+static void make_subdivided_octahedron(unsigned int frequency, inputs & in)
+{
+	const int corners[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+	const int faces[8][3] = { { 0, 2, 4 }, { 2, 1, 4 }, { 1, 3, 4 }, { 3, 0, 4 }, { 2, 0, 5 }, { 1, 2, 5 }, { 3, 1, 5 }, { 0, 3, 5 } };
+	const int f = (int) frequency;
+	// Points on the octahedron have integer coordinates when scaled by the frequency, which identifies the shared ones exactly.
+	std::map<std::vector<int>, std::size_t> index;
+	for (int t = 0; t < 8; ++t)
+	{
+		std::vector<std::vector<std::size_t> > row(f + 1);
+		for (int i = 0; i <= f; ++i)
+		{
+			for (int j = 0; j <= f - i; ++j)
+			{
+				std::vector<int> key(3);
+				for (int k = 0; k < 3; ++k) key[k] = (f - i - j) * corners[faces[t][0]][k] + i * corners[faces[t][1]][k] + j * corners[faces[t][2]][k];
+				std::map<std::vector<int>, std::size_t>::iterator it = index.find(key);
+				if (it == index.end())
+				{
+					it = index.insert(std::make_pair(key, in.coordinates.size() / 3)).first;
+					const double norm = std::sqrt(double(key[0] * key[0] + key[1] * key[1] + key[2] * key[2]));
+					for (int k = 0; k < 3; ++k) in.coordinates.push_back(10.0 * f * key[k] / norm);
+				}
+				row[i].push_back(it->second);
+			}
+		}
+		for (int i = 0; i < f; ++i)
+		{
+			for (int j = 0; j < f - i; ++j)
+			{
+				std::vector<std::size_t> face(3);
+				face[0] = row[i][j]; face[1] = row[i + 1][j]; face[2] = row[i][j + 1];
+				in.faces.push_back(face);
+				if (j + 1 < f - i)
+				{
+					face[0] = row[i + 1][j]; face[1] = row[i + 1][j + 1]; face[2] = row[i][j + 1];
+					in.faces.push_back(face);
+				}
+			}
+		}
+	}
+
+	// The rotation around every vertex follows from the faces: in a face (a, b, c) the neighbour a of b is followed by c.
+	const std::size_t n = in.coordinates.size() / 3;
+	std::vector<std::map<std::size_t, std::size_t> > successor(n);
+	for (std::size_t i = 0; i < in.faces.size(); ++i)
+		for (std::size_t k = 0; k < 3; ++k)
+			successor[in.faces[i][(k + 1) % 3]][in.faces[i][k]] = in.faces[i][(k + 2) % 3];
+	std::map<std::pair<std::size_t, std::size_t>, std::size_t> edge_indices;
+	in.edge_code.assign(n, std::vector<std::size_t>());
+	in.rotation.assign(n, std::vector<Vertex>());
+	for (std::size_t v = 0; v < n; ++v)
+	{
+		const std::size_t first = successor[v].begin()->first;
+		std::size_t u = first;
+		do
+		{
+			const std::pair<std::size_t, std::size_t> key(std::min(u, v), std::max(u, v));
+			std::map<std::pair<std::size_t, std::size_t>, std::size_t>::iterator it = edge_indices.find(key);
+			if (it == edge_indices.end()) it = edge_indices.insert(std::make_pair(key, edge_indices.size())).first;
+			in.edge_code[v].push_back(it->second);
+			in.rotation[v].push_back(u);
+			u = successor[v][u];
+		} while (u != first);
+	}
+
+	// The graph with edge indices as Atrail_search builds it from an edge code.
+	in.G = Graph(n);
+	std::vector<std::pair<std::size_t, std::size_t> > ends(edge_indices.size());
+	for (std::map<std::pair<std::size_t, std::size_t>, std::size_t>::iterator it = edge_indices.begin(); it != edge_indices.end(); ++it)
+		ends[it->second] = it->first;
+	for (std::size_t e = 0; e < ends.size(); ++e)
+		add_edge(ends[e].first, ends[e].second, e, in.G);
+}
+
+static bool write_inputs(inputs & in)
+{
+	in.ply_file = "microbenchmark_input.ply";
+	in.edgecode_file = "microbenchmark_input.ecode";
+	std::ofstream ply(in.ply_file.c_str(), std::ofstream::out);
+	if (!ply.is_open())
+	{
+		std::cerr << "ERROR! Unable to create file " << in.ply_file << std::endl;
+		return false;
+	}
+	ply << "ply\nformat ascii 1.0\nelement vertex " << in.coordinates.size() / 3 << "\nproperty float x\nproperty float y\nproperty float z\n"
+		<< "element face " << in.faces.size() << "\nproperty list uchar int vertex_indices\nend_header\n";
+	for (std::size_t i = 0; i < in.coordinates.size(); i += 3)
+		ply << in.coordinates[i] << " " << in.coordinates[i + 1] << " " << in.coordinates[i + 2] << "\n";
+	for (std::size_t i = 0; i < in.faces.size(); ++i)
+		ply << "3 " << in.faces[i][0] << " " << in.faces[i][1] << " " << in.faces[i][2] << "\n";
+	ply.close();
+	return !ply.fail() && write_edge_code(in.edgecode_file, in.edge_code);
+}
+
+// Shortest path distances, in edges, from the seeded choice of vertices matched by the postman kernel. Only their rows of D are filled.
+static void make_matching_input(unsigned int num_odd_vertices, unsigned int seed, inputs & in)
+{
+	const std::size_t n = num_vertices(in.G);
+	std::vector<Vertex> all(n);
+	for (std::size_t v = 0; v < n; ++v) all[v] = v;
+	std::mt19937 generator(seed);
+	std::shuffle(all.begin(), all.end(), generator);
+	in.odd_vertices.assign(all.begin(), all.begin() + std::min<std::size_t>(n - n % 2, num_odd_vertices - num_odd_vertices % 2));
+	in.D.assign(n, std::vector<int>(n, 0));
+	for (std::size_t i = 0; i < in.odd_vertices.size(); ++i)
+	{
+		std::vector<int> & distance = in.D[in.odd_vertices[i]];
+		std::vector<bool> seen(n, false);
+		std::queue<Vertex> queue;
+		queue.push(in.odd_vertices[i]);
+		seen[in.odd_vertices[i]] = true;
+		while (!queue.empty())
+		{
+			const Vertex u = queue.front();
+			queue.pop();
+			AdjacencyIterator ait, aend;
+			for (boost::tie(ait, aend) = adjacent_vertices(u, in.G); ait != aend; ++ait)
+			{
+				if (!seen[*ait])
+				{
+					seen[*ait] = true;
+					distance[*ait] = distance[u] + 1;
+					queue.push(*ait);
+				}
+			}
+		}
+	}
+}
+
+// Nearest rank percentile of the sorted samples.
+static double percentile(const std::vector<double> & sorted, double p)
+{
+	std::size_t rank = (std::size_t) std::ceil(p / 100.0 * sorted.size());
+	return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+static bool parse_arguments(int argc, char * argv[], settings & s)
+{
+	s.warmup = 3;
+	s.repetitions = 30;
+	s.frequency = 12;
+	s.depth = 16;
+	s.odd_vertices = 200;
+	s.seed = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string argument(argv[i]);
+		const std::size_t equal = argument.find('=');
+		const std::string name = argument.substr(0, equal), value = (equal == std::string::npos) ? "" : argument.substr(equal + 1);
+		const unsigned int number = (unsigned int) strtoul(value.c_str(), NULL, 10);
+		if (name == "--filter") s.filter = value;
+		else if (name == "--output") s.output = value;
+		else if (name == "--warmup") s.warmup = number;
+		else if (name == "--repetitions") s.repetitions = std::max(1u, number);
+		else if (name == "--frequency") s.frequency = std::max(1u, number);
+		else if (name == "--depth") s.depth = number;
+		else if (name == "--odd_vertices") s.odd_vertices = number;
+		else if (name == "--seed") s.seed = number;
+		else
+		{
+			std::cerr << "ERROR! Unknown argument " << argument << std::endl;
+			std::cerr << "Usage: microbenchmark [--filter=<substring>] [--warmup=<n>] [--repetitions=<n>] [--frequency=<n>] [--depth=<n>] [--odd_vertices=<n>] [--seed=<n>] [--output=<filename>]" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char * argv[])
+{
+	std::cout << "INFO: microbenchmark, times the graph kernels of the pipeline in isolation." << std::endl;
+	settings s;
+	if (!parse_arguments(argc, argv, s)) return 1;
+
+	// The kernels report their progress on stdout, which is silenced while they run.
+	std::ostringstream discard;
+	std::streambuf * console = std::cout.rdbuf();
+
+	inputs in;
+	make_subdivided_octahedron(s.frequency, in);
+	if (!write_inputs(in)) return 1;
+	make_matching_input(s.odd_vertices, s.seed, in);
+	std::cout << "INFO: Input: subdivided octahedron of frequency " << s.frequency << " with " << num_vertices(in.G) << " vertices and " << num_edges(in.G) << " edges." << std::endl;
+
+	// An A-trail for Atrail_verify, so that the verification walks the whole trail.
+	{
+		Graph G = in.G;
+		std::vector<std::vector<std::size_t> > edge_code = in.edge_code;
+		std::list<std::size_t> trail;
+		std::list<Vertex> node_trail;
+		std::cout.rdbuf(discard.rdbuf());
+		const bool found = Atrail_search(G, edge_code, trail, node_trail);
+		std::cout.rdbuf(console);
+		if (!found) std::cerr << "WARNING: No A-trail found for the input, Atrail_verify is timed on a rejected trail." << std::endl;
+		in.trail.assign(trail.begin(), trail.end());
+		if (in.trail.empty())
+		{
+			std::list<Vertex> eulerian_trail = find_eulerian_trail(in.G);
+			for (std::list<Vertex>::iterator it = eulerian_trail.begin(), next = ++eulerian_trail.begin(); next != eulerian_trail.end(); ++it, ++next)
+				in.trail.push_back(get(edge_index, in.G, edge(*it, *next, in.G).first));
+		}
+	}
+
+	std::vector<unsigned int> branch_nodes;
+	enumerate_intersectable_nodes(in.G, branch_nodes);
+	if (branch_nodes.size() > s.depth) branch_nodes.resize(s.depth);
+	std::cout << "INFO: split_and_check splits " << branch_nodes.size() << " branch nodes, the matching pairs up " << in.odd_vertices.size() << " vertices." << std::endl;
+
+	// Results of the kernels are kept alive here so that the work is not optimized away.
+	Graph G_work, G_read;
+	std::vector<std::vector<std::size_t> > edge_code_read;
+	std::vector<unsigned int> bn_out;
+	std::list<Vertex> eulerian_trail;
+	std::vector< std::pair<Vertex, Vertex> > match;
+	std::map<Vertex, std::vector<Vertex> > bn_new_nodes_map;
+	std::size_t sink = 0;
+
+	std::vector<kernel> kernels;
+	kernel k;
+	k.setup = [](){};
+	k.name = "has_eulerian_trail";
+	k.run = [&](){ sink += has_eulerian_trail(in.G) ? 1 : 0; };
+	kernels.push_back(k);
+	k.name = "find_eulerian_trail";
+	k.run = [&](){ eulerian_trail = find_eulerian_trail(in.G); };
+	kernels.push_back(k);
+	k.name = "enumerate_intersectable_nodes";
+	k.run = [&](){ enumerate_intersectable_nodes(in.G, bn_out); };
+	kernels.push_back(k);
+	k.name = "split_and_check";
+	k.setup = [&](){ G_work = in.G; bn_new_nodes_map.clear(); };
+	k.run = [&](){ sink += split_and_check(G_work, in.rotation, branch_nodes, 0, odd_even, bn_new_nodes_map, std::vector<parity>()) ? 1 : 0; };
+	kernels.push_back(k);
+	k.name = "read_ply";
+	k.setup = [](){};
+	k.run = [&](){ sink += read_ply(in.ply_file, G_read) ? 1 : 0; };
+	kernels.push_back(k);
+	k.name = "read_edge_code";
+	k.run = [&](){ edge_code_read.clear(); sink += read_edge_code(in.edgecode_file, edge_code_read) ? 1 : 0; };
+	kernels.push_back(k);
+	k.name = "Atrail_verify";
+	k.run = [&](){ sink += Atrail_verify(in.edge_code, in.trail) ? 1 : 0; };
+	kernels.push_back(k);
+	k.name = "postman_matching";
+	k.run = [&](){ match = min_weight_odd_vertex_matching(in.D, in.odd_vertices); };
+	kernels.push_back(k);
+
+	std::ofstream output;
+	if (!s.output.empty())
+	{
+		output.open(s.output.c_str(), std::ofstream::out);
+		if (!output.is_open())
+		{
+			std::cerr << "ERROR! Unable to create file " << s.output << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << std::left << std::setw(32) << "kernel" << std::right << std::setw(6) << "reps"
+		<< std::setw(12) << "min(ms)" << std::setw(12) << "p50(ms)" << std::setw(12) << "p90(ms)" << std::setw(12) << "p99(ms)"
+		<< std::setw(12) << "max(ms)" << std::setw(12) << "mean(ms)" << std::endl;
+	std::cout << std::fixed << std::setprecision(4);
+	if (output.is_open()) output << std::fixed << std::setprecision(4);
+	for (std::size_t i = 0; i < kernels.size(); ++i)
+	{
+		if (!s.filter.empty() && kernels[i].name.find(s.filter) == std::string::npos) continue;
+		std::vector<double> samples;
+		std::cout.rdbuf(discard.rdbuf());
+		for (unsigned int r = 0; r < s.warmup + s.repetitions; ++r)
+		{
+			kernels[i].setup();
+			const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			kernels[i].run();
+			const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			if (r >= s.warmup) samples.push_back(std::chrono::duration<double, std::milli>(end - begin).count());
+			discard.str("");
+		}
+		std::cout.rdbuf(console);
+		std::sort(samples.begin(), samples.end());
+		double sum = 0;
+		for (std::size_t j = 0; j < samples.size(); ++j) sum += samples[j];
+		std::cout << std::left << std::setw(32) << kernels[i].name << std::right << std::setw(6) << samples.size()
+			<< std::setw(12) << samples.front() << std::setw(12) << percentile(samples, 50) << std::setw(12) << percentile(samples, 90)
+			<< std::setw(12) << percentile(samples, 99) << std::setw(12) << samples.back() << std::setw(12) << sum / samples.size() << std::endl;
+		if (output.is_open())
+			output << "{\"kernel\":\"" << kernels[i].name << "\",\"repetitions\":" << samples.size() << ",\"min_ms\":" << samples.front()
+				<< ",\"p50_ms\":" << percentile(samples, 50) << ",\"p90_ms\":" << percentile(samples, 90) << ",\"p99_ms\":" << percentile(samples, 99)
+				<< ",\"max_ms\":" << samples.back() << ",\"mean_ms\":" << sum / samples.size() << "}\n";
+	}
+	if (output.is_open())
+	{
+		output.close();
+		std::cout << "INFO: Wrote the results to " << s.output << std::endl;
+	}
+
+	remove(in.ply_file.c_str());
+	remove(in.edgecode_file.c_str());
+	return sink == 0 ? 1 : EXIT_SUCCESS; // At least the reads succeed, keeps sink observable.
+}
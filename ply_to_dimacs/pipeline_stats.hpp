@@ -0,0 +1,75 @@
+/*
+ * pipeline_stats.hpp
+ *
+ *  Per stage wall time, CPU time and peak resident set size, plus algorithm counters, for the tools of the pipeline.
+ *  A tool run with --stats=json prints the statistics as a single JSON line prefixed with "STATS: " to stdout,
+ *  with --stats=<filename> it writes the JSON object to that file instead.
+ */
+
+#ifndef PIPELINE_STATS_HPP_
+#define PIPELINE_STATS_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Wall clock in seconds, process CPU time (user and system) in seconds and the peak resident set size in kilobytes so far.
+struct resource_usage {
+	double wall;
+	double cpu;
+	uint64_t peak_rss_kb;
+};
+resource_usage current_resource_usage();
+
+class pipeline_stats {
+public:
+	// The statistics of the running tool.
+	static pipeline_stats & instance();
+
+	// Removes the --stats=json or --stats=<filename> argument from argv, if given, and enables the statistics.
+	void parse_arguments(std::string tool, int & argc, char ** argv);
+	bool enabled() const { return !output.empty(); }
+
+	// Starts and stops timing the named stage. Stages may nest, every stage is reported on its own.
+	void begin_stage(std::string name);
+	void end_stage();
+
+	// Algorithm counters, e.g. search nodes, backtracks or odd vertices.
+	void set_counter(std::string name, uint64_t value) { counters[name] = value; }
+	void add_counter(std::string name, uint64_t value) { counters[name] += value; }
+
+	std::string to_json() const;
+	// Writes the statistics to stdout or the file given by --stats, does nothing if the statistics are disabled.
+	bool write() const;
+
+private:
+	pipeline_stats();
+
+	struct stage {
+		std::string name;
+		resource_usage begin, end;
+	};
+
+	std::string tool, output;
+	resource_usage start;
+	std::vector<stage> stages;
+	std::vector<std::size_t> open_stages;
+	std::map<std::string, uint64_t> counters;
+};
+
+// Times a stage for as long as it is in scope.
+class scoped_stage {
+public:
+	explicit scoped_stage(std::string name) { pipeline_stats::instance().begin_stage(name); }
+	~scoped_stage() { pipeline_stats::instance().end_stage(); }
+};
+
+// Parses --stats in the constructor and writes the statistics when main returns.
+class stats_report {
+public:
+	stats_report(std::string tool, int & argc, char ** argv) { pipeline_stats::instance().parse_arguments(tool, argc, argv); }
+	~stats_report() { pipeline_stats::instance().write(); }
+};
+
+#endif /* PIPELINE_STATS_HPP_ */
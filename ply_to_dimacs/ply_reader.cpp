@@ -0,0 +1,139 @@
+/*
+ * ply_reader.cpp
+ *
+ *  See ply_reader.hpp.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include "ply_reader.hpp"
+using namespace std;
+
+bool read_ply (std::string input_filename, Graph & G)
+{
+	string line;
+	ifstream myfile (input_filename.c_str());
+	int number_faces;
+	int number_nodes;
+	std::vector<bool> check_double;
+	int nodes_per_face;
+	int start_node;
+	int end_node;
+	int aux;
+	int max;
+	int min;
+	if (myfile.is_open())
+	{
+		getline(myfile, line);
+		if( line.substr(0,3).compare("ply")) 
+		{
+			std::cerr<<"ERROR: the given file is not a PLY file"<<std::endl;
+			return false; //Making sure it is a ply file
+		}
+		
+		while ( myfile.good() )
+		{
+			getline (myfile, line);
+			//std::cout<<"Line: "<<line<<std::endl;
+			if (line.substr(0,6).compare("format") == 0)
+			{
+				std::stringstream ss(line.c_str());
+				string type;
+				string line_header;
+				//string version;
+				ss>>line_header>>type;									
+				if(type.compare("ascii") != 0)
+				{
+					std::cerr<<"ERROR: the PLY file is not ascii format"<<std::endl;
+					return false;
+				}
+			}
+			if (line.substr(0,14).compare("element vertex") == 0)
+			{
+				// Get the number of vertices
+				char *temp = new char[line.substr(15).size() + 1];
+				strcpy(temp, line.substr(15).c_str());
+				number_nodes = atoi(temp);
+				delete temp;
+				check_double = std::vector<bool>(number_nodes*number_nodes, false);
+				std::cout<<"INFO: Number of vertices: "<<number_nodes<<std::endl;
+				G = Graph(number_nodes);
+			}
+			if (line.substr(0,12).compare("element face") == 0)
+			{
+				// Get the number of faces
+				char *temp = new char[line.substr(13).size() + 1];
+				strcpy(temp, line.substr(13).c_str());
+				number_faces = atoi(temp);
+				std::cout<<"INFO: Number of faces: "<<number_faces<<std::endl;
+				delete temp;
+			}
+			if (line.substr(0,10).compare("end_header") == 0)
+			{
+				// Skip the geometric positions of the verticecs
+				for (int i = 0; i < number_nodes; i++)
+					getline(myfile, line);
+				// Obtain adjacency information from the face descriptions.
+				for (int i = 0; i < number_faces; i++)
+				{
+					getline (myfile, line);
+					//std::cout<<"line: "<<line<<std::endl;
+					char * temp = new char[line.size()+1];
+					strcpy (temp,line.c_str());
+					char *p = strtok(temp, " ");
+					nodes_per_face = atoi(p);
+					p = strtok(NULL, " ");
+					start_node = atoi(p) + 1;
+					p = strtok(NULL, " ");
+					aux = start_node;
+					end_node = atoi(p) + 1;
+					p = strtok(NULL, " ");
+					max = std::max(start_node, end_node);
+					min = std::min(start_node, end_node);
+					if (check_double[min + (max-1)*(max-2)/2] == false)
+					{
+						add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
+						check_double[min + (max-1)*(max-2)/2] = true;
+					}
+					for (int i = 2; i < nodes_per_face; i++)
+					{
+						start_node = end_node;
+						end_node = atoi(p) + 1;
+						p = strtok(NULL, " ");
+						max = std::max(start_node, end_node);
+						min = std::min(start_node, end_node);
+						if (check_double[min + (max-1)*(max-2)/2] == false)
+						{
+							add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
+							check_double[min + (max-1)*(max-2)/2] = true;
+						}
+					}
+					start_node = end_node;
+					end_node = aux;
+					max = std::max(start_node, end_node);
+					min = std::min(start_node, end_node);
+					if (check_double[min + (max-1)*(max-2)/2] == false)
+					{
+						add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
+						check_double[min + (max-1)*(max-2)/2] = true;
+					}
+					delete temp;
+				}
+			}
+		}
+		myfile.close();
+	}
+	else {
+		std::cerr << "ERROR: Unable to open file "<<input_filename<<std::endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,16 @@
+/*
+ * ply_reader.hpp
+ *
+ *  Reading the graph of a PLY mesh, shared by ply_to_dimacs and the microbenchmark.
+ */
+
+#ifndef PLY_READER_HPP_
+#define PLY_READER_HPP_
+
+#include <string>
+#include "boost_graph_helper.hpp"
+
+// Reads the ply file to the graph object. 
+bool read_ply (std::string input_filename, Graph & G);
+
+#endif /* PLY_READER_HPP_ */
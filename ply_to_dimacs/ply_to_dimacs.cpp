@@ -6,6 +6,8 @@
  *  Takes the graph information of a 3D object's mesh (ply file) and creates a graph (dimacs file).
  *  Argument 1: filename of ply document (ply ascii format http://paulbourke.net/dataformats/ply).
  *  Argument 2 (Optional): output graph filename in dimacs format, uses the ply file basename + dimacs if not given (dimacs format mat.gsia.cmu.edu/COLOR/general/ccformat.ps).
+ *  Optional: --stats=json or --stats=<filename> reports the time and memory spent per stage, see pipeline_stats.hpp.
+ *  Optional: --cache=<directory> reuses the graph of an earlier run on a mesh with the same faces, see artifact_cache.hpp.
  */
 
 // reading a text file
@@ -27,14 +29,18 @@
 #define NDEBUG
 #include <assert.h>
 #include "boost_graph_helper.hpp"
+#include "ply_reader.hpp"
+#include "pipeline_stats.hpp"
+#include "artifact_cache.hpp"
 using namespace std;
 using namespace boost;
 
-// Reads the ply file to the graph object. 
-bool read_ply (std::string input_filename, Graph & G);
-
 int main (int argc, char *argv[])
 {
+	stats_report report("ply_to_dimacs", argc, argv);
+	pipeline_stats & stats = pipeline_stats::instance();
+	artifact_cache & cache = artifact_cache::instance();
+	cache.parse_arguments(argc, argv);
 	Graph G;
 	std::cout<<"INFO: ply_to_dimacs, A simple PLY to dimacs converter."<<std::endl;
 	std::cout<<"INFO: PLY is a simple polygon format for describing 3d meshes, more info about the format can be found from http://paulbourke.net/dataformats/ply."<<std::endl;
@@ -54,10 +60,33 @@ int main (int argc, char *argv[])
 			outputdimacs = inputply.substr(0, inputply.find_last_of('.')).append(".dimacs");
 		}
 
-		if(!read_ply(inputply.c_str(), G)) return 1;
+		// The graph only depends on the faces, a mesh that was only moved or scaled is found in the cache.
+		cache_key key("ply_to_dimacs", 1);
+		bool keyed = false; // Nothing is stored unless every input was hashed.
+		if( cache.enabled())
+		{
+			scoped_stage cache_stage("cache_lookup");
+			key.add(is_binary_filename(outputdimacs) ? "binary" : "text");
+			keyed = key.add_ply_topology(inputply);
+			if( keyed && cache.fetch(key, std::vector<std::string>(1, outputdimacs)))
+			{
+				stats.set_counter("cache_hits", 1);
+				std::cout<<"INFO: Copied the cached dimacs of the faces of "<<inputply<<" to "<<outputdimacs<<"."<<std::endl;
+				return EXIT_SUCCESS;
+			}
+		}
+		stats.begin_stage("ply_parse");
+		const bool read = read_ply(inputply.c_str(), G);
+		stats.end_stage();
+		if(!read) return 1;
 		std::cout<<"INFO: Done reading the PLY file "<<inputply<<std::endl;
+		stats.set_counter("vertices", num_vertices(G));
+		stats.set_counter("edges", num_edges(G));
+		stats.begin_stage("connectivity_check");
 		std::vector<int> component(num_vertices(G));
 		unsigned int num_components = connected_components(G, &component[0]);
+		stats.end_stage();
+		stats.set_counter("components", num_components);
 
 		assert( num_components == 1);
 		if( num_components != 1 )
@@ -67,14 +96,20 @@ int main (int argc, char *argv[])
 		{
 			std::cout<<"INFO: The graph in the PLY is connected."<<std::endl;
 		}	
-		if (boyer_myrvold_planarity_test(G))
+		stats.begin_stage("planarity_check");
+		const bool is_planar = boyer_myrvold_planarity_test(G);
+		stats.end_stage();
+		if (is_planar)
 			std::cout << "INFO: The graph in the PLY is planar." << std::endl;
 		else
 		{
 			std::cerr<< "WARNING: The graph in the PLY is not planar!" << std::endl;
 		}
 		//std::cout<<"Graph:\n"<<to_string_graph(G, "Vertex ", "->\t\t\t", "\t" )<<std::endl;
-		write_dimacs(outputdimacs, G);
+		stats.begin_stage("write_dimacs");
+		const bool written = write_dimacs(outputdimacs, G);
+		stats.end_stage();
+		if( written && keyed) cache.store(key, std::vector<std::string>(1, outputdimacs));
 		std::cout<<"INFO: Successfully converted the PLY "<<inputply<<" to dimacs "<<outputdimacs<<"."<<std::endl;
 		return EXIT_SUCCESS;
 	}else
@@ -85,125 +120,3 @@ int main (int argc, char *argv[])
 	}
 
 }
-
-bool read_ply (std::string input_filename, Graph & G)
-{
-	string line;
-	ifstream myfile (input_filename.c_str());
-	int number_faces;
-	int number_nodes;
-	std::vector<bool> check_double;
-	int nodes_per_face;
-	int start_node;
-	int end_node;
-	int aux;
-	int max;
-	int min;
-	if (myfile.is_open())
-	{
-		getline(myfile, line);
-		if( line.substr(0,3).compare("ply")) 
-		{
-			std::cerr<<"ERROR: the given file is not a PLY file"<<std::endl;
-			return false; //Making sure it is a ply file
-		}
-		
-		while ( myfile.good() )
-		{
-			getline (myfile, line);
-			//std::cout<<"Line: "<<line<<std::endl;
-			if (line.substr(0,6).compare("format") == 0)
-			{
-				std::stringstream ss(line.c_str());
-				string type;
-				string line_header;
-				//string version;
-				ss>>line_header>>type;									
-				if(type.compare("ascii") != 0)
-				{
-					std::cerr<<"ERROR: the PLY file is not ascii format"<<std::endl;
-					return false;
-				}
-			}
-			if (line.substr(0,14).compare("element vertex") == 0)
-			{
-				// Get the number of vertices
-				char *temp = new char[line.substr(15).size() + 1];
-				strcpy(temp, line.substr(15).c_str());
-				number_nodes = atoi(temp);
-				delete temp;
-				check_double = std::vector<bool>(number_nodes*number_nodes, false);
-				std::cout<<"INFO: Number of vertices: "<<number_nodes<<std::endl;
-				G = Graph(number_nodes);
-			}
-			if (line.substr(0,12).compare("element face") == 0)
-			{
-				// Get the number of faces
-				char *temp = new char[line.substr(13).size() + 1];
-				strcpy(temp, line.substr(13).c_str());
-				number_faces = atoi(temp);
-				std::cout<<"INFO: Number of faces: "<<number_faces<<std::endl;
-				delete temp;
-			}
-			if (line.substr(0,10).compare("end_header") == 0)
-			{
-				// Skip the geometric positions of the verticecs
-				for (int i = 0; i < number_nodes; i++)
-					getline(myfile, line);
-				// Obtain adjacency information from the face descriptions.
-				for (int i = 0; i < number_faces; i++)
-				{
-					getline (myfile, line);
-					//std::cout<<"line: "<<line<<std::endl;
-					char * temp = new char[line.size()+1];
-					strcpy (temp,line.c_str());
-					char *p = strtok(temp, " ");
-					nodes_per_face = atoi(p);
-					p = strtok(NULL, " ");
-					start_node = atoi(p) + 1;
-					p = strtok(NULL, " ");
-					aux = start_node;
-					end_node = atoi(p) + 1;
-					p = strtok(NULL, " ");
-					max = std::max(start_node, end_node);
-					min = std::min(start_node, end_node);
-					if (check_double[min + (max-1)*(max-2)/2] == false)
-					{
-						add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
-						check_double[min + (max-1)*(max-2)/2] = true;
-					}
-					for (int i = 2; i < nodes_per_face; i++)
-					{
-						start_node = end_node;
-						end_node = atoi(p) + 1;
-						p = strtok(NULL, " ");
-						max = std::max(start_node, end_node);
-						min = std::min(start_node, end_node);
-						if (check_double[min + (max-1)*(max-2)/2] == false)
-						{
-							add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
-							check_double[min + (max-1)*(max-2)/2] = true;
-						}
-					}
-					start_node = end_node;
-					end_node = aux;
-					max = std::max(start_node, end_node);
-					min = std::min(start_node, end_node);
-					if (check_double[min + (max-1)*(max-2)/2] == false)
-					{
-						add_edge(start_node-1, end_node-1, G); //cout << "(" << start_node << ", " << end_node << ")\n"; //add_edge
-						check_double[min + (max-1)*(max-2)/2] = true;
-					}
-					delete temp;
-				}
-			}
-		}
-		myfile.close();
-	}
-	else {
-		std::cerr << "ERROR: Unable to open file "<<input_filename<<std::endl;
-		return false;
-	}
-
-	return true;
-}
@@ -6,6 +6,8 @@
  *  Takes the embedding information of a 3D object's mesh (ply file) and creates an embedding (vcode file).
  *  Argument 1: filename of ply document (ply ascii format http://paulbourke.net/dataformats/ply).
  *  Argument 2 (Optional): output embedding filename in vcode format, uses the ply file basename + vcode if not given (vcode is simply list of adjacent vertices according to their clockwise order).
+ *  Optional: --stats=json or --stats=<filename> reports the time and memory spent per stage, see pipeline_stats.hpp.
+ *  Optional: --cache=<directory> reuses the vcode of an earlier run on a mesh with the same faces, see artifact_cache.hpp.
  *  Preconditions: TODO: mesh is 2-vertex-connected
  */
 
@@ -20,6 +22,8 @@
 #include <algorithm>
 #include <sstream>
 #include <assert.h>
+#include "pipeline_stats.hpp"
+#include "artifact_cache.hpp"
 
 #define NDEBUG
 #ifdef DEBUG
@@ -44,6 +48,9 @@ bool ply_to_embedding (std::string input_filename,  embedding_t & embedding);
 
 int main (int argc, char *argv[])
 {
+	stats_report report("ply_to_embedding", argc, argv);
+	artifact_cache & cache = artifact_cache::instance();
+	cache.parse_arguments(argc, argv);
 	std::cout<<"INFO: ply_to_embedding, A simple PLY to embedding (vcode) converter."<<std::endl;
 	std::cout<<"INFO: PLY is a simple polygon format for describing 3d meshes, more info about the format can be found from http://paulbourke.net/dataformats/ply."<<std::endl;
 	std::cout << "INFO: vcode (vertex code) is a simple format where each line reprsents the local rotational order of the adjacent vertices of a vertex corresponding to the line" << std::endl;
@@ -61,10 +68,24 @@ int main (int argc, char *argv[])
 		{
 			outputembedding = inputply.substr(0, inputply.find_last_of('.')).append(".vcode");
 		}
+		cache_key key("ply_to_embedding", 1);
+		bool keyed = false; // Nothing is stored unless every input was hashed.
+		if( cache.enabled())
+		{
+			scoped_stage cache_stage("cache_lookup");
+			keyed = key.add_ply_topology(inputply);
+			if( keyed && cache.fetch(key, std::vector<std::string>(1, outputembedding)))
+			{
+				pipeline_stats::instance().set_counter("cache_hits", 1);
+				std::cout << "INFO: Copied the cached embedding of the faces of " << inputply << " to " << outputembedding << "." << std::endl;
+				return EXIT_SUCCESS;
+			}
+		}
 		embedding_t embedding;
 		std::cout << "INFO: Fetching the embedding from the PLY file " << inputply << std::endl;
 		if(!ply_to_embedding(inputply.c_str(), embedding)) return 1;
 		std::cout << "INFO: Successfully fetched the embedding from the PLY."<< std::endl;
+		scoped_stage write_stage("write_vcode");
 		std::ofstream ofs(outputembedding.c_str(), std::ofstream::out);
 		if (!ofs.is_open())
 		{
@@ -82,6 +103,7 @@ int main (int argc, char *argv[])
 		}
 		ofs.close();
 		std::cout << "INFO: Successfully wrote the embedding to " << outputembedding << "." << std::endl;
+		if( !ofs.fail() && keyed) cache.store(key, std::vector<std::string>(1, outputembedding));
 		
 		return EXIT_SUCCESS;
 	}else
@@ -104,6 +126,8 @@ bool ply_to_embedding(std::string input_filename, embedding_t & embedding)
 	//std::vector <std::vector<size_t> > facemat;
 	std::vector<std::vector<neighbours> > face_neigh_list; // neighbours list according to order of face descriptions
 	int nodes_per_face;
+	pipeline_stats & stats = pipeline_stats::instance();
+	stats.begin_stage("ply_parse");
 
 	if (myfile.is_open())
 	{
@@ -204,6 +228,10 @@ bool ply_to_embedding(std::string input_filename, embedding_t & embedding)
 					}
 					DEBUGPRINT(std::cout << std::endl;)
 				}
+				stats.end_stage();
+				stats.set_counter("vertices", number_nodes);
+				stats.set_counter("faces", number_faces);
+				scoped_stage rotation_stage("rotation_build");
 				std::cout << "INFO: Gathering embedding from face list ..." << std::endl;
 				bool push_back = true;
 				for (int i = 0; i < number_nodes; i++)
@@ -10,6 +10,16 @@
 #include <sstream>
 #include <fstream>
 #include <stdio.h>
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+static bool write_binary(std::string output_filename, binary_kind kind, uint64_t num_nodes, uint64_t count, const std::vector<uint32_t> & payload);
+static bool read_binary_graph(std::string input_filename, binary_kind kind, Graph & G);
+static bool write_binary_graph(std::string output_filename, Graph & G, bool weighted);
+static bool map_file(std::string filename, boost::interprocess::file_mapping & file, boost::interprocess::mapped_region & region);
+static bool read_text_dimacs(std::string input_filename, Graph & G, bool weighted);
+static bool write_text_dimacs(std::string output_filename, Graph & G, bool weighted);
 
 void print_embedding(const planar_embedding_t & planar_embedding, const Graph & G, std::vector<std::vector<Vertex> > & embedding_as_vertex_order)
 {
@@ -115,150 +125,60 @@ std::string to_string_graph_edgelist(const Graph & G, std::string pair_sep, std:
 
 bool read_dimacs(std::string input_filename, Graph & G)
 {
-	std::string line;
-	std::ifstream ifs(input_filename.c_str(), std::ifstream::in);
-	if( !ifs.is_open())
+	binary_header header;
+	if(read_binary_header(input_filename, header))
 	{
-		std::cerr<<"Unable to open file "<<input_filename;
-		return false;
-	}
-	unsigned int n, m;
-	unsigned int u, v;
-	const unsigned int MAX_LENGTH = 10;
-	char* line_type = new char[MAX_LENGTH];
-	char* format = new char[MAX_LENGTH];
-	std::size_t edge_ind = 0;
-	while(std::getline(ifs, line))
-	{
-		if(!line.empty())
+		if(header.kind != binary_graph && header.kind != binary_weighted_graph)
 		{
-			//std::cout<<line<<std::endl;
-			switch (line[0])
-			{
-			case 'p':
-				sscanf(line.c_str(),"%s %s %u %u", line_type, format, &n, &m);
-				G = Graph(n);
-				break;
-			case 'e':
-			case 'a':
-				sscanf(line.c_str(),"%s %u %u", line_type, &u, &v);
-				add_edge(u-1,v-1,edge_ind,G);
-				edge_ind++;
-				break;
-			case 'c':
-				break;
-			default:
-				break;
-			}
+			std::cerr<<"ERROR! The binary file "<<input_filename<<" is not a graph (kind "<<header.kind<<")"<<std::endl;
+			return false;
 		}
-		line.clear();
+		return read_binary_graph(input_filename, (binary_kind) header.kind, G);
 	}
-	ifs.close();
-	delete line_type;
-	delete format;
-	return true;
+	return read_text_dimacs(input_filename, G, false);
 }
 
 bool write_dimacs(std::string output_filename, Graph & G)
 {
-	std::string line;
-	std::ofstream ofs(output_filename.c_str(), std::ifstream::out);
-	if( !ofs.is_open())
-	{
-		std::cerr<<"Unable to open file "<<output_filename;
-		return false;
-	}
-	ofs<<"p edge "<<num_vertices(G)<<" "<<num_edges(G)<<"\n";
-	EdgeIterator e_it, e_end;
-	tie(e_it, e_end) = edges(G);
-	Vertex u, v;
-	for( ; e_it != e_end; e_it++)
-	{
-		u = source(*e_it, G);
-		v = target(*e_it, G);
-		ofs<<"e "<< u + 1<<" "<<v+1<<"\n";
-	}
-	ofs.close();
-	return true;
+	if(is_binary_filename(output_filename))
+		return write_binary_graph(output_filename, G, false);
+	return write_text_dimacs(output_filename, G, false);
 }
 
 bool read_weighed_dimacs(std::string input_filename, Graph & G)
 {
-	std::string line;
-	std::ifstream ifs(input_filename.c_str(), std::ifstream::in);
-	if (!ifs.is_open())
-	{
-		std::cerr << "Unable to open file " << input_filename;
-		return false;
-	}
-	unsigned int n, m;
-	unsigned int u, v;
-	int weight;
-
-	const unsigned int MAX_LENGTH = 10;
-	char* line_type = new char[MAX_LENGTH];
-	char* format = new char[MAX_LENGTH];
-	std::size_t edge_ind = 0;
-	Edge ed;
-	while (std::getline(ifs, line))
+	binary_header header;
+	if (read_binary_header(input_filename, header))
 	{
-		if (!line.empty())
+		if (header.kind != binary_weighted_graph)
 		{
-			//std::cout<<line<<std::endl;
-			switch (line[0])
-			{
-			case 'p':
-				sscanf(line.c_str(), "%s %s %u %u", line_type, format, &n, &m);
-				G = Graph(n);
-				break;
-			case 'e':
-			case 'a':
-				sscanf(line.c_str(), "%s %u %u %u", line_type, &u, &v, &weight); 
-				ed = add_edge(u - 1, v - 1, edge_ind, G).first;
-				put(edge_weight, G, ed, weight);
-				edge_ind++;
-				break;
-			case 'c':
-				break;
-			default:
-				break;
-			}
+			std::cerr << "ERROR! The binary graph " << input_filename << " carries no edge weights" << std::endl;
+			return false;
 		}
-		line.clear();
+		return read_binary_graph(input_filename, binary_weighted_graph, G);
 	}
-
-	ifs.close();
-	delete line_type;
-	delete format;
-	return true;
+	return read_text_dimacs(input_filename, G, true);
 }
 
 bool write_weighed_dimacs(std::string output_filename, Graph & G)
 {
-	std::string line;
-	std::ofstream ofs(output_filename.c_str(), std::ifstream::out);
-	if( !ofs.is_open())
-	{
-		std::cerr<<"Unable to open file "<<output_filename;
-		return false;
-	}
-	ofs<<"p edge "<<num_vertices(G)<<" "<<num_edges(G)<<"\n";
-	EdgeIterator e_it, e_end;
-	boost::tie(e_it, e_end) = edges(G);
-	Vertex u, v;
-	property_map < Graph, edge_weight_t >::type w = get(edge_weight, G);
-	for( ; e_it != e_end; e_it++)
-	{
-		u = boost::source(*e_it, G);
-		v = boost::target(*e_it, G);
-		ofs<<"e "<< u + 1<<" "<<v+1<<" "<<w[*e_it]<<"\n";
-	}
-	ofs.close();
-	return true;
+	if(is_binary_filename(output_filename))
+		return write_binary_graph(output_filename, G, true);
+	return write_text_dimacs(output_filename, G, true);
 }
 
-bool read_edge_code(std::string input_filename, std::vector<std::vector<std::size_t> > & edge_code)
+bool read_edge_code(std::string input_filename, std::vector<std::vector<std::size_t> > & edge_code, binary_kind kind)
 {
+	binary_header binary;
+	if(read_binary_header(input_filename, binary))
+	{
+		mapped_edge_code mapped;
+		if(!mapped.open(input_filename, kind)) return false;
+		edge_code = std::vector<std::vector<std::size_t> >(mapped.size());
+		for( std::size_t i = 0; i < mapped.size(); ++i)
+			edge_code[i].assign(mapped.rotation_begin(i), mapped.rotation_end(i));
+		return true;
+	}
 	std::string line;
 	unsigned long n_comp = 0;
 	std::size_t n = 0;
@@ -319,10 +239,19 @@ bool read_edge_code(std::string input_filename, std::vector<std::vector<std::siz
 	return true;
 }
 
-bool write_edge_code(std::string filename, std::vector<std::vector<std::size_t> > edge_code)
+bool write_edge_code(std::string filename, const std::vector<std::vector<std::size_t> > & edge_code)
 {
-	std::string line;
-
+	if(is_binary_filename(filename))
+	{
+		std::vector<uint32_t> payload(edge_code.size() + 1, 0);
+		for( std::size_t i = 0; i < edge_code.size(); ++i)
+			payload[i + 1] = payload[i] + (uint32_t) edge_code[i].size();
+		payload.reserve(payload.size() + payload.back());
+		for( std::size_t i = 0; i < edge_code.size(); ++i)
+			payload.insert(payload.end(), edge_code[i].begin(), edge_code[i].end());
+		const bool vertex_code = filename.size() >= 7 && filename.compare(filename.size() - 7, 7, ".bvcode") == 0;
+		return write_binary(filename, vertex_code ? binary_vertex_code : binary_edge_code, edge_code.size(), payload.size() - edge_code.size() - 1, payload);
+	}
 	std::ofstream ofs(filename.c_str(), std::ofstream::out);
 	if( !ofs.is_open())
 	{
@@ -336,8 +265,389 @@ bool write_edge_code(std::string filename, std::vector<std::vector<std::size_t>
 		{
 			ofs<<edge_code[i][j]<<" ";
 		}
-		ofs<<std::endl;
+		ofs<<"\n";
 	}
 	ofs.close();
 	return true;
 }
+
+bool read_trail(std::string input_filename, std::vector<std::size_t> & trail)
+{
+	binary_header header;
+	if(read_binary_header(input_filename, header))
+	{
+		mapped_trail mapped;
+		if(!mapped.open(input_filename)) return false;
+		trail.assign(mapped.data(), mapped.data() + mapped.size());
+		return true;
+	}
+	std::ifstream ifs(input_filename.c_str(), std::ifstream::in);
+	if( !ifs.is_open())
+	{
+		std::cerr<<"ERROR! Unable to read file "<<input_filename;
+		return false;
+	}
+	trail.clear();
+	std::string line;
+	std::getline(ifs, line);
+	std::istringstream iss(line);
+	std::size_t next;
+	while(iss >> next)
+		trail.push_back(next);
+	ifs.close();
+	return true;
+}
+
+bool write_trail(std::string output_filename, const std::vector<std::size_t> & trail)
+{
+	if(is_binary_filename(output_filename))
+		return write_binary(output_filename, binary_trail, 0, trail.size(), std::vector<uint32_t>(trail.begin(), trail.end()));
+	std::ofstream ofs(output_filename.c_str(), std::ofstream::out);
+	if( !ofs.is_open())
+	{
+		std::cerr<<"ERROR! Unable to create file "<<output_filename<<std::endl;
+		return false;
+	}
+	for( std::vector<std::size_t>::const_iterator it = trail.begin(); it != trail.end(); ++it)
+		ofs<<*it<<" ";
+	ofs.close();
+	return true;
+}
+
+bool is_binary_filename(std::string filename)
+{
+	static const char * const extensions[] = { ".becode", ".bvcode", ".btrail", ".bntrail", ".bdimacs" };
+	std::size_t dot = filename.find_last_of('.');
+	if( dot == std::string::npos) return false;
+	std::string extension = filename.substr(dot);
+	for( unsigned int i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i)
+		if( extension == extensions[i]) return true;
+	return false;
+}
+
+bool read_binary_header(std::string filename, binary_header & header)
+{
+	std::ifstream ifs(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	return ifs.read((char *) &header, sizeof(header)) && memcmp(header.magic, "BSCB", 4) == 0;
+}
+
+bool mapped_binary_file::open(std::string filename, binary_kind kind)
+{
+	header = NULL;
+	payload = NULL;
+	if( !map_file(filename, file, region)) return false;
+	if( region.get_size() < sizeof(binary_header))
+	{
+		std::cerr<<"ERROR! The file "<<filename<<" is too short for a binary header"<<std::endl;
+		return false;
+	}
+	header = (const binary_header *) region.get_address();
+	if( memcmp(header->magic, "BSCB", 4) != 0 || header->version != binary_format_version || header->byte_order != binary_byte_order || header->kind != (uint32_t) kind)
+	{
+		std::cerr<<"ERROR! The file "<<filename<<" has an unsupported binary header (version "<<header->version<<", kind "<<header->kind<<")"<<std::endl;
+		header = NULL;
+		return false;
+	}
+	// The records are 32 bit, larger counts can only come from a corrupt header and would overflow the payload size.
+	if( header->num_nodes > std::numeric_limits<uint32_t>::max() || header->count > std::numeric_limits<uint32_t>::max())
+	{
+		std::cerr<<"ERROR! The counts in the binary header of "<<filename<<" are out of range"<<std::endl;
+		header = NULL;
+		return false;
+	}
+	payload = (const uint32_t *) (header + 1);
+	return true;
+}
+
+bool mapped_binary_file::check_payload_size(std::string filename, uint64_t payload_words) const
+{
+	if( (region.get_size() - sizeof(binary_header)) / sizeof(uint32_t) < payload_words)
+	{
+		std::cerr<<"ERROR! The binary file "<<filename<<" is truncated"<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool mapped_edge_code::open(std::string filename, binary_kind kind)
+{
+	if( !mapped_binary_file::open(filename, kind)
+			|| !check_payload_size(filename, get_header().num_nodes + 1 + get_header().count))
+		return false;
+	if( offsets()[0] != 0 || offsets()[size()] != get_header().count)
+	{
+		std::cerr<<"ERROR! The offsets of the binary edge code "<<filename<<" do not match its header"<<std::endl;
+		return false;
+	}
+	for( std::size_t v = 0; v < size(); ++v)
+	{
+		if( offsets()[v] > offsets()[v + 1])
+		{
+			std::cerr<<"ERROR! The offsets of the binary edge code "<<filename<<" are not increasing"<<std::endl;
+			return false;
+		}
+	}
+	// Every edge of an edge code occurs in the rotations of both its ends, so there are count / 2 edges.
+	const uint64_t bound = (kind == binary_vertex_code) ? get_header().num_nodes : get_header().count / 2;
+	for( std::size_t k = 0; k < get_header().count; ++k)
+	{
+		if( edges()[k] >= bound)
+		{
+			std::cerr<<"ERROR! The binary "<<(kind == binary_vertex_code ? "vertex code " : "edge code ")<<filename<<" refers to "
+					<<(kind == binary_vertex_code ? "vertex " : "edge ")<<edges()[k]<<", which does not exist"<<std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool mapped_trail::open(std::string filename)
+{
+	return mapped_binary_file::open(filename, binary_trail) && check_payload_size(filename, get_header().count);
+}
+
+// Unweighted or weighted edge list of a binary graph.
+class mapped_graph : public mapped_binary_file {
+public:
+	bool open(std::string filename, binary_kind kind)
+	{
+		return mapped_binary_file::open(filename, kind) && check_payload_size(filename, get_header().count * (kind == binary_weighted_graph ? 3 : 2));
+	}
+	const uint32_t * data() const { return get_payload(); }
+};
+
+static bool read_binary_graph(std::string input_filename, binary_kind kind, Graph & G)
+{
+	mapped_graph mapped;
+	if( !mapped.open(input_filename, kind)) return false;
+	const std::size_t stride = (kind == binary_weighted_graph) ? 3 : 2;
+	const uint32_t * it = mapped.data();
+	G = Graph((std::size_t) mapped.get_header().num_nodes);
+	for( std::size_t edge_ind = 0; edge_ind < mapped.get_header().count; ++edge_ind, it += stride)
+	{
+		// The graph would silently grow to fit a vertex that does not exist.
+		if( it[0] >= num_vertices(G) || it[1] >= num_vertices(G))
+		{
+			std::cerr<<"ERROR! Edge "<<edge_ind<<" of the binary graph "<<input_filename<<" joins a vertex that does not exist"<<std::endl;
+			return false;
+		}
+		Edge ed = add_edge(it[0], it[1], edge_ind, G).first;
+		if( kind == binary_weighted_graph) put(edge_weight, G, ed, (int) it[2]);
+	}
+	return true;
+}
+
+static bool write_binary_graph(std::string output_filename, Graph & G, bool weighted)
+{
+	std::vector<uint32_t> payload;
+	payload.reserve(num_edges(G) * (weighted ? 3 : 2));
+	EdgeIterator e_it, e_end;
+	for( tie(e_it, e_end) = edges(G); e_it != e_end; ++e_it)
+	{
+		payload.push_back((uint32_t) source(*e_it, G));
+		payload.push_back((uint32_t) target(*e_it, G));
+		if( weighted) payload.push_back((uint32_t) get(edge_weight, G, *e_it));
+	}
+	return write_binary(output_filename, weighted ? binary_weighted_graph : binary_graph, num_vertices(G), num_edges(G), payload);
+}
+
+static bool write_binary(std::string output_filename, binary_kind kind, uint64_t num_nodes, uint64_t count, const std::vector<uint32_t> & payload)
+{
+	std::ofstream ofs(output_filename.c_str(), std::ofstream::out | std::ofstream::binary);
+	if( !ofs.is_open())
+	{
+		std::cerr<<"Unable to create file "<<output_filename;
+		return false;
+	}
+	binary_header header;
+	memcpy(header.magic, "BSCB", 4);
+	header.version = binary_format_version;
+	header.kind = kind;
+	header.byte_order = binary_byte_order;
+	header.num_nodes = num_nodes;
+	header.count = count;
+	ofs.write((const char *) &header, sizeof(header));
+	if( !payload.empty())
+		ofs.write((const char *) &payload[0], payload.size() * sizeof(uint32_t));
+	ofs.close();
+	return !ofs.fail();
+}
+
+// Maps the whole file read-only. An empty file leaves the region empty, as it cannot be mapped.
+static bool map_file(std::string filename, boost::interprocess::file_mapping & file, boost::interprocess::mapped_region & region)
+{
+	std::ifstream ifs(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	if( !ifs.is_open())
+	{
+		std::cerr<<"Unable to open file "<<filename;
+		return false;
+	}
+	ifs.seekg(0, std::ifstream::end);
+	const bool empty = (ifs.tellg() <= 0);
+	ifs.close();
+	region = boost::interprocess::mapped_region();
+	if( empty) return true;
+	try
+	{
+		file = boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only);
+		region = boost::interprocess::mapped_region(file, boost::interprocess::read_only);
+	}catch(const boost::interprocess::interprocess_exception & e)
+	{
+		std::cerr<<"ERROR! Unable to map file "<<filename<<": "<<e.what()<<std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Parses an unsigned decimal after optional blanks and leaves it behind the last digit.
+static bool parse_unsigned(const char *& it, const char * end, unsigned long & value)
+{
+	while( it != end && (*it == ' ' || *it == '\t')) ++it;
+	if( it == end || *it < '0' || *it > '9') return false;
+	value = 0;
+	for( ; it != end && *it >= '0' && *it <= '9'; ++it)
+		value = value * 10 + (unsigned long) (*it - '0');
+	return true;
+}
+
+static bool parse_int(const char *& it, const char * end, long & value)
+{
+	while( it != end && (*it == ' ' || *it == '\t')) ++it;
+	const bool negative = (it != end && *it == '-');
+	if( it != end && (*it == '-' || *it == '+')) ++it;
+	unsigned long magnitude;
+	if( !parse_unsigned(it, end, magnitude)) return false;
+	value = negative ? -(long) magnitude : (long) magnitude;
+	return true;
+}
+
+// Parses the dimacs text straight from the mapped file. The edges are collected into storage reserved from the problem line
+// and added once the whole file has been validated.
+static bool read_text_dimacs(std::string input_filename, Graph & G, bool weighted)
+{
+	boost::interprocess::file_mapping file;
+	boost::interprocess::mapped_region region;
+	if( !map_file(input_filename, file, region)) return false;
+	const char * it = (const char *) region.get_address();
+	const char * const end = it + region.get_size();
+
+	unsigned long n = 0, m = 0, u, v;
+	long weight = 0;
+	bool has_problem = false;
+	std::vector<uint32_t> ends;
+	std::vector<int> weights;
+	std::size_t line_number = 0;
+	while( it != end)
+	{
+		++line_number;
+		bool valid = true;
+		switch (*it)
+		{
+		case 'p':
+			++it;
+			while( it != end && (*it == ' ' || *it == '\t')) ++it;
+			while( it != end && *it != ' ' && *it != '\t' && *it != '\n') ++it; // the format, e.g. edge
+			valid = parse_unsigned(it, end, n) && parse_unsigned(it, end, m);
+			if( valid)
+			{
+				has_problem = true;
+				// Every edge line takes at least six characters, which bounds the reservation for a corrupt edge count.
+				const std::size_t max_edges = std::min((std::size_t) m, region.get_size() / 6);
+				ends.reserve(2 * max_edges);
+				if( weighted) weights.reserve(max_edges);
+			}
+			break;
+		case 'e':
+		case 'a':
+			++it;
+			valid = has_problem && parse_unsigned(it, end, u) && parse_unsigned(it, end, v)
+					&& (!weighted || parse_int(it, end, weight))
+					&& u >= 1 && u <= n && v >= 1 && v <= n;
+			if( valid)
+			{
+				ends.push_back((uint32_t) (u - 1));
+				ends.push_back((uint32_t) (v - 1));
+				if( weighted) weights.push_back((int) weight);
+			}
+			break;
+		default: // comments and empty lines
+			break;
+		}
+		if( !valid)
+		{
+			std::cerr<<"ERROR! Invalid line "<<line_number<<" in the dimacs file "<<input_filename<<std::endl;
+			return false;
+		}
+		it = std::find(it, end, '\n');
+		if( it != end) ++it;
+	}
+
+	G = Graph(n);
+	for( std::size_t edge_ind = 0; 2 * edge_ind < ends.size(); ++edge_ind)
+	{
+		Edge ed = add_edge(ends[2 * edge_ind], ends[2 * edge_ind + 1], edge_ind, G).first;
+		if( weighted) put(edge_weight, G, ed, weights[edge_ind]);
+	}
+	return true;
+}
+
+// Formats value in decimal at out and returns the position behind the last digit.
+static char * format_unsigned(char * out, unsigned long value)
+{
+	char digits[20];
+	int k = 0;
+	do
+	{
+		digits[k++] = (char) ('0' + value % 10);
+		value /= 10;
+	}while( value != 0);
+	while( k > 0) *out++ = digits[--k];
+	return out;
+}
+
+// Formats the dimacs text into a large buffer that is handed to the stream in big blocks.
+static bool write_text_dimacs(std::string output_filename, Graph & G, bool weighted)
+{
+	std::ofstream ofs(output_filename.c_str(), std::ofstream::out);
+	if( !ofs.is_open())
+	{
+		std::cerr<<"Unable to open file "<<output_filename;
+		return false;
+	}
+	const std::size_t BUFFER_SIZE = 1 << 20;
+	const std::size_t MAX_LINE_LENGTH = 80;
+	std::vector<char> buffer(BUFFER_SIZE + MAX_LINE_LENGTH);
+	char * const begin = &buffer[0];
+	char * out = begin;
+	memcpy(out, "p edge ", 7);
+	out = format_unsigned(out + 7, (unsigned long) num_vertices(G));
+	*out++ = ' ';
+	out = format_unsigned(out, (unsigned long) num_edges(G));
+	*out++ = '\n';
+	EdgeIterator e_it, e_end;
+	property_map < Graph, edge_weight_t >::type w = get(edge_weight, G);
+	for( boost::tie(e_it, e_end) = edges(G); e_it != e_end; ++e_it)
+	{
+		if( (std::size_t) (out - begin) >= BUFFER_SIZE)
+		{
+			ofs.write(begin, out - begin);
+			out = begin;
+		}
+		*out++ = 'e';
+		*out++ = ' ';
+		out = format_unsigned(out, (unsigned long) boost::source(*e_it, G) + 1);
+		*out++ = ' ';
+		out = format_unsigned(out, (unsigned long) boost::target(*e_it, G) + 1);
+		if( weighted)
+		{
+			const long weight = w[*e_it];
+			*out++ = ' ';
+			if( weight < 0) *out++ = '-';
+			out = format_unsigned(out, (unsigned long) (weight < 0 ? -weight : weight));
+		}
+		*out++ = '\n';
+	}
+	ofs.write(begin, out - begin);
+	ofs.close();
+	return !ofs.fail();
+}
@@ -0,0 +1,44 @@
+/*
+ * postman_matching.cpp
+ *
+ *  See postman_matching.hpp.
+ */
+
+#include "postman_matching.hpp"
+#include <lemon/matching.h>
+#include <lemon/full_graph.h>
+
+using namespace lemon;
+
+typedef FullGraph::EdgeMap<signed int> Distances;
+typedef MaxWeightedPerfectMatching<FullGraph, Distances> MWPM;
+
+std::vector< std::pair<Vertex, Vertex> > min_weight_odd_vertex_matching(const std::vector<std::vector<int> > & D, const std::vector<Vertex> & odd_vertices)
+{
+	const std::size_t num_odd_vertices = odd_vertices.size();
+	FullGraph lg = FullGraph(num_odd_vertices); // lemon complete graph for min weight perfect matching
+	Distances emap = Distances(lg, 1); // Unspecified distances set to 1
+	for (std::size_t i = 0; i < num_odd_vertices; ++i)
+	{
+		for (std::size_t j = i + 1; j < num_odd_vertices; ++j)
+		{
+			emap[lg.edge(lg(i), lg(j))] = -1 * D[odd_vertices[i]][odd_vertices[j]];
+		}
+	}
+	// Max weight perfect matching on lemon graph == min weight matching on orignal dimacs graph
+	MWPM mwpm = MWPM(lg, emap);
+	mwpm.run();
+
+	std::vector< std::pair<Vertex, Vertex> > match;
+	std::vector<bool> added = std::vector<bool>(num_odd_vertices, false);
+	for (std::size_t i = 0; i < num_odd_vertices; ++i)
+	{
+		if (added[i] == false)
+		{
+			match.push_back(std::make_pair(i, lg.index(mwpm.mate(lg(i)))));
+			added[i] = true;
+			added[lg.index(mwpm.mate(lg(i)))] = true;
+		}
+	}
+	return match;
+}
@@ -0,0 +1,18 @@
+/*
+ * postman_matching.hpp
+ *
+ *  The min weight perfect matching of the odd degree vertices, shared by postman_tour and the microbenchmark.
+ */
+
+#ifndef POSTMAN_MATCHING_HPP_
+#define POSTMAN_MATCHING_HPP_
+
+#include <utility>
+#include <vector>
+#include "boost_graph_helper.hpp"
+
+// Pairs up the odd degree vertices odd_vertices by a min weight perfect matching on the complete graph over them, weighted by the shortest path
+// distances D between all vertices of the graph. Returns the matched pairs as indices into odd_vertices.
+std::vector< std::pair<Vertex, Vertex> > min_weight_odd_vertex_matching(const std::vector<std::vector<int> > & D, const std::vector<Vertex> & odd_vertices);
+
+#endif /* POSTMAN_MATCHING_HPP_ */
@@ -6,6 +6,8 @@
 *  Creates a multigraph from a simple graph such that the graph is Eulerian
 *  Argument 1: filename of input graph in dimacs format.
 *  Argument 2: filename of output multigraph in dimacs format.
+*  Optional: --stats=json or --stats=<filename> reports the time and memory spent per stage, see pipeline_stats.hpp.
+*  Optional: --cache=<directory> reuses the multigraph of an earlier run on the same graph, see artifact_cache.hpp.
 */
 #include <iostream>
 #include <fstream>
@@ -17,10 +19,9 @@
 #include <boost/graph/connected_components.hpp>
 #include <boost/graph/johnson_all_pairs_shortest.hpp>
 #include "boost_graph_helper.hpp"
-#include <lemon/list_graph.h>
-#include <lemon/matching.h>
-#include <lemon/concepts/graph.h>
-#include <lemon/full_graph.h>
+#include "postman_matching.hpp"
+#include "pipeline_stats.hpp"
+#include "artifact_cache.hpp"
 
 #define NDEBUG
 #ifdef DEBUG
@@ -29,16 +30,16 @@
 #define DEBUGPRINT( x )
 #endif
 
-using namespace lemon;
 using namespace std;
 
-typedef FullGraph::EdgeMap<signed int> Distances;
-typedef MaxWeightedPerfectMatching<FullGraph, Distances> MWPM;
-
 bool is_even(Graph G);
 
 int main(int argc, char* argv[])
 {
+	stats_report report("postman_tour", argc, argv);
+	pipeline_stats & stats = pipeline_stats::instance();
+	artifact_cache & cache = artifact_cache::instance();
+	cache.parse_arguments(argc, argv);
 	std::cout << "INFO: postman_tour, creates a multigraph from a simple graph using a min weight perfect matching to make the graph Eulerian. " << std::endl;
 	if (argc != 3)
 		std::cerr << "ERROR! Usage: postman_tour input_dimacs output_dimacs" << std::endl;
@@ -46,11 +47,31 @@ int main(int argc, char* argv[])
 	{
 		std::string infile(argv[1]);
 		std::string outfile(argv[2]);
+		cache_key key("postman_tour", 1);
+		bool keyed = false; // Nothing is stored unless every input was hashed.
+		if (cache.enabled())
+		{
+			scoped_stage cache_stage("cache_lookup");
+			key.add(is_binary_filename(outfile) ? "binary" : "text");
+			keyed = key.add_file(infile);
+			if (keyed && cache.fetch(key, std::vector<std::string>(1, outfile)))
+			{
+				stats.set_counter("cache_hits", 1);
+				std::cout << "INFO: Copied the cached Eulerian multigraph of " << infile << " to " << outfile << std::endl;
+				return EXIT_SUCCESS;
+			}
+		}
 		Graph ingraph;
+		stats.begin_stage("read_dimacs");
 		if (!read_dimacs(infile, ingraph)) return 1;
+		stats.end_stage();
+		stats.set_counter("vertices", num_vertices(ingraph));
+		stats.set_counter("edges", num_edges(ingraph));
 
+		stats.begin_stage("connectivity_check");
 		std::vector<int> component(num_vertices(ingraph));
 		unsigned int num_components = connected_components(ingraph, &component[0]);
+		stats.end_stage();
 		assert(num_components == 1);
 		if (num_components != 1)
 		{
@@ -77,58 +98,25 @@ int main(int argc, char* argv[])
 				num_odd_vertices++;
 			}
 		}
+		stats.set_counter("odd_vertices", num_odd_vertices);
 
 		Graph multigraph = ingraph;
 		if (num_odd_vertices > 0)
 		{
-			Graph oddgraph(num_odd_vertices);
 			std::vector<std::vector<int> > D(n, std::vector<int>(n, 0));
 			get(edge_weight, ingraph);
 			boost::tie(e_it, e_end) = edges(ingraph);
 
 			std::cout << "INFO: Finding the shortest paths between odd degree vertices ..." << std::endl;
+			stats.begin_stage("apsp");
 			johnson_all_pairs_shortest_paths(ingraph, D);
+			stats.end_stage();
 
-			// Add edges to the complete graph
-			std::size_t e_ind = 0;
-			std::cout << "INFO: Constructing a complete graph from the odd degree vertices ..." << std::endl;
-			for (long unsigned int i = 0; i < num_odd_vertices; ++i)
-			{
-				for (long unsigned int j = i + 1; j < num_odd_vertices; ++j)
-				{
-					Edge e = boost::add_edge(i, j, e_ind, oddgraph).first;
-					boost::put(edge_weight, oddgraph, e, D[old_ind[i]][old_ind[j]]);
-					e_ind++;
-				}
-			}
-
-			FullGraph lg = FullGraph(num_odd_vertices); // lemon complete graph for min weight perfect matching
-			Distances emap = Distances(lg, 1); // Unspecified distances set to 1
-			EdgeIterator e_it, e_end;
-			boost::tie(e_it, e_end) = edges(oddgraph);
-			// Copying edge weights from boost graph to lemon full graph
-
-			for (; e_it != e_end; e_it++)
-			{
-				//std::cout << "e " << e_it->m_source << " " << e_it->m_target << " " << get(edge_weight, ingraph, *e_it)<<std::endl;
-				emap[lg.edge(lg(e_it->m_source), lg(e_it->m_target))] = -1 * get(edge_weight, ingraph, *e_it);
-			}
-			// Max weight perfect matching on lemon graph == min weight matching on orignal dimacs graph
-			MWPM mwpm = MWPM(lg, emap);
 			std::cout << "INFO: Running the min weight matching algorithm ..." << std::endl;
-			mwpm.run();
-
-			std::vector< std::pair<Vertex, Vertex> > match;
-			std::vector<bool> added = std::vector<bool>(num_odd_vertices, false);
-			for (size_t i = 0; i < num_odd_vertices; ++i)
-			{
-				if (added[i] == false)
-				{
-					match.push_back(std::make_pair(i, lg.index(mwpm.mate(lg(i)))));
-					added[i] = true;
-					added[lg.index(mwpm.mate(lg(i)))] = true;
-				}
-			}
+			stats.begin_stage("matching");
+			std::vector< std::pair<Vertex, Vertex> > match = min_weight_odd_vertex_matching(D, old_ind);
+			stats.end_stage();
+			stats.set_counter("matched_pairs", match.size());
 			
 			boost::tie(e_it, e_end) = edges(ingraph);
 			std::vector<std::size_t> parallel_edge_count(n*n, 0);
@@ -151,6 +139,7 @@ int main(int argc, char* argv[])
 
 			// Adding multiedges along the path of each matched pair to make all vertices have even degree.
 			std::cout << "INFO: Adding edges along the shortest paths ..." << std::endl;
+			stats.begin_stage("path_augmentation");
 
 			//unsigned int num_components = connected_components(ingraph, &component[0]);
 			for (std::vector<std::pair<Vertex, Vertex> >::iterator vit = match.begin(); vit != match.end(); ++vit)
@@ -178,6 +167,7 @@ int main(int argc, char* argv[])
 
 				DEBUGPRINT(std::cout << current << std::endl;)
 			}
+			stats.end_stage();
 			DEBUGPRINT(std::cout << "INFO: Graph after addition of multiedges" << std::endl;)
 
 		}
@@ -192,8 +182,12 @@ int main(int argc, char* argv[])
 			std::cerr << "ERROR! an unknown error occurred. Output file not written." << std::endl;
 			return 1;
 		}
-		write_dimacs(outfile, multigraph);
+		stats.set_counter("multigraph_edges", num_edges(multigraph));
+		stats.begin_stage("write_dimacs");
+		const bool written = write_dimacs(outfile, multigraph);
+		stats.end_stage();
 		std::cout << "INFO: Wrote an Eulerian multigraph after addition of multiedges to " << outfile << std::endl;
+		if (written && keyed) cache.store(key, std::vector<std::string>(1, outfile));
 		return EXIT_SUCCESS;
 
 	}
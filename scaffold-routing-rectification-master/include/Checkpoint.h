@@ -0,0 +1,55 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <Scene.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+/*
+ * A resumable relaxation: the poses, velocities and base counts of the best mesh so far, how far the optimizer has come and the separation it reached.
+ * Checkpoints are written to a temporary file that then replaces the previous one, so that a preempted job always leaves a complete checkpoint behind.
+ */
+
+class checkpoint {
+public:
+	struct settings_type {
+		std::string filename; // Resumed from if it exists, empty for no checkpoints.
+		double interval; // Seconds between checkpoints and snapshots of the best mesh to the output file.
+		double time_limit; // Seconds until the relaxation is stopped, 0 for no limit.
+		double target_separation; // Total separation in nm that stops the relaxation once reached, 0 for none.
+	};
+
+	scene::State state;
+	uint64_t position; // Index of the next gradient descent candidate, 0 for the other searches.
+	physics::real_type total;
+
+	bool write(const std::string & filename) const;
+	bool read(const std::string & filename); // Returns false, and leaves the checkpoint unchanged, if the file does not exist or is invalid.
+};
+
+// A name next to filename for a temporary file, different on every call so that threads writing the same file do not share it.
+std::string temporary_filename(const std::string & filename);
+
+// Writes to filename through a temporary file that replaces it once completely written. WriteFunctorT is called with the std::ostream & to write to.
+template<typename WriteFunctorT>
+bool write_atomically(const std::string & filename, WriteFunctorT write_functor) {
+	const std::string temporary(temporary_filename(filename));
+	bool written;
+	{
+		std::ofstream outfile(temporary);
+		written = outfile && write_functor(outfile);
+		outfile.close();
+		written = written && !outfile.fail();
+	}
+
+	if (written && replace_file(temporary, filename))
+		return true;
+
+	std::remove(temporary.c_str());
+	return false;
+}
+
+#endif /* N _CHECKPOINT_H_ */
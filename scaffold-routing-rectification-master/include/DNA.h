@@ -57,6 +57,45 @@ namespace DNA {
 	T HelixRotation(T distance) {
 		return T(BasesToRotation(DistanceToBaseCount(distance)));
 	}
+
+	const int BASES_PER_TWO_TURNS = 21;													// PITCH * 21 is 720 degrees, so the rotation of the helix ends repeats with this period.
+
+	/*
+	 * Directions from the helix axis to the forward and backward strands at the end of a helix with a given number of bases, tabulated over one period
+	 * so that building helices and measuring their attachments needs no trigonometry. They are the y axis rotated around the z axis.
+	 */
+	struct EndDirectionTable {
+		physics::vec3_type forward[BASES_PER_TWO_TURNS], backward[BASES_PER_TWO_TURNS];
+		physics::vec3_type backward_start;												// The backward strand at the start of the helix, rotated by -OPPOSITE_ROTATION.
+
+		inline EndDirectionTable() {
+			for (int i = 0; i < BASES_PER_TWO_TURNS; ++i) {
+				forward[i] = direction(BasesToRotation(i));
+				backward[i] = direction(BasesToRotation(i) - OPPOSITE_ROTATION);
+			}
+			backward_start = direction(-OPPOSITE_ROTATION);
+		}
+
+	private:
+		static inline physics::vec3_type direction(double degrees) {
+			const double radians(degrees * M_PI / 180);
+			return physics::vec3_type(physics::real_type(-std::sin(radians)), physics::real_type(std::cos(radians)), 0);
+		}
+	};
+
+	static const EndDirectionTable END_DIRECTIONS;
+
+	inline const physics::vec3_type & ForwardEndDirection(int bases) {
+		return END_DIRECTIONS.forward[(bases % BASES_PER_TWO_TURNS + BASES_PER_TWO_TURNS) % BASES_PER_TWO_TURNS];
+	}
+
+	inline const physics::vec3_type & BackwardEndDirection(int bases) {
+		return END_DIRECTIONS.backward[(bases % BASES_PER_TWO_TURNS + BASES_PER_TWO_TURNS) % BASES_PER_TWO_TURNS];
+	}
+
+	inline const physics::vec3_type & BackwardStartDirection() {
+		return END_DIRECTIONS.backward_start;
+	}
 }
 
 #endif /* DNA_H_ */
@@ -39,14 +39,27 @@ public:
 		createRigidBody(phys, bases, transform);
 	}
 
-	void recreateRigidBody(physics & phys, int bases, const physics::transform_type & transform);
+	// Changes the number of bases and moves the helix to transform. The rigid body and the frames of its joints are updated in place when the physics allows it.
+	void setBaseCount(physics & phys, int bases, const physics::transform_type & transform);
 
 	inline physics::transform_type getTransform() const {
-		return rigidBody->getGlobalPose();
+		return physics::world_transform(*rigidBody);
 	}
 
 	inline void setTransform(const physics::transform_type & transform) {
-		rigidBody->setGlobalPose(transform);
+		physics::set_world_transform(*rigidBody, transform);
+	}
+
+	inline physics::vec3_type getLinearVelocity() const {
+		return physics::linear_velocity(*rigidBody);
+	}
+
+	inline physics::vec3_type getAngularVelocity() const {
+		return physics::angular_velocity(*rigidBody);
+	}
+
+	inline void setVelocity(const physics::vec3_type & linear, const physics::vec3_type & angular) {
+		physics::set_velocity(*rigidBody, linear, angular);
 	}
 
 	void attach(physics & phys, Helix & other, AttachmentPoint thisPoint, AttachmentPoint otherPoint);
@@ -73,13 +86,38 @@ public:
 		return joints[point];
 	}
 
+	// The attachment point on the connected helix of the joint at point.
+	inline AttachmentPoint getConnectedPoint(AttachmentPoint point) const {
+		return otherPoint(point, *joints[point].helix);
+	}
+
+	// The position of an attachment point relative to the helix origin.
+	physics::vec3_type getLocalFrame(AttachmentPoint point) const;
+
 	inline bool isSleeping() const {
-		return rigidBody->isSleeping();
+		return physics::is_sleeping(*rigidBody);
+	}
+
+	// A kinematic helix is held in place by the simulation. The rigid body is dynamic again after it has been recreated.
+	inline void setKinematic(bool kinematic) {
+		physics::set_kinematic(*rigidBody, kinematic);
+	}
+
+	// Upper bound of the speed of any attachment point: the speed of the origin plus the angular speed times the distance to the farthest point.
+	physics::real_type getMaxSpeed() const;
+
+	// The energy k / 2 * d^2 of the fixed spring and half of that of the joints, the other half is counted at the connected helices.
+	double getPotentialEnergy() const;
+
+	// Lets the rigid body refer back to this helix through its user data. Has to be repeated when the helix has been copied.
+	inline void bindRigidBody() {
+		physics::set_user_data(*rigidBody, this);
 	}
 
 private:
 	void createRigidBody(physics & phys, int bases, const physics::transform_type & transform);
 	void destroyRigidBody(physics & phys);
+	void recreateRigidBody(physics & phys, int bases, const physics::transform_type & transform);
 
 	AttachmentPoint otherPoint(AttachmentPoint point, const Helix & other) const;
 
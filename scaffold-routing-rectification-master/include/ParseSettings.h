@@ -1,10 +1,15 @@
 #ifndef _PARSE_SETTINGS_H_
 #define _PARSE_SETTINGS_H_
 
+#include <Checkpoint.h>
 #include <Helix.h>
+#include <Relaxation.h>
 #include <Scene.h>
+#include <Service.h>
+#include <SimulatedAnnealing.h>
 
 #include <cassert>
+#include <cstring>
 #include <sstream>
 
 /*
@@ -20,6 +25,18 @@ private:
 		}
 	};
 
+	struct string_to_solver : public std::unary_function<const char *, relaxation_settings::solver_type> {
+		inline relaxation_settings::solver_type operator()(const char *str) const {
+			return stricmp("static", str) == 0 ? relaxation_settings::kStaticSolver : relaxation_settings::kDynamicSolver;
+		}
+	};
+
+	struct string_is_tempering : public std::unary_function<const char *, bool> {
+		inline bool operator()(const char *str) const {
+			return stricmp("tempering", str) == 0;
+		}
+	};
+
 	template<typename T>
 	struct identity : public std::unary_function<T, T> {
 		inline T operator()(T && t) const {
@@ -29,7 +46,7 @@ private:
 
 public:
 
-	static void parse(int argc, const char **argv, physics::settings_type & physics_settings, scene::settings_type & scene_settings, Helix::settings_type & helix_settings, std::string & input_file, std::string & output_file) {
+	static void parse(int argc, const char **argv, physics::settings_type & physics_settings, scene::settings_type & scene_settings, Helix::settings_type & helix_settings, parallel_evaluator::settings_type & evaluator_settings, relaxation_settings & relaxation, bool & tempering, parallel_tempering_settings & tempering_settings, checkpoint::settings_type & checkpoint_settings, std::string & input_file, std::string & output_file, std::string & batch_file, unsigned int & concurrent_jobs, std::string & stats_output, std::string & telemetry_output, service::settings_type & service_settings) {
 
 		physics_settings.kStaticFriction = physics::real_type(0.5);
 		physics_settings.kDynamicFriction = physics::real_type(0.5);
@@ -43,6 +60,31 @@ public:
 		helix_settings.spring_stiffness = physics::real_type(100);
 		helix_settings.fixed_spring_stiffness = physics::real_type(1000);
 		helix_settings.spring_damping = physics::real_type(100);
+		evaluator_settings.workers = 0; // One per core, divided among the concurrent jobs.
+		evaluator_settings.local_hops = 0;
+		relaxation.solver = relaxation_settings::kDynamicSolver;
+		relaxation.coarsening = 0;
+		relaxation.dynamic_solver_settings.speed_tolerance = physics::real_type(0.05);
+		relaxation.dynamic_solver_settings.energy_tolerance = 1e-5;
+		relaxation.dynamic_solver_settings.settle_steps = 10;
+		relaxation.dynamic_solver_settings.max_steps = 1000000;
+		relaxation.dynamic_solver_settings.timestep = physics::real_type(1.0 / 60.0);
+		relaxation.dynamic_solver_settings.max_timestep = physics::real_type(1.0 / 15.0);
+		relaxation.static_solver_settings.history = 8;
+		relaxation.static_solver_settings.max_iterations = 10000;
+		relaxation.static_solver_settings.tolerance = 1e-6;
+		tempering = false;
+		tempering_settings.sweeps = 100;
+		tempering_settings.sweep_length = 5;
+		tempering_settings.min_temperature = 0.001f;
+		tempering_settings.max_temperature = 0.05f;
+		checkpoint_settings.interval = 60;
+		checkpoint_settings.time_limit = 0;
+		checkpoint_settings.target_separation = 0;
+		concurrent_jobs = 0;
+		service_settings.socket.clear();
+		service_settings.tools.clear();
+		service_settings.cache.clear();
 
 		parse_settings parser( {
 			make_argument("scaling", scene_settings.initial_scaling, std::ptr_fun(&atof)),
@@ -60,8 +102,31 @@ public:
 			make_argument("rigid_body_sleep_threshold", physics_settings.kRigidBodySleepThreshold, std::ptr_fun(&atof)),
 			make_argument("visual_debugger", physics_settings.visual_debugger, string_to_bool()),
 
+			make_argument("workers", evaluator_settings.workers, std::ptr_fun(&atoi)),
+			make_argument("local_hops", evaluator_settings.local_hops, std::ptr_fun(&atoi)),
+			make_argument("solver", relaxation.solver, string_to_solver()),
+			make_argument("coarsening", relaxation.coarsening, std::ptr_fun(&atoi)),
+			make_argument("speed_tolerance", relaxation.dynamic_solver_settings.speed_tolerance, std::ptr_fun(&atof)),
+			make_argument("energy_tolerance", relaxation.dynamic_solver_settings.energy_tolerance, std::ptr_fun(&atof)),
+			make_argument("max_timestep", relaxation.dynamic_solver_settings.max_timestep, std::ptr_fun(&atof)),
+			make_argument("search", tempering, string_is_tempering()),
+			make_argument("sweeps", tempering_settings.sweeps, std::ptr_fun(&atoi)),
+			make_argument("min_temperature", tempering_settings.min_temperature, std::ptr_fun(&atof)),
+			make_argument("max_temperature", tempering_settings.max_temperature, std::ptr_fun(&atof)),
+			make_argument("time_limit", checkpoint_settings.time_limit, std::ptr_fun(&atof)),
+			make_argument("target_separation", checkpoint_settings.target_separation, std::ptr_fun(&atof)),
+			make_argument("checkpoint_file", checkpoint_settings.filename, identity<std::string>()),
+			make_argument("snapshot_interval", checkpoint_settings.interval, std::ptr_fun(&atof)),
+
 			make_argument("input", input_file, identity<std::string>()),
-			make_argument("output", output_file, identity<std::string>())
+			make_argument("output", output_file, identity<std::string>()),
+			make_argument("batch", batch_file, identity<std::string>()),
+			make_argument("jobs", concurrent_jobs, std::ptr_fun(&atoi)),
+			make_argument("stats", stats_output, identity<std::string>()),
+			make_argument("telemetry", telemetry_output, identity<std::string>()),
+			make_argument("serve", service_settings.socket, identity<std::string>()),
+			make_argument("tools", service_settings.tools, identity<std::string>()),
+			make_argument("cache", service_settings.cache, identity<std::string>())
 		}, argc, argv );
 	}
 
@@ -69,8 +134,10 @@ public:
 		std::stringstream ss;
 
 		ss << "Usage: " << name << std::endl
-			<< "\t--input=<filename>" << std::endl
-			<< "\t--output=<filename>" << std::endl
+			<< "\t--input=<filename> --output=<filename> | --batch=<filename> | --serve=<socket>" << std::endl
+			<< "\t[ --jobs=<integer> ]" << std::endl
+			<< "\t[ --tools=<directory> ]" << std::endl
+			<< "\t[ --cache=<directory> ]" << std::endl
 			<< "\t[ --scaling=<decimal> ]" << std::endl
 			<< "\t[ --discretize_lengths=<true|false> ]" << std::endl
 			<< "\t[ --density=<decimal> ]" << std::endl
@@ -82,7 +149,24 @@ public:
 			<< "\t[ --dynamic_friction=<decimal> ]" << std::endl
 			<< "\t[ --restitution=<decimal> ]" << std::endl
 			<< "\t[ --rigid_body_sleep_threshold=<decimal> ]" << std::endl
-			<< "\t[ --visual_debugger=<true|false> ] " << std::endl;
+			<< "\t[ --visual_debugger=<true|false> ] " << std::endl
+			<< "\t[ --workers=<integer> ]" << std::endl
+			<< "\t[ --local_hops=<integer> ]" << std::endl
+			<< "\t[ --solver=<dynamic|static> ]" << std::endl
+			<< "\t[ --coarsening=<integer> ]" << std::endl
+			<< "\t[ --speed_tolerance=<decimal> ]" << std::endl
+			<< "\t[ --energy_tolerance=<decimal> ]" << std::endl
+			<< "\t[ --max_timestep=<decimal> ]" << std::endl
+			<< "\t[ --search=<descent|tempering> ]" << std::endl
+			<< "\t[ --sweeps=<integer> ]" << std::endl
+			<< "\t[ --min_temperature=<decimal> ]" << std::endl
+			<< "\t[ --max_temperature=<decimal> ]" << std::endl
+			<< "\t[ --time_limit=<seconds> ]" << std::endl
+			<< "\t[ --target_separation=<decimal> ]" << std::endl
+			<< "\t[ --checkpoint_file=<filename> ]" << std::endl
+			<< "\t[ --snapshot_interval=<seconds> ]" << std::endl
+			<< "\t[ --stats=<json|filename> ]" << std::endl
+			<< "\t[ --telemetry=<filename> ]" << std::endl;
 		return ss.str();
 	}
 
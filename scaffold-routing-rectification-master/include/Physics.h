@@ -1,13 +1,22 @@
 #ifndef _PHYSICS_H_
 #define _PHYSICS_H_
 
+#ifdef REFERENCE_PHYSICS
+#include <ReferencePhysics.h>
+#else
+
 #include <PxPhysicsAPI.h>
 
 #include <cassert>
 #include <initializer_list>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
 
 /*
  * All NVIDIA PhysX stuff should reside in here. For easy switching of physics engines in the future.
+ * Define REFERENCE_PHYSICS to use the headless reference backend in ReferencePhysics.h instead.
+ * PhysX allows one foundation and SDK per process, so every physics instance has its own scene in the SDK shared by all instances, simulated by a shared CPU dispatcher.
  */
 
 #define PVD_HOST "127.0.0.1"
@@ -42,7 +51,8 @@ public:
 	 * For every geometry argument, std::get<0> will be used to get the PxGeometry, std::get<1> will be used to obtain the PxTransform. Use std::pair or std::tuple.
 	 */
 	template<typename GeometryT, typename... GeometryListT>
-	rigid_body_type *create_rigid_body(const transform_type & transform, real_type density, const GeometryT & geometry, GeometryListT &... geometries) {
+	rigid_body_type *create_rigid_body(const transform_type & transform, real_type density, const GeometryT & geometry, const GeometryListT &... geometries) {
+		std::lock_guard<std::mutex> lock(sdk_mutex());
 		physx::PxRigidDynamic *rigid_body(physx::PxCreateDynamic(*pxphysics, transform, std::get<0>(geometry), *material, density, std::get<1>(geometry)));
 		assert(rigid_body != nullptr);
 
@@ -51,16 +61,40 @@ public:
 		internal_rigid_body_attach_geometry(*rigid_body, geometries...);
 
 		scene->addActor(*rigid_body);
+		moved_bodies.insert(rigid_body);
 		return rigid_body;
 	}
 
+	/*
+	 * Replaces the geometries of a rigid body, given as for create_rigid_body, and recomputes its mass and inertia. The shapes are updated in place,
+	 * so the geometries must be of the same number and types as when the body was created, otherwise false is returned and the body is left as it is.
+	 */
+	template<typename... GeometryListT>
+	bool update_rigid_body(rigid_body_type *rigid_body, real_type density, const GeometryListT &... geometries) {
+		const physx::PxU32 count(sizeof...(geometries));
+		physx::PxShape *shapes[count];
+		if (rigid_body->getNbShapes() != count || rigid_body->getShapes(shapes, count) != count || !internal_rigid_body_matches_geometry(shapes, geometries...))
+			return false;
+
+		internal_rigid_body_update_geometry(shapes, geometries...);
+		physx::PxRigidBodyExt::updateMassAndInertia(*rigid_body, density);
+		return true;
+	}
+
 	sphere_geometry_type create_sphere_geometry(real_type radius);
 	capsule_geometry_type create_x_axis_capsule(real_type radius, real_type half_height);
 
 	spring_joint_type *create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping);
 
-	inline void destroy_spring_joint(spring_joint_type *) {} // physx takes care of joints. Note that this does not detach the spring from the rigid body when called!
-	inline void destroy_rigid_body(rigid_body_type *rigid_body) const { scene->removeActor(*rigid_body); rigid_body->release(); }
+	// Moves the frame of the spring on the given body, or on the world if NULL, to the local frame.
+	inline void set_spring_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & frame) {
+		physx::PxRigidActor *actor0, *actor1;
+		joint->getActors(actor0, actor1);
+		joint->setLocalPose(actor0 == rigid_body ? physx::PxJointActorIndex::eACTOR0 : physx::PxJointActorIndex::eACTOR1, frame);
+	}
+
+	inline void destroy_spring_joint(spring_joint_type *) {} // The joints are released with their bodies. Note that this does not detach the spring from the rigid body when called!
+	void destroy_rigid_body(rigid_body_type *rigid_body); // Also releases the joints attached to the body.
 
 	inline static vec3_type transform(const transform_type & transform, const vec3_type & vec) {
 		return physx::PxMat44(transform).transform(vec);
@@ -70,9 +104,64 @@ public:
 		return rigid_body.getGlobalPose();
 	}
 
+	inline static void set_world_transform(rigid_body_type & rigid_body, const transform_type & transform) {
+		rigid_body.setGlobalPose(transform);
+		static_cast<physics *>(rigid_body.getScene()->userData)->moved_bodies.insert(&rigid_body);
+	}
+
+	inline static vec3_type linear_velocity(const rigid_body_type & rigid_body) {
+		return rigid_body.getLinearVelocity();
+	}
+
+	inline static vec3_type angular_velocity(const rigid_body_type & rigid_body) {
+		return rigid_body.getAngularVelocity();
+	}
+
+	inline static void set_velocity(rigid_body_type & rigid_body, const vec3_type & linear, const vec3_type & angular) {
+		rigid_body.setLinearVelocity(linear);
+		rigid_body.setAngularVelocity(angular);
+	}
+
+	inline static bool is_sleeping(const rigid_body_type & rigid_body) {
+		return rigid_body.isSleeping();
+	}
+
+	// Kinematic bodies are not moved by the simulation, but the springs attached to them still pull on the dynamic bodies at their other ends.
+	inline static void set_kinematic(rigid_body_type & rigid_body, bool kinematic) {
+		rigid_body.setRigidBodyFlag(physx::PxRigidBodyFlag::eKINEMATIC, kinematic);
+		if (!kinematic)
+			rigid_body.wakeUp();
+	}
+
+	inline static real_type spring_length(const spring_joint_type & joint) {
+		return joint.getDistance();
+	}
+
+	inline static void set_user_data(rigid_body_type & rigid_body, void *user_data) {
+		rigid_body.userData = user_data;
+	}
+
+	inline static void *user_data(const rigid_body_type & rigid_body) {
+		return rigid_body.userData;
+	}
+
+	// Replaces the contents of moved with the bodies that were created, had their transform set or were moved by the simulation since the last call.
+	void collect_moved_bodies(std::vector<rigid_body_type *> & moved);
+
+	// Advances the simulation by dt seconds.
+	inline void step(real_type dt) {
+		scene->simulate(dt);
+		scene->fetchResults(true);
+
+		physx::PxU32 count;
+		const physx::PxActiveTransform *active(scene->getActiveTransforms(count));
+		for (physx::PxU32 i = 0; i < count; ++i)
+			moved_bodies.insert(static_cast<rigid_body_type *>(active[i].actor));
+	}
+
 public: // DEBUG make private.
-	physx::PxDefaultAllocator allocator;
-	physx::PxDefaultErrorCallback errorCallback;
+	// Serializes the creation and release of SDK objects by instances used from different threads.
+	static std::mutex & sdk_mutex();
 
 	physx::PxScene *scene;
 	physx::PxFoundation *foundation;
@@ -83,17 +172,38 @@ public: // DEBUG make private.
 	physx::PxDefaultCpuDispatcher*	dispatcher;
 	physx::PxMaterial *material = NULL;
 
+	std::unordered_set<rigid_body_type *> moved_bodies;
+	std::unordered_set<spring_joint_type *> joints; // Joints are not actors of the scene, they are released by the instance that created them.
+
 	const settings_type settings;
 
 private:
 
 	template<typename GeometryT, typename... GeometryListT>
-	inline void internal_rigid_body_attach_geometry(rigid_body_type & rigid_body, const GeometryT & geometry, GeometryListT &... geometries) {
+	inline void internal_rigid_body_attach_geometry(rigid_body_type & rigid_body, const GeometryT & geometry, const GeometryListT &... geometries) {
 		rigid_body.createShape(std::get<0>(geometry), *material)->setLocalPose(std::get<1>(geometry));
 		internal_rigid_body_attach_geometry(rigid_body, geometries...);
 	}
 
 	inline void internal_rigid_body_attach_geometry(rigid_body_type & rigid_body) {}
+
+	template<typename GeometryT, typename... GeometryListT>
+	inline static bool internal_rigid_body_matches_geometry(physx::PxShape **shapes, const GeometryT & geometry, const GeometryListT &... geometries) {
+		return (*shapes)->getGeometryType() == std::get<0>(geometry).getType() && internal_rigid_body_matches_geometry(shapes + 1, geometries...);
+	}
+
+	inline static bool internal_rigid_body_matches_geometry(physx::PxShape **shapes) { return true; }
+
+	template<typename GeometryT, typename... GeometryListT>
+	inline static void internal_rigid_body_update_geometry(physx::PxShape **shapes, const GeometryT & geometry, const GeometryListT &... geometries) {
+		(*shapes)->setGeometry(std::get<0>(geometry));
+		(*shapes)->setLocalPose(std::get<1>(geometry));
+		internal_rigid_body_update_geometry(shapes + 1, geometries...);
+	}
+
+	inline static void internal_rigid_body_update_geometry(physx::PxShape **shapes) {}
 };
 
+#endif /* N REFERENCE_PHYSICS */
+
 #endif /* N _PHYSICS_H_ */
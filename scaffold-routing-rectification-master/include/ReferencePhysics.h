@@ -0,0 +1,300 @@
+#ifndef _REFERENCE_PHYSICS_H_
+#define _REFERENCE_PHYSICS_H_
+
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <initializer_list>
+#include <array>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Headless reference physics backend, selected by defining REFERENCE_PHYSICS. It implements the same physics interface as the PhysX backend
+ * with a purpose-built solver for networks of rigid bodies connected by zero length springs: the body state is stored as structure of arrays and
+ * the spring forces and the integration are computed four bodies or springs at a time with SSE. There is no collision detection, the helices only
+ * interact through their springs. Bodies are simulated as one island that falls asleep when all of them have rested for the wake counter time.
+ * The vector, quaternion and transform types mirror the subset of the PhysX math types used by the rest of the program.
+ */
+
+namespace reference_physics {
+	typedef float real_type;
+
+	struct vec3 {
+		real_type x, y, z;
+
+		inline vec3() : x(0), y(0), z(0) {}
+		inline vec3(real_type x, real_type y, real_type z) : x(x), y(y), z(z) {}
+
+		inline vec3 operator+(const vec3 & v) const { return vec3(x + v.x, y + v.y, z + v.z); }
+		inline vec3 operator-(const vec3 & v) const { return vec3(x - v.x, y - v.y, z - v.z); }
+		inline vec3 operator-() const { return vec3(-x, -y, -z); }
+		inline vec3 operator*(real_type f) const { return vec3(x * f, y * f, z * f); }
+		inline vec3 operator/(real_type f) const { return vec3(x / f, y / f, z / f); }
+		inline vec3 & operator+=(const vec3 & v) { x += v.x; y += v.y; z += v.z; return *this; }
+		inline vec3 & operator-=(const vec3 & v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+		inline vec3 & operator*=(real_type f) { x *= f; y *= f; z *= f; return *this; }
+		inline vec3 & operator/=(real_type f) { x /= f; y /= f; z /= f; return *this; }
+
+		inline real_type dot(const vec3 & v) const { return x * v.x + y * v.y + z * v.z; }
+		inline vec3 cross(const vec3 & v) const { return vec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+		inline real_type magnitudeSquared() const { return dot(*this); }
+		inline real_type magnitude() const { return std::sqrt(magnitudeSquared()); }
+
+		// Normalizes the vector and returns its previous magnitude, a zero vector is left as it is.
+		inline real_type normalize() {
+			const real_type m(magnitude());
+			if (m > 0)
+				*this /= m;
+			return m;
+		}
+
+		inline vec3 getNormalized() const {
+			const real_type m(magnitude());
+			return m > 0 ? *this / m : vec3();
+		}
+	};
+
+	struct quat {
+		real_type x, y, z, w;
+
+		inline quat() : x(0), y(0), z(0), w(1) {}
+		inline quat(real_type x, real_type y, real_type z, real_type w) : x(x), y(y), z(z), w(w) {}
+		// Rotation by angle radians around the unit axis.
+		inline quat(real_type angle, const vec3 & axis) {
+			const real_type s(std::sin(angle / 2));
+			x = axis.x * s; y = axis.y * s; z = axis.z * s; w = std::cos(angle / 2);
+		}
+
+		inline quat operator*(const quat & q) const {
+			return quat(w * q.x + q.w * x + y * q.z - q.y * z, w * q.y + q.w * y + z * q.x - q.z * x, w * q.z + q.w * z + x * q.y - q.x * y, w * q.w - x * q.x - y * q.y - z * q.z);
+		}
+
+		inline real_type magnitude() const { return std::sqrt(x * x + y * y + z * z + w * w); }
+		inline real_type normalize() {
+			const real_type m(magnitude());
+			if (m > 0) {
+				x /= m; y /= m; z /= m; w /= m;
+			}
+			return m;
+		}
+
+		inline quat getNormalized() const { quat q(*this); q.normalize(); return q; }
+		inline quat getConjugate() const { return quat(-x, -y, -z, w); }
+
+		inline vec3 rotate(const vec3 & v) const {
+			const vec3 u(x, y, z), t(u.cross(v) * 2);
+			return v + t * w + u.cross(t);
+		}
+
+		inline vec3 rotateInv(const vec3 & v) const { return getConjugate().rotate(v); }
+	};
+
+	struct transform {
+		vec3 p;
+		quat q;
+
+		inline transform() {}
+		inline explicit transform(const vec3 & p) : p(p) {}
+		inline explicit transform(const quat & q) : q(q) {}
+		inline transform(const vec3 & p, const quat & q) : p(p), q(q) {}
+
+		inline vec3 transform_point(const vec3 & v) const { return q.rotate(v) + p; }
+		inline transform operator*(const transform & t) const { return transform(q.rotate(t.p) + p, q * t.q); }
+	};
+
+	struct sphere_geometry {
+		real_type radius;
+		inline explicit sphere_geometry(real_type radius) : radius(radius) {}
+	};
+
+	// A capsule along the x axis.
+	struct capsule_geometry {
+		real_type radius, halfHeight;
+		inline capsule_geometry(real_type radius, real_type halfHeight) : radius(radius), halfHeight(halfHeight) {}
+	};
+
+	// Mass, center of mass and inertia tensor (xx, yy, zz, xy, xz, yz) around the body origin, accumulated over the geometries of a body.
+	struct mass_properties {
+		real_type mass;
+		vec3 weighted_center;
+		real_type inertia[6];
+
+		inline mass_properties() : mass(0) { for (real_type & i : inertia) i = 0; }
+
+		void add(const sphere_geometry & geometry, const transform & pose, real_type density);
+		void add(const capsule_geometry & geometry, const transform & pose, real_type density);
+
+	private:
+		// Adds a solid with the given mass and diagonal inertia around its center in its own frame.
+		void add(real_type mass, const vec3 & inertia, const transform & pose);
+	};
+}
+
+class physics {
+public:
+	typedef reference_physics::quat quaternion_type;
+	typedef reference_physics::real_type real_type;
+	typedef reference_physics::transform transform_type;
+	typedef reference_physics::vec3 vec3_type;
+
+	// Handles to the bodies and springs in the arrays of the physics instance. Their addresses stay valid until the physics instance is destroyed.
+	struct rigid_body {
+		physics *owner;
+		unsigned int index;
+		void *user_data;
+	};
+
+	struct spring_joint {
+		physics *owner;
+		unsigned int index;
+	};
+
+	typedef rigid_body rigid_body_type;
+	typedef spring_joint spring_joint_type;
+	typedef reference_physics::sphere_geometry sphere_geometry_type;
+	typedef reference_physics::capsule_geometry capsule_geometry_type;
+
+	static const quaternion_type quaternion_identity;
+
+	struct settings_type {
+		real_type kStaticFriction, kDynamicFriction, kRestitution; // Unused, there are no contacts.
+		real_type kRigidBodySleepThreshold;
+
+		bool visual_debugger; // Unused.
+	};
+
+	physics(const settings_type & settings);
+	~physics();
+
+	/*
+	 * Creates a rigid body with the given geometries as variadic template arguments.
+	 * For every geometry argument, std::get<0> will be used to get the geometry, std::get<1> will be used to obtain its transform. Use std::pair or std::tuple.
+	 * The geometries only define the mass and inertia of the body.
+	 */
+	template<typename GeometryT, typename... GeometryListT>
+	rigid_body_type *create_rigid_body(const transform_type & transform, real_type density, const GeometryT & geometry, const GeometryListT &... geometries) {
+		reference_physics::mass_properties properties;
+		internal_rigid_body_add_geometry(properties, density, geometry, geometries...);
+		return create_rigid_body(transform, properties);
+	}
+
+	/*
+	 * Replaces the geometries of a rigid body, given as for create_rigid_body, keeping its transform and springs. Returns false if the body cannot be
+	 * updated in place and has to be recreated, which never happens here as the geometries only define the mass and inertia.
+	 */
+	template<typename... GeometryListT>
+	bool update_rigid_body(rigid_body_type *rigid_body, real_type density, const GeometryListT &... geometries) {
+		reference_physics::mass_properties properties;
+		internal_rigid_body_add_geometry(properties, density, geometries...);
+		set_mass_properties(rigid_body->index, properties);
+		return true;
+	}
+
+	sphere_geometry_type create_sphere_geometry(real_type radius);
+	capsule_geometry_type create_x_axis_capsule(real_type radius, real_type half_height);
+
+	// A NULL rigid body attaches the spring to the world at the position of its transform.
+	spring_joint_type *create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping);
+
+	// Moves the anchor of the spring on the given body, or on the world if NULL, to the local frame.
+	void set_spring_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & frame);
+
+	void destroy_spring_joint(spring_joint_type *joint);
+	void destroy_rigid_body(rigid_body_type *rigid_body); // Also destroys the springs attached to the body.
+
+	inline static vec3_type transform(const transform_type & transform, const vec3_type & vec) {
+		return transform.transform_point(vec);
+	}
+
+	static transform_type world_transform(const rigid_body_type & rigid_body);
+	static void set_world_transform(rigid_body_type & rigid_body, const transform_type & transform); // Wakes up the simulation.
+	static vec3_type linear_velocity(const rigid_body_type & rigid_body);
+	static vec3_type angular_velocity(const rigid_body_type & rigid_body);
+	static void set_velocity(rigid_body_type & rigid_body, const vec3_type & linear, const vec3_type & angular); // Wakes up the simulation.
+	static bool is_sleeping(const rigid_body_type & rigid_body);
+	// Kinematic bodies are not moved by the simulation and keep zero velocity, but the springs attached to them still pull on the dynamic bodies at their other ends.
+	static void set_kinematic(rigid_body_type & rigid_body, bool kinematic);
+	static real_type spring_length(const spring_joint_type & joint);
+
+	// The user data of a body is not used by the physics, it is NULL until set.
+	inline static void set_user_data(rigid_body_type & rigid_body, void *user_data) {
+		rigid_body.user_data = user_data;
+	}
+
+	inline static void *user_data(const rigid_body_type & rigid_body) {
+		return rigid_body.user_data;
+	}
+
+	// Replaces the contents of moved with the bodies that were created, had their transform set or were moved by the simulation since the last call.
+	void collect_moved_bodies(std::vector<rigid_body_type *> & moved);
+
+	// Advances the simulation by dt seconds, split into as many substeps as the stiffest spring requires.
+	void step(real_type dt);
+
+private:
+	physics(const physics &) = delete;
+	physics & operator=(const physics &) = delete;
+
+	template<typename GeometryT, typename... GeometryListT>
+	inline void internal_rigid_body_add_geometry(reference_physics::mass_properties & properties, real_type density, const GeometryT & geometry, const GeometryListT &... geometries) {
+		properties.add(std::get<0>(geometry), std::get<1>(geometry), density);
+		internal_rigid_body_add_geometry(properties, density, geometries...);
+	}
+
+	inline void internal_rigid_body_add_geometry(reference_physics::mass_properties &, real_type) {}
+
+	rigid_body_type *create_rigid_body(const transform_type & transform, const reference_physics::mass_properties & properties);
+	// Keeps the world transform of the body origin and the anchors of the attached springs relative to it.
+	void set_mass_properties(unsigned int body, const reference_physics::mass_properties & properties);
+	void release_spring(unsigned int spring);
+	real_type spring_rate(unsigned int spring) const;
+	void wake_up();
+	void mark_moved(unsigned int body);
+	void substep(real_type dt);
+
+	// Body 0 is the static world that springs without a second body are attached to. Its inverse mass and inertia are zero.
+	// The position and orientation are those of the center of mass, center is the center of mass relative to the body origin.
+	struct body_arrays {
+		std::vector<real_type> px, py, pz, qx, qy, qz, qw, vx, vy, vz, wx, wy, wz, fx, fy, fz, tx, ty, tz;
+		std::vector<real_type> inverse_mass, inertia[6], inverse_inertia[6], centerx, centery, centerz, wake_counter;
+
+		void resize(size_t size);
+	};
+
+	// Springs pull their anchors, given relative to the center of mass of each body, together. A released spring has zero stiffness and damping.
+	struct spring_arrays {
+		std::vector<unsigned int> body1, body2;
+		std::vector<real_type> anchor1x, anchor1y, anchor1z, anchor2x, anchor2y, anchor2z, stiffness, damping;
+		std::vector<real_type> forcex, forcey, forcez, torque1x, torque1y, torque1z, torque2x, torque2y, torque2z; // Per step results.
+		std::vector<real_type> gathered[2][13]; // Position, orientation, velocity and angular velocity of the bodies at each end.
+
+		void resize(size_t size);
+	};
+
+	body_arrays bodies;
+	spring_arrays springs;
+	size_t body_count, spring_count; // Used entries, the arrays are padded to a multiple of the SIMD width.
+
+	std::deque<rigid_body_type> body_handles;
+	std::deque<spring_joint_type> spring_handles;
+	std::vector<unsigned int> free_bodies, free_springs;
+	std::vector<std::vector<unsigned int> > body_springs;
+
+	// Bodies moved since the last collect_moved_bodies, the simulation moves all bodies of the island at once.
+	std::vector<unsigned char> body_moved;
+	std::vector<unsigned int> moved_bodies;
+	bool all_bodies_moved;
+
+	// Kinematic bodies have zero inverse mass and inertia in the body arrays, their dynamic ones are kept here until they become dynamic again.
+	std::unordered_map<unsigned int, std::array<real_type, 7> > kinematic_inverses;
+
+	real_type max_spring_rate; // Upper bound of sqrt(k / m) + c / m over the springs, limits the substep length.
+	bool spring_rate_changed, sleeping;
+	bool woken; // The wake counters are reset at the start of the next step.
+
+	const settings_type settings;
+};
+
+#endif /* N _REFERENCE_PHYSICS_H_ */
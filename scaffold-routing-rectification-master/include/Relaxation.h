@@ -0,0 +1,220 @@
+#ifndef _RELAXATION_H_
+#define _RELAXATION_H_
+
+#include <Scene.h>
+#include <StaticSolver.h>
+#include <Statistics.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Relaxes the mesh by simulating it. The mesh is at rest when, for settle_steps consecutive steps, no attachment point moves faster than speed_tolerance
+ * and the potential energy of the springs changes by less than energy_tolerance relative to it. The timestep starts at timestep and grows by 10% per
+ * step up to max_timestep. It is halved, down to timestep / 16, whenever the potential energy rises above the energy the relaxation started with,
+ * which a damped network of springs starting at rest can only do when the integration is unstable.
+ */
+class dynamic_solver {
+public:
+	struct settings_type {
+		physics::real_type speed_tolerance; // nm/s
+		double energy_tolerance;
+		unsigned int settle_steps, max_steps;
+		physics::real_type timestep, max_timestep; // s
+	};
+
+	/*
+	 * Steps the simulation until the mesh comes to rest by the residuals above, max_steps have been taken or running_functor returns false.
+	 * Returns true if it came to rest. The steps are added to the statistics, together with the most steps any call took.
+	 */
+	template<typename RunningFunctorT>
+	static bool simulate(scene & mesh, physics & phys, const settings_type & settings, RunningFunctorT running_functor, uint64_t & steps);
+};
+
+template<typename RunningFunctorT>
+bool dynamic_solver::simulate(scene & mesh, physics & phys, const settings_type & settings, RunningFunctorT running_functor, uint64_t & steps) {
+	physics::real_type speed, timestep(settings.timestep);
+	double energy;
+	mesh.getResidual(speed, energy);
+
+	// Starting from rest, damping can only lower the potential energy below its initial value. Exceeding the bound means the integration is unstable.
+	const double kEnergyMargin(0.01);
+	double energy_bound(energy * (1 + kEnergyMargin));
+	uint64_t timestep_reductions(0);
+	steps = 0;
+	unsigned int settled(0);
+	bool converged(false);
+	while (steps < settings.max_steps && running_functor()) {
+		phys.step(timestep);
+		++steps;
+
+		const double previous_energy(energy);
+		mesh.getResidual(speed, energy);
+
+		if (speed <= settings.speed_tolerance && std::abs(energy - previous_energy) <= settings.energy_tolerance * std::max(energy, 1e-12)) {
+			if (++settled >= settings.settle_steps) {
+				converged = true;
+				break;
+			}
+		} else
+			settled = 0;
+
+		if (energy > energy_bound) {
+			timestep = std::max(settings.timestep / 16, timestep / 2);
+			energy_bound = energy * (1 + kEnergyMargin);
+			++timestep_reductions;
+		} else
+			timestep = std::min(settings.max_timestep, timestep * physics::real_type(1.1));
+	}
+
+	statistics & stats(statistics::instance());
+	stats.add_counter("simulation_steps", steps);
+	stats.max_counter("relaxation_steps_max", steps);
+	if (timestep_reductions > 0)
+		stats.add_counter("timestep_reductions", timestep_reductions);
+	return converged;
+}
+
+/*
+ * How meshes are relaxed: by simulating them until they come to rest (--solver=dynamic) or by minimizing the energy of the springs (--solver=static).
+ */
+struct relaxation_settings {
+	enum solver_type {
+		kDynamicSolver,
+		kStaticSolver
+	};
+
+	solver_type solver;
+	unsigned int coarsening; // Chain length factor between the levels of relax_multilevel, 0 or 1 for no coarse levels.
+	dynamic_solver::settings_type dynamic_solver_settings;
+	static_solver::settings_type static_solver_settings;
+};
+
+/*
+ * Relaxes the mesh with the configured solver. Returns false if it did not come to rest, because running_functor returned false or the solver did not converge.
+ * steps is set to the number of simulation steps or static solver iterations taken.
+ */
+template<typename RunningFunctorT>
+bool relax(scene & mesh, physics & phys, const relaxation_settings & settings, RunningFunctorT running_functor, uint64_t & steps) {
+	const bool converged(settings.solver == relaxation_settings::kStaticSolver ?
+		static_solver::minimize(mesh, settings.static_solver_settings, running_functor, steps) :
+		dynamic_solver::simulate(mesh, phys, settings.dynamic_solver_settings, running_functor, steps));
+
+	statistics & stats(statistics::instance());
+	stats.add_counter("relaxations");
+	if (!converged)
+		stats.add_counter("relaxations_unconverged");
+	return converged;
+}
+
+template<typename RunningFunctorT>
+bool relax(scene & mesh, physics & phys, const relaxation_settings & settings, RunningFunctorT running_functor) {
+	uint64_t steps;
+	return relax(mesh, phys, settings, running_functor, steps);
+}
+
+/*
+ * Relaxes a mesh far from its equilibrium, such as one at its initial transforms. With a coarsening factor c above 1, chains of c^k, ..., c consecutive
+ * helices along the scaffold path are first relaxed as rigid bodies by the static solver, from the longest chains that leave at least two of them
+ * down, each level starting from the result of the previous one. The deformations spanning many helices settle at the coarse levels, so the
+ * configured solver only has to resolve the local ones.
+ */
+template<typename RunningFunctorT>
+bool relax_multilevel(scene & mesh, physics & phys, const relaxation_settings & settings, RunningFunctorT running_functor) {
+	if (settings.coarsening > 1) {
+		scene::HelixContainer::size_type chain_length(1);
+		while (chain_length * settings.coarsening * 2 <= mesh.getHelixCount())
+			chain_length *= settings.coarsening;
+
+		for (; chain_length > 1 && running_functor(); chain_length /= settings.coarsening) {
+			static_solver::minimize_coarse(mesh, (unsigned int) chain_length, settings.static_solver_settings, running_functor);
+			statistics::instance().add_counter("coarse_levels");
+		}
+	}
+
+	return relax(mesh, phys, settings, running_functor);
+}
+
+/*
+ * Evaluates base count changes of single helices concurrently. Every worker simulates its own copy of the mesh in its own physics scene,
+ * the first worker uses the mesh of the caller and the others are read from the same input file. The first worker runs on the calling thread,
+ * the others on the threads of a pool that lives as long as the evaluator.
+ */
+class parallel_evaluator {
+public:
+	struct settings_type {
+		unsigned int workers;
+		unsigned int local_hops; // If not 0, only the helices within local_hops joints of the changed one are relaxed, the others are kinematic.
+	};
+
+	struct candidate {
+		size_t helix;
+		int bases;
+	};
+
+	struct result {
+		physics::real_type min, max, average, total;
+		bool completed; // False if the relaxation was interrupted or did not converge.
+		uint64_t steps; // Of the relaxation, see relax.
+		double wall_ms; // Of the relaxation and the measurement.
+	};
+
+	parallel_evaluator(const settings_type & settings, const relaxation_settings & relaxation, scene & mesh, physics & phys, const physics::settings_type & physics_settings, const scene::settings_type & scene_settings, const Helix::settings_type & helix_settings, const std::string & input_file); // throws exceptions.
+
+	/*
+	 * Worker i restores the given relaxed state, applies candidates[i] to it and measures the separation once the mesh has come to rest again.
+	 * Only the changed helix starts out of equilibrium. There may be at most getWorkerCount() candidates. The scene of worker i is left relaxed with its candidate applied.
+	 * In local mode, the result only accounts for the relaxation of the patch around the changed helix.
+	 */
+	void evaluate(const scene::State & start, const std::vector<candidate> & candidates, std::vector<result> & results, const std::function<bool()> & running_functor);
+
+	/*
+	 * Relaxes the whole scene of a worker and measures it again, for results of local evaluations before they are accepted. Returns r.completed.
+	 * The steps and time are added to those of the evaluation.
+	 */
+	bool revalidate(unsigned int worker, result & r, const std::function<bool()> & running_functor);
+
+	inline bool isLocal() const {
+		return local_hops > 0;
+	}
+
+	inline unsigned int getWorkerCount() const {
+		return (unsigned int) workers.size();
+	}
+
+	inline scene & getScene(unsigned int worker) {
+		return *workers[worker].mesh;
+	}
+
+	inline physics & getPhysics(unsigned int worker) {
+		return *workers[worker].phys;
+	}
+
+	// Runs task(i) for the workers i < count, see worker_pool::run.
+	inline void run(size_t count, const std::function<void(size_t)> & task) {
+		pool->run(count, task);
+	}
+
+private:
+	struct worker {
+		scene *mesh;
+		physics *phys;
+	};
+
+	static void evaluate(worker & w, const relaxation_settings & relaxation, unsigned int local_hops, const scene::State & start, const candidate & c, result & r, const std::function<bool()> & running_functor);
+
+	const relaxation_settings relaxation;
+	const unsigned int local_hops;
+	std::vector<worker> workers;
+	std::vector< std::unique_ptr<physics> > owned_physics; // Declared before the meshes, which are destroyed first.
+	std::vector< std::unique_ptr<scene> > owned_meshes;
+	std::unique_ptr<worker_pool> pool; // Declared last, its threads are joined before the scenes are destroyed.
+};
+
+#endif /* N _RELAXATION_H_ */
@@ -3,11 +3,15 @@
 
 #include <Utility.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cstdint>
 #include <fstream>
 #include <functional>
+#include <limits>
 #include <numeric>
+#include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -19,6 +23,17 @@ class scene {
 public:
 	typedef std::vector<Helix> HelixContainer;
 
+	// Poses, velocities and base counts of all helices. Saved from a relaxed scene so that the simulation can be restarted from its equilibrium.
+	struct State {
+		struct HelixState {
+			physics::transform_type transform;
+			physics::vec3_type linear_velocity, angular_velocity;
+			unsigned int bases;
+		};
+
+		std::vector<HelixState> helices;
+	};
+
 	struct settings_type {
 		physics::real_type initial_scaling;
 		bool discretize_lengths;
@@ -26,50 +41,84 @@ public:
 
 	inline scene(const settings_type & settings, const ::Helix::settings_type & helix_settings) : settings(settings), helix_settings(helix_settings) {}
 
-	// Distinguish the file type by its file ending and parses either a rmesh or a ply file.
-	inline bool read(physics & phys, const std::string & filename) {
-		if (ends_with(filename, ".ply"))
-			return read_ply(phys, std::ifstream(filename), std::ifstream(strip_trailing_string(filename, ".ply") + ".ntrail"));
-		else if (ends_with(filename, ".ntrail"))
-			return read_ply(phys, std::ifstream(strip_trailing_string(filename, ".ntrail") + ".ply"), std::ifstream(filename));
-		else
-			return read_rmesh(phys, std::ifstream(filename));
-	}
+	// Distinguishes the file type by its file ending and parses either a rmesh or a ply file with its trail. The files are memory mapped.
+	// A .ply file is read with the .ntrail file next to it, or the binary .bntrail if there is none. Returns false if the files can not be opened.
+	// If the edge code (.ecode or .becode) and edge trail (.trail or .btrail) of the mesh are also next to it, they are used as in read_ply.
+	bool read(physics & phys, const std::string & filename);
 
 	// Reads a mesh in the .rmsh "Routed mesh" text based format from the scaffold-routing Maya exporter project.
 	// TODO: Move to SceneDescription?
-	bool read_rmesh(physics & phys, std::istream & ifile);
+	bool read_rmesh(physics & phys, const char *begin, const char *end);
 
-	// Read a mesh using the .ply and .ntrail formats
-	bool read_ply(physics &phys, std::istream & ply_file, std::istream & ntrail_file);
+	// Read a mesh using the ascii or binary .ply format and the text .ntrail or binary .bntrail format. Given the edge code from make_embedding_eulerian
+	// and the edge trail from Atrail_search, the order of the edges around the vertices is taken from the edge code instead of the order of the visits.
+	bool read_ply(physics & phys, const char *ply_begin, const char *ply_end, const char *ntrail_begin, const char *ntrail_end,
+		const char *ecode_begin = NULL, const char *ecode_end = NULL, const char *trail_begin = NULL, const char *trail_end = NULL);
 
 	inline HelixContainer & getHelices() {
 		return helices;
 	}
 
+	inline const ::Helix::settings_type & getHelixSettings() const {
+		return helix_settings;
+	}
+
 	inline HelixContainer::size_type getHelixCount() const {
 		return helices.size();
 	}
 
+	// The separations are cached per joint, only the joints of the helices that moved since the last call are measured again.
 	// TODO: Move to SceneDescription when Scene can be constructed from a SceneDescription.
-	inline physics::real_type getTotalSeparation() const {
-		physics::real_type totalSeparation(0);
-		for (const Helix & helix : helices)
-			totalSeparation += std::accumulate(helix.getJoints().begin(), helix.getJoints().end(), physics::real_type(0), [](physics::real_type & separation, const Helix::Connection & connection) { return separation + (connection ? connection.joint->getDistance() : physics::real_type(0)); });
-
-		return totalSeparation / 2;
+	inline physics::real_type getTotalSeparation() {
+		updateSeparations();
+		return non_finite_separations > 0 ? std::numeric_limits<physics::real_type>::quiet_NaN() : physics::real_type(total_separation / 2);
 	}
 
 	// TODO: Move to SceneDescription when Scene...
-	void getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) const;
+	void getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total);
+
+	State saveState() const;
+
+	// Clears the patch and recreates the helices whose base count differs from the state, then moves all helices to their saved poses and velocities.
+	void restoreState(physics & phys, const State & state);
+
+	// Measures how far the mesh is from rest: the largest speed of any attachment point and the potential energy of the springs, of the patch if one is set.
+	void getResidual(physics::real_type & max_speed, double & energy) const;
 
-	inline bool isSleeping() const {
-		return std::find_if(helices.begin(), helices.end(), std::mem_fun_ref(&Helix::isSleeping)) != helices.end();
+	// Makes only the helices within hops joints of the given helix dynamic, the others are kinematic until clearPatch or restoreState.
+	void setPatch(HelixContainer::size_type helix, unsigned int hops);
+	void clearPatch();
+
+	// The dynamic helices while a patch is set, empty otherwise.
+	inline const std::vector<HelixContainer::size_type> & getPatch() const {
+		return patch;
 	}
 
 private:
 	bool setupHelices(physics & phys);
 
+	// Reads the edge code and edge trail into embedding if every edge of the trail is found between the vertices of the path.
+	bool read_embedding(const char *ecode_begin, const char *ecode_end, const char *trail_begin, const char *trail_end);
+	// Orders neighbor_edges by the embedding. Returns false if the trail does not turn to a neighboring edge at every vertex, as an A-trail does.
+	bool setupRotations();
+	// Direction in which one of duplicates parallel edges is moved away from the others, from their order around its lower numbered vertex.
+	// Its length is between 0 and 1 so that the parallel edges are evenly spaced.
+	physics::vec3_type parallelEdgeSide(unsigned int edge, unsigned int duplicates) const;
+
+	void updateSeparations();
+	void setSeparation(size_t slot, physics::real_type separation);
+
+	physics *phys = NULL; // The physics the helices were created in, set by read_rmesh and read_ply.
+
+	// Separation of every connected joint by helix index * 4 + attachment point, every joint is counted at both its helices.
+	std::vector<physics::real_type> separations;
+	// Only the finite separations are sorted and summed, a NaN would break the ordering of the set and never leave the sum. Diverged joints are counted instead.
+	std::multiset<physics::real_type> sorted_separations; // For the min and max.
+	double total_separation = 0;
+	size_t non_finite_separations = 0;
+	std::vector<physics::rigid_body_type *> moved_bodies;
+	std::vector<HelixContainer::size_type> patch; // The dynamic helices while a patch is set, empty otherwise.
+
 	struct Vertex {
 		physics::vec3_type position, normal;
 		struct Edge {
@@ -82,40 +131,36 @@ private:
 		};
 		typedef std::vector<Edge> NeighborContainer;
 		NeighborContainer neighbor_edges; // Edge indices. TODO: Change name to edges.
-		std::unordered_map<unsigned int, NeighborContainer::const_iterator> edges_lookup;
-
-		// TODO: Rename to optimize_edges or something more suitable.
-		inline void generate_lookup() {
-			//std::sort(neighbor_edges.begin(), neighbor_edges.end());
+		unsigned int unique_neighbors; // Number of distinct vertices the edges lead to.
 
-			edges_lookup.clear();
-			edges_lookup.reserve(neighbor_edges.size());
-			for (NeighborContainer::const_iterator it(neighbor_edges.begin()); it != neighbor_edges.end(); ++it)
-				edges_lookup.insert(std::make_pair(it->index, it));
-		}
-
-		inline Vertex(const physics::vec3_type & position) : position(position) {}
+		inline Vertex(const physics::vec3_type & position) : position(position), unique_neighbors(0) {}
 	};
 
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> path;
+
+	// The rotation system of the mesh, empty unless read_ply was given an edge code that fits the path.
+	struct Embedding {
+		std::vector<unsigned int> offsets, edges; // The edges around vertex v are edges[offsets[v]] to edges[offsets[v + 1]], by their index in the path.
+	} embedding;
+
 	HelixContainer helices;
 
 	struct Edge {
 		std::array<unsigned int, 2> vertices;
-
-		static std::hash<unsigned int> hasher;
+		std::array<unsigned int, 2> slots; // Position of the edge in the neighbor_edges of each of its vertices, set by setupHelices.
 
 		// Visual C++ support for initializer_list is awful.
-		inline Edge(unsigned int vertices_[2]) : vertices(std::array<unsigned int, 2> { { vertices_[0], vertices_[1] } }) {}
-		inline Edge(unsigned int vertex1, unsigned int vertex2) : vertices(std::array<unsigned int, 2> { { vertex1, vertex2 } }) {}
+		inline Edge(unsigned int vertices_[2]) : vertices(std::array<unsigned int, 2> { { vertices_[0], vertices_[1] } }), slots(std::array<unsigned int, 2> { { 0, 0 } }) {}
+		inline Edge(unsigned int vertex1, unsigned int vertex2) : vertices(std::array<unsigned int, 2> { { vertex1, vertex2 } }), slots(std::array<unsigned int, 2> { { 0, 0 } }) {}
 
 		inline bool operator==(const Edge & e) const {
 			return (e.vertices[0] == vertices[0] && e.vertices[1] == vertices[1]) || (e.vertices[0] == vertices[1] && e.vertices[1] == vertices[0]);
 		}
 
-		inline std::hash<unsigned int>::result_type hash() const {
-			return hasher(vertices[0]) + hasher(vertices[1]);
+		// Equal for both directions of the edge and unique for every vertex pair.
+		inline uint64_t key() const {
+			return uint64_t(std::min(vertices[0], vertices[1])) << 32 | std::max(vertices[0], vertices[1]);
 		}
 
 		inline unsigned int other(unsigned int vertex) const {
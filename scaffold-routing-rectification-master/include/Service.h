@@ -0,0 +1,40 @@
+#ifndef _SERVICE_H_
+#define _SERVICE_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * The bscord daemon, started with --serve=<socket>: rectifies the meshes sent to a UNIX domain socket, one per connection, so that many small meshes
+ * do not each pay for starting a process and the PhysX SDK. A request is one line with arguments of the rectifier separated by whitespace, e.g.
+ * "--input=mesh.ply --scaling=20". The reply is a line "OK <output file>" followed by the written rpoly, or a line "ERROR <message>".
+ * Clients are trusted: a request reads and writes any path the user of the daemon may access, so the socket is only accessible to that user.
+ * Not supported on Windows.
+ */
+
+class service {
+public:
+	struct settings_type {
+		std::string socket; // Path of the UNIX domain socket, empty unless serving.
+		std::string tools; // Directory of the graph tools, empty to search the PATH.
+		std::string cache; // Passed to the graph tools as --cache, empty to leave it to BSCOR_CACHE.
+	};
+
+	// Handles the arguments of request number index, whose intermediate files go to its own work directory. Sets the output file that is reported and
+	// the file whose contents are sent, the output or a copy of it in the work directory, or the message if it returns non zero.
+	typedef std::function<int(unsigned int index, const std::vector<std::string> & arguments, const std::string & work_directory, std::string & output_file, std::string & reply_file, std::string & message)> handler_type;
+
+	// Listens on the socket until interrupted, with a thread per concurrent job accepting and handling the requests. Every request gets a new work
+	// directory in TMPDIR, or /tmp, that is removed with its contents once the reply has been sent.
+	// Returns false if the socket can not be created or another daemon is already listening on it.
+	static bool serve(const settings_type & settings, unsigned int concurrent_jobs, const handler_type & handler, const std::atomic<bool> & interrupted);
+
+	// Copies the PLY to the work directory and runs ply_to_dimacs, postman_tour, ply_to_embedding, make_embedding_eulerian and Atrail_search on the
+	// copy, writing their outputs next to it as bscor does. Sets routed_ply to the copy, which is to be rectified. Repeated topologies are copied from
+	// the artifact cache by the tools themselves. Sets the message if it returns false.
+	static bool route(const settings_type & settings, const std::string & ply_file, const std::string & work_directory, std::string & routed_ply, std::string & message);
+};
+
+#endif /* N _SERVICE_H_ */
@@ -1,8 +1,16 @@
 #ifndef _SIMULATED_ANNEALING_H_
 #define _SIMULATED_ANNEALING_H_
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
 
 // Pseudo code from http://en.wikipedia.org/wiki/Simulated_annealing#Pseudocode
 
@@ -62,12 +70,100 @@ void simulated_annealing(
 	}
 }
 
+struct parallel_tempering_settings {
+	unsigned int sweeps, sweep_length; // Temperatures are exchanged after every sweep of sweep_length moves per replica.
+	float min_temperature, max_temperature; // Per helix, the ladder is geometric between them.
+};
+
+/*
+ * Parallel tempering: every replica runs the Metropolis chain of the alternative simulated_annealing above at a fixed temperature on its own thread,
+ * with its own random number generator seeded from seed. After every sweep the replicas at neighbouring temperatures, alternating between the even and
+ * the odd pairs, exchange their temperatures with probability min(1, exp((e_cold - e_hot) * (1 / T_cold - 1 / T_hot))), which is the same as exchanging
+ * their states without copying them. neighbor_functor is called as neighbor_functor(replica, generator) and must only touch its own replica.
+ * It returns false if the energy of the move is not to be trusted, e.g. its relaxation was cut short, and such a move is always reverted and never stored.
+ * The best energy is shared through an atomic, only the moves that improve on it take the lock around store_best_functor. Returns the number of exchanges.
+ * After every move, move_functor(replica, energy, temperature, accepted) is called on the thread of the replica. Every sweep is run by
+ * run_functor(count, chain), which must call chain(i) for every replica i, each on its own thread, and return once all of them have returned, as
+ * worker_pool::run does. After every sweep and its exchanges, sweep_functor() is called on the calling thread while no replica moves.
+ */
+template<typename ReplicaT, typename EnergyFunctorT, typename NeighborFunctorT, typename ProbabilityFunctorT, typename RevertFunctorT, typename StoreBestFunctorT, typename MoveFunctorT, typename RunFunctorT, typename SweepFunctorT, typename RunningFunctorT>
+uint64_t parallel_tempering(std::vector<ReplicaT> & replicas, const std::vector<float> & temperatures, EnergyFunctorT energy_functor, NeighborFunctorT neighbor_functor, ProbabilityFunctorT probability_functor, RevertFunctorT revert_functor, StoreBestFunctorT store_best_functor, MoveFunctorT move_functor, RunFunctorT run_functor, SweepFunctorT sweep_functor, RunningFunctorT running_functor, unsigned int sweeps, unsigned int sweep_length, unsigned int seed) {
+	typedef decltype(energy_functor(replicas.front())) EnergyT;
+	const size_t count(replicas.size());
+	assert(count > 0 && temperatures.size() == count);
+
+	std::vector<std::mt19937> generators;
+	std::vector<EnergyT> energies(count);
+	std::vector<size_t> temperature_of(count), replica_at(count); // Index of the temperature of every replica and its inverse.
+	size_t best_replica(0);
+	for (size_t i = 0; i < count; ++i) {
+		generators.push_back(std::mt19937(seed + (unsigned int) i));
+		energies[i] = energy_functor(replicas[i]);
+		temperature_of[i] = replica_at[i] = i;
+		if (energies[i] < energies[best_replica])
+			best_replica = i;
+	}
+
+	std::atomic<EnergyT> best(energies[best_replica]);
+	EnergyT stored_best(energies[best_replica]);
+	std::mutex store_mutex;
+	store_best_functor(replicas[best_replica], stored_best);
+
+	auto chain = [&](size_t i) {
+		std::uniform_real_distribution<float> uniform(0, 1);
+		for (unsigned int k = 0; k < sweep_length && running_functor(); ++k) {
+			const bool completed(neighbor_functor(replicas[i], generators[i]));
+			const EnergyT enew(energy_functor(replicas[i]));
+
+			const bool accepted(probability_functor(energies[i], enew, temperatures[temperature_of[i]]) > uniform(generators[i]) && completed);
+			if (accepted)
+				energies[i] = enew;
+			else
+				revert_functor(replicas[i]);
+			move_functor(replicas[i], enew, temperatures[temperature_of[i]], accepted);
+			if (!completed)
+				continue;
+
+			EnergyT current(best.load());
+			while (enew < current && !best.compare_exchange_weak(current, enew)) {}
+			if (enew < current) {
+				std::lock_guard<std::mutex> lock(store_mutex);
+				if (enew < stored_best) {
+					store_best_functor(replicas[i], enew);
+					stored_best = enew;
+				}
+			}
+		}
+	};
+
+	std::mt19937 swap_generator(seed + (unsigned int) count);
+	std::uniform_real_distribution<float> uniform(0, 1);
+	uint64_t swaps(0);
+	for (unsigned int sweep = 0; sweep < sweeps && running_functor(); ++sweep) {
+		run_functor(count, chain);
+
+		for (size_t t = sweep % 2; t + 1 < count; t += 2) {
+			const size_t cold(replica_at[t]), hot(replica_at[t + 1]);
+			if (std::exp(float(energies[cold] - energies[hot]) * (1 / temperatures[t] - 1 / temperatures[t + 1])) > uniform(swap_generator)) {
+				std::swap(replica_at[t], replica_at[t + 1]);
+				temperature_of[cold] = t + 1;
+				temperature_of[hot] = t;
+				++swaps;
+			}
+		}
+
+		sweep_functor();
+	}
+
+	return swaps;
+}
+
 // Pseudo code from http://en.wikipedia.org/wiki/Simulated_annealing#Acceptance_probabilities_2
 
 template<typename EnergyT, typename TemperatureT>
 struct probability_functor : std::function<float(EnergyT, EnergyT, TemperatureT)> {
 	inline float operator()(const EnergyT & e, const EnergyT & enew, const TemperatureT & T) const {
-		return enew < e ? result_type(1) : exp(result_type(e - enew) / T);
+		return enew < e ? float(1) : exp(float(e - enew) / T);
 	}
 };
 
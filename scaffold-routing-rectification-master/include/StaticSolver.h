@@ -0,0 +1,32 @@
+#ifndef _STATIC_SOLVER_H_
+#define _STATIC_SOLVER_H_
+
+#include <Scene.h>
+
+#include <cstdint>
+#include <functional>
+
+/*
+ * Finds the static equilibrium of a mesh directly instead of simulating it until it comes to rest. The potential energy of the springs between the
+ * helices and of the fixed springs, k / 2 * d^2 for every spring, is minimized over the helix poses with L-BFGS using its analytic gradient: the forces
+ * and torques of the springs on the helices. Steps translate the helices and rotate them around their origins by rotation vectors in the world frame.
+ * Like the reference physics backend, it ignores collisions between helices. Computations are done in double precision.
+ */
+
+class static_solver {
+public:
+	struct settings_type {
+		unsigned int history; // Number of correction pairs kept by L-BFGS.
+		unsigned int max_iterations;
+		// Converged when the largest remaining force divided by the stiffest spring is less than this distance in nm. Torques are also divided by the longest anchor arm.
+		double tolerance;
+	};
+
+	// Moves the helices of the mesh to the minimum, only those of the patch while one is set. Returns false if it was not reached within max_iterations or running_functor returned false.
+	static bool minimize(scene & mesh, const settings_type & settings, const std::function<bool()> & running_functor, uint64_t & iterations);
+
+	// Like minimize, but chains of chain_length consecutive helices along the scaffold path move as rigid bodies. The joints within a chain are left as they are.
+	static bool minimize_coarse(scene & mesh, unsigned int chain_length, const settings_type & settings, const std::function<bool()> & running_functor);
+};
+
+#endif /* N _STATIC_SOLVER_H_ */
@@ -0,0 +1,72 @@
+#ifndef _STATISTICS_H_
+#define _STATISTICS_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Per stage wall time, CPU time and peak resident set size plus counters, reported with --stats=json (a "STATS: " line on stdout) or --stats=<filename>.
+ * The JSON layout is the same as the one written by the pipeline tools (pipeline_stats.hpp).
+ */
+
+class statistics {
+public:
+	struct usage_type {
+		double wall, cpu; // seconds
+		uint64_t peak_rss_kb;
+	};
+
+	static usage_type current_usage();
+
+	// The statistics of this process.
+	static statistics & instance();
+
+	// output is "json", a filename or empty for disabled.
+	inline void setOutput(const std::string & output) { this->output = output; }
+	inline bool isEnabled() const { return !output.empty(); }
+
+	// Stages may nest, every stage is reported on its own. Stages begun on different threads are ended by the index begin_stage returned.
+	size_t begin_stage(const std::string & name);
+	void end_stage();
+	void end_stage(size_t stage);
+
+	// Counters may be updated from several threads.
+	inline void set_counter(const std::string & name, uint64_t value) { std::lock_guard<std::mutex> lock(counters_mutex); counters[name] = value; }
+	inline void add_counter(const std::string & name, uint64_t value = 1) { std::lock_guard<std::mutex> lock(counters_mutex); counters[name] += value; }
+	inline void max_counter(const std::string & name, uint64_t value) { std::lock_guard<std::mutex> lock(counters_mutex); uint64_t & counter(counters[name]); counter = std::max(counter, value); }
+
+	std::string to_json(const std::string & tool) const;
+	bool write(const std::string & tool) const;
+
+private:
+	statistics();
+
+	struct stage {
+		std::string name;
+		usage_type begin, end;
+		bool open;
+	};
+
+	std::string output;
+	usage_type start;
+	std::vector<stage> stages;
+	std::vector<size_t> open_stages;
+	mutable std::mutex stages_mutex;
+	std::map<std::string, uint64_t> counters;
+	mutable std::mutex counters_mutex;
+};
+
+/*
+ * Times a stage for as long as it is in scope.
+ */
+class scoped_stage {
+public:
+	inline explicit scoped_stage(const std::string & name) { statistics::instance().begin_stage(name); }
+	inline ~scoped_stage() { statistics::instance().end_stage(); }
+};
+
+#endif /* N _STATISTICS_H_ */
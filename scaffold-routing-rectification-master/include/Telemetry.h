@@ -0,0 +1,69 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * A JSON lines stream with one line per evaluated candidate, written with --telemetry=<filename>. Events are queued by the optimizers and written
+ * by a background thread, so that the relaxations never wait for the file. Every line is flushed with the batch it was written in.
+ */
+
+class telemetry {
+public:
+	struct event {
+		const char *search; // "descent" or "tempering".
+		unsigned int job; // Index in the --batch manifest, 0 for a single structure.
+		unsigned int worker;
+		uint64_t helix;
+		int bases;
+		double separation; // Total, nm. Written as null if it is not finite.
+		bool completed, accepted;
+		uint64_t steps;
+		double wall_ms;
+		float temperature; // Negative if the search has no temperature.
+	};
+
+	// The telemetry of this process.
+	static telemetry & instance();
+
+	// Starts the writer thread. Returns false if the file can not be opened.
+	bool open(const std::string & filename);
+	// Writes the remaining events and stops the writer thread.
+	void close();
+
+	inline bool isEnabled() const { return enabled; }
+
+	// May be called from several threads. Does nothing unless open.
+	void record(const event & e);
+
+	~telemetry();
+
+private:
+	telemetry();
+
+	struct queued_event {
+		event e;
+		uint64_t index;
+		double time; // Seconds since open.
+	};
+
+	void write_loop();
+
+	bool enabled;
+	std::ofstream outfile;
+	std::thread writer;
+	std::mutex queue_mutex;
+	std::condition_variable queue_changed;
+	std::vector<queued_event> queue;
+	uint64_t next_index;
+	double start;
+	bool stopping;
+};
+
+#endif /* N _TELEMETRY_H_ */
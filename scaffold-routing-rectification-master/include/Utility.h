@@ -12,6 +12,12 @@
 #include <Physics.h>
 
 #include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 /*
@@ -19,11 +25,12 @@
  */
 
 inline bool ends_with(const std::string & haystack, const std::string & needle) {
-	return haystack.find_last_of(needle) == haystack.length() - 1;
+	return haystack.length() >= needle.length() && haystack.compare(haystack.length() - needle.length(), needle.length(), needle) == 0;
 }
 
+// Removes trailing from the end of str if str ends with it.
 inline std::string strip_trailing_string(const std::string & str, const std::string & trailing) {
-	return str.substr(0, str.length() - trailing.length());
+	return ends_with(str, trailing) ? str.substr(0, str.length() - trailing.length()) : str;
 }
 
 #ifdef __GNUC__
@@ -69,35 +76,35 @@ T toDegrees(T radians) {
 /*
 * Project vector 'from' onto 'onto'.
 */
-inline physx::PxVec3 proj(const physx::PxVec3 & from, const physx::PxVec3 & onto) {
+inline physics::vec3_type proj(const physics::vec3_type & from, const physics::vec3_type & onto) {
 	return onto * (from.dot(onto) / onto.magnitudeSquared());
 }
 
-static const physx::PxVec3 kPosXAxis(1, 0, 0);
-static const physx::PxVec3 kPosYAxis(0, 1, 0);
-static const physx::PxVec3 kPosZAxis(0, 0, 1);
+static const physics::vec3_type kPosXAxis(1, 0, 0);
+static const physics::vec3_type kPosYAxis(0, 1, 0);
+static const physics::vec3_type kPosZAxis(0, 0, 1);
 
-static const physx::PxVec3 kNegXAxis(-1, 0, 0);
-static const physx::PxVec3 kNegYAxis(0, -1, 0);
-static const physx::PxVec3 kNegZAxis(0, 0, -1);
+static const physics::vec3_type kNegXAxis(-1, 0, 0);
+static const physics::vec3_type kNegYAxis(0, -1, 0);
+static const physics::vec3_type kNegZAxis(0, 0, -1);
 
-static const physx::PxVec3 kZeroVec(0, 0, 0);
-static const physx::PxVec3 kOneVec(1, 1, 1);
+static const physics::vec3_type kZeroVec(0, 0, 0);
+static const physics::vec3_type kOneVec(1, 1, 1);
 
-inline auto signedAngle(physx::PxVec3 from, physx::PxVec3 to, const physx::PxVec3 & normal)->decltype(from.dot(to)) {
+inline auto signedAngle(physics::vec3_type from, physics::vec3_type to, const physics::vec3_type & normal)->decltype(from.dot(to)) {
 	from.normalize();
 	to.normalize();
-	const physx::PxReal tofrom(to.dot(from));
+	const physics::real_type tofrom(to.dot(from));
 
-	if (abs(tofrom) >= physx::PxReal(1.0 - 1e-06))
-		return (1 - sgn_nozero(tofrom)) * physx::PxReal(M_PI / 2);
+	if (std::abs(tofrom) >= physics::real_type(1.0 - 1e-06))
+		return (1 - sgn_nozero(tofrom)) * physics::real_type(M_PI / 2);
 	else {
 		const int sign = sgn_nozero((normal.cross(from)).dot(to));
 		return sign * std::acos(tofrom);
 	}
 }
 
-physx::PxQuat rotationFromTo(physx::PxVec3 from, physx::PxVec3 to);
+physics::quaternion_type rotationFromTo(physics::vec3_type from, physics::vec3_type to);
 
 template<typename U, typename V>
 V circular_index(U index, V length) {
@@ -131,7 +138,7 @@ void seed();
 #include <windows.h>
 
 // Do not use, internal only, use setinterrupthandler() below.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 BOOL WINAPI __InterruptHandlerRoutine(_In_  DWORD dwCtrlType) {
 	if (dwCtrlType == CTRL_C_EVENT)
 		FuncPtr();
@@ -139,7 +146,7 @@ BOOL WINAPI __InterruptHandlerRoutine(_In_  DWORD dwCtrlType) {
 }
 
 // Set interrupt handler ^C by template argument to function pointer.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 inline void setinterrupthandler() {
 	SetConsoleCtrlHandler(__InterruptHandlerRoutine<FuncPtr>, TRUE);
 }
@@ -154,22 +161,37 @@ inline void seed() {
 	srand(GetTickCount());
 }
 
+// Renames from to to, replacing to if it exists.
+inline bool replace_file(const std::string & from, const std::string & to) {
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+}
+
 inline unsigned int numcpucores() {
 	SYSTEM_INFO sysinfo;
 	GetSystemInfo(&sysinfo);
-	return unsigned int(sysinfo.dwNumberOfProcessors);
+	return (unsigned int) sysinfo.dwNumberOfProcessors;
 }
 
 #else
 
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <strings.h>
+#include <unistd.h>
+
+inline int stricmp(const char *str1, const char *str2) {
+	return strcasecmp(str1, str2);
+}
+
 // Do not use, internal only, use setinterrupthandler below.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 void __interrupthandlerroutine(int s) {
 	FuncPtr();
 }
 
 // Set the interrupt handler ^C by template argument to function pointer.
-template<typename void(*FuncPtr)()>
+template<void(*FuncPtr)()>
 inline void setinterrupthandler() {
 	struct sigaction sigint_handler;
 	sigint_handler.sa_handler = __interrupthandlerroutine<FuncPtr>;
@@ -190,10 +212,68 @@ inline void seed() {
 	srand(time(NULL));
 }
 
+// Renames from to to, replacing to if it exists. The replacement is atomic.
+inline bool replace_file(const std::string & from, const std::string & to) {
+	return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
 inline unsigned int numcpucores() {
-	return unsigned int(sysconf(_SC_NPROCESSORS_ONLN));
+	return (unsigned int) sysconf(_SC_NPROCESSORS_ONLN);
 }
 
 #endif /* N _WINDOWS */
 
+/*
+ * A read only memory mapping of a whole file. Empty files are opened without a mapping, data() is then NULL.
+ */
+class mapped_file {
+public:
+	inline mapped_file() : address(NULL), length(0) {}
+	inline ~mapped_file() { close(); }
+
+	bool open(const std::string & filename);
+	void close();
+
+	inline const char *data() const { return address; }
+	inline const char *end() const { return address + length; }
+	inline size_t size() const { return length; }
+
+private:
+	mapped_file(const mapped_file &);
+	mapped_file & operator=(const mapped_file &);
+
+	const char *address;
+	size_t length;
+};
+
+/*
+ * Threads that stay alive between rounds of work, so that a round does not pay for creating and joining threads. run(count, task) calls task(0) on the
+ * calling thread and task(1), ..., task(count - 1) on the threads of the pool, and returns once all of them have returned. count may be at most getThreadCount() + 1.
+ */
+class worker_pool {
+public:
+	explicit worker_pool(unsigned int threads);
+	~worker_pool();
+
+	void run(size_t count, const std::function<void(size_t)> & task);
+
+	inline unsigned int getThreadCount() const {
+		return (unsigned int) threads.size();
+	}
+
+private:
+	worker_pool(const worker_pool &);
+	worker_pool & operator=(const worker_pool &);
+
+	void loop(size_t thread);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start_condition, done_condition;
+	const std::function<void(size_t)> *task; // Of the current round.
+	size_t count, pending; // Tasks of the current round, and those of them the threads have not finished yet.
+	uint64_t round; // Counts the rounds, so that a thread only takes a round once.
+	bool stopping;
+};
+
 #endif /* UTILITY_H_ */
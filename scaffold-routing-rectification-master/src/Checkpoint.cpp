@@ -0,0 +1,66 @@
+#include <Definition.h>
+#include <Checkpoint.h>
+
+#include <atomic>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <utility>
+
+namespace {
+	const char *kMagic = "rectification-checkpoint";
+	const int kVersion = 1;
+}
+
+std::string temporary_filename(const std::string & filename) {
+	static std::atomic<unsigned int> next(0);
+	std::ostringstream ss;
+	ss << filename << ".tmp" << next++;
+	return ss.str();
+}
+
+bool checkpoint::write(const std::string & filename) const {
+	return write_atomically(filename, [this](std::ostream & out) {
+		out << std::setprecision(std::numeric_limits<physics::real_type>::max_digits10)
+			<< kMagic << ' ' << kVersion << std::endl
+			<< "helices " << state.helices.size() << std::endl
+			<< "position " << position << std::endl
+			<< "total " << total << std::endl;
+
+		for (const scene::State::HelixState & helix : state.helices) {
+			const physics::transform_type & t(helix.transform);
+			const physics::vec3_type & v(helix.linear_velocity), & w(helix.angular_velocity);
+			out << "h " << helix.bases << ' ' << t.p.x << ' ' << t.p.y << ' ' << t.p.z << ' ' << t.q.x << ' ' << t.q.y << ' ' << t.q.z << ' ' << t.q.w
+				<< ' ' << v.x << ' ' << v.y << ' ' << v.z << ' ' << w.x << ' ' << w.y << ' ' << w.z << std::endl;
+		}
+
+		return bool(out);
+	});
+}
+
+bool checkpoint::read(const std::string & filename) {
+	std::ifstream infile(filename);
+	if (!infile)
+		return false;
+
+	// Parsed into a copy, so that an invalid file leaves this checkpoint as it was.
+	checkpoint parsed;
+	std::string magic, key;
+	int version;
+	size_t count;
+	if (!(infile >> magic >> version) || magic != kMagic || version != kVersion)
+		return false;
+	if (!(infile >> key >> count) || key != "helices" || !(infile >> key >> parsed.position) || key != "position" || !(infile >> key >> parsed.total) || key != "total")
+		return false;
+
+	parsed.state.helices.resize(count);
+	for (scene::State::HelixState & helix : parsed.state.helices) {
+		physics::transform_type & t(helix.transform);
+		physics::vec3_type & v(helix.linear_velocity), & w(helix.angular_velocity);
+		if (!(infile >> key >> helix.bases >> t.p.x >> t.p.y >> t.p.z >> t.q.x >> t.q.y >> t.q.z >> t.q.w >> v.x >> v.y >> v.z >> w.x >> w.y >> w.z) || key != "h")
+			return false;
+	}
+
+	*this = std::move(parsed);
+	return true;
+}
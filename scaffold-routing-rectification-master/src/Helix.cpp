@@ -2,44 +2,51 @@
 #include <DNA.h>
 #include <Helix.h>
 
+#include <algorithm>
+#include <array>
 #include <cassert>
-#include <initializer_list>
+#include <stdexcept>
 
 physics::vec3_type localFrame(Helix::AttachmentPoint point, int bases) {
 	const physics::vec3_type offset(0, 0, physics::real_type(DNA::BasesToLength(bases) / 2));
 
 	switch (point) {
 	case Helix::kForwardThreePrime:
-		return physics::quaternion_type(physics::real_type(toRadians(DNA::BasesToRotation(bases))), kPosZAxis).rotate(physics::vec3_type(0, physics::real_type(DNA::RADIUS), 0)) + offset;
+		return DNA::ForwardEndDirection(bases) * physics::real_type(DNA::RADIUS) + offset;
 	case Helix::kForwardFivePrime:
 		return physics::vec3_type(0, physics::real_type(DNA::RADIUS), 0) - offset;
 	case Helix::kBackwardThreePrime:
-		return physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), kPosZAxis).rotate(physics::vec3_type(0, physics::real_type(DNA::RADIUS), 0)) - offset;
+		return DNA::BackwardStartDirection() * physics::real_type(DNA::RADIUS) - offset;
 	case Helix::kBackwardFivePrime:
-		return physics::quaternion_type(physics::real_type(toRadians(DNA::BasesToRotation(bases) - DNA::OPPOSITE_ROTATION)), kPosZAxis).rotate(physics::vec3_type(0, physics::real_type(DNA::RADIUS), 0)) + offset;
+		return DNA::BackwardEndDirection(bases) * physics::real_type(DNA::RADIUS) + offset;
 	default:
 		assert(0);
 		return physics::vec3_type();
 	}
 }
 
-std::initializer_list<Helix::AttachmentPoint> opposites(Helix::AttachmentPoint point) {
+std::array<Helix::AttachmentPoint, 2> opposites(Helix::AttachmentPoint point) {
 	switch (point) {
 	case Helix::kForwardThreePrime:
 	case Helix::kBackwardThreePrime:
-		return{ Helix::kForwardFivePrime, Helix::kBackwardFivePrime };
+		return{ { Helix::kForwardFivePrime, Helix::kBackwardFivePrime } };
 	case Helix::kForwardFivePrime:
 	case Helix::kBackwardFivePrime:
-		return { Helix::kForwardThreePrime, Helix::kBackwardThreePrime };
+		return{ { Helix::kForwardThreePrime, Helix::kBackwardThreePrime } };
 	default:
 		assert(0);
-		return{ Helix::kNoAttachmentPoint, Helix::kNoAttachmentPoint };
+		return{ { Helix::kNoAttachmentPoint, Helix::kNoAttachmentPoint } };
 	}
 }
 
-void Helix::createRigidBody(physics & phys, int bases, const physics::transform_type & transform) {
-	assert(rigidBody == nullptr);
+// Turns the x axis capsule along the helix axis.
+static const physics::quaternion_type kCapsuleRotation(physics::real_type(M_PI_2), kNegYAxis);
 
+/*
+ * Calls functor with the geometries of a helix with the given number of bases as std::pair<geometry, local pose> arguments.
+ */
+template<typename ResultT, typename FunctorT>
+ResultT helixGeometries(int bases, const FunctorT & functor) {
 	const physics::real_type length(physics::real_type(DNA::BasesToLength(bases)));
 	//assert(length > DNA::RADIUS_PLUS_SPHERE_RADIUS * 2);
 	if (length <= 0/*DNA::RADIUS_PLUS_SPHERE_RADIUS * 2*/)
@@ -50,23 +57,54 @@ void Helix::createRigidBody(physics & phys, int bases, const physics::transform_
 
 	const physics::sphere_geometry_type sphereGeometry(radius);
 	if (length > DNA::RADIUS_PLUS_SPHERE_RADIUS * 2) {
-		rigidBody = phys.create_rigid_body(transform, settings.density,
-			std::make_pair(physics::capsule_geometry_type(physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS), length / 2 - physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS)), physics::transform_type(physics::quaternion_type(physics::real_type(M_PI_2), kNegYAxis))),
+		return functor(
+			std::make_pair(physics::capsule_geometry_type(physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS), length / 2 - physics::real_type(DNA::RADIUS_PLUS_SPHERE_RADIUS)), physics::transform_type(kCapsuleRotation)),
 			std::make_pair(sphereGeometry, physics::transform_type(physics::vec3_type(0, offset, -length / 2 + radius))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, -length / 2 + radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases - DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))));
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::BackwardStartDirection() * offset + physics::vec3_type(0, 0, -length / 2 + radius))),
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::ForwardEndDirection(bases) * offset + physics::vec3_type(0, 0, length / 2 - radius))),
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::BackwardEndDirection(bases) * offset + physics::vec3_type(0, 0, length / 2 - radius))));
 	} else {
-		rigidBody = phys.create_rigid_body(transform, settings.density,
+		return functor(
 			std::make_pair(sphereGeometry, physics::transform_type(physics::vec3_type(0, offset, -length / 2 + radius))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(-DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, -length / 2 + radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))),
-			std::make_pair(sphereGeometry, physics::transform_type(physics::quaternion_type(physics::real_type(toRadians(DNA::PITCH * bases - DNA::OPPOSITE_ROTATION)), physics::vec3_type(0, 0, 1)).rotate(physics::vec3_type(0, offset, length / 2 - radius)))));
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::BackwardStartDirection() * offset + physics::vec3_type(0, 0, -length / 2 + radius))),
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::ForwardEndDirection(bases) * offset + physics::vec3_type(0, 0, length / 2 - radius))),
+			std::make_pair(sphereGeometry, physics::transform_type(DNA::BackwardEndDirection(bases) * offset + physics::vec3_type(0, 0, length / 2 - radius))));
+	}
+}
+
+struct createRigidBodyFunctor {
+	physics & phys;
+	const physics::transform_type & transform;
+	physics::real_type density;
+
+	template<typename... GeometryListT>
+	inline physics::rigid_body_type *operator()(const GeometryListT &... geometries) const {
+		return phys.create_rigid_body(transform, density, geometries...);
 	}
+};
+
+struct updateRigidBodyFunctor {
+	physics & phys;
+	physics::rigid_body_type *rigidBody;
+	physics::real_type density;
+
+	template<typename... GeometryListT>
+	inline bool operator()(const GeometryListT &... geometries) const {
+		return phys.update_rigid_body(rigidBody, density, geometries...);
+	}
+};
+
+void Helix::createRigidBody(physics & phys, int bases, const physics::transform_type & transform) {
+	assert(rigidBody == nullptr);
+
+	const createRigidBodyFunctor functor = { phys, transform, settings.density };
+	rigidBody = helixGeometries<physics::rigid_body_type *>(bases, functor);
 	assert(rigidBody != nullptr);
+	bindRigidBody();
 
+	// The fixed joint always holds the helix to where it was initially.
 	if (settings.attach_fixed) {
-		fixedJoint = phys.create_spring_joint(rigidBody, physics::transform_type(kZeroVec), NULL, transform, settings.fixed_spring_stiffness, settings.spring_damping);
+		fixedJoint = phys.create_spring_joint(rigidBody, physics::transform_type(kZeroVec), NULL, initialTransform, settings.fixed_spring_stiffness, settings.spring_damping);
 		assert(rigidBody != nullptr);
 	}
 
@@ -94,6 +132,23 @@ void Helix::recreateRigidBody(physics & phys, int bases, const physics::transfor
 		attach(phys, *std::get<0>(points[i]), std::get<1>(points[i]), std::get<2>(points[i]));
 }
 
+void Helix::setBaseCount(physics & phys, int bases, const physics::transform_type & transform) {
+	const updateRigidBodyFunctor functor = { phys, rigidBody, settings.density };
+	if (!helixGeometries<bool>(bases, functor)) {
+		recreateRigidBody(phys, bases, transform);
+		return;
+	}
+
+	this->bases = bases;
+	setTransform(transform);
+	setVelocity(kZeroVec, kZeroVec);
+
+	for (int i = 0; i < 4; ++i) {
+		if (joints[i])
+			phys.set_spring_frame(joints[i].joint, rigidBody, physics::transform_type(localFrame(AttachmentPoint(i), bases)));
+	}
+}
+
 void Helix::attach(physics & phys, Helix & other, AttachmentPoint thisPoint, AttachmentPoint otherPoint) {
 	assert(rigidBody);
 	//assert(joints[thisPoint].helix == nullptr && joints[thisPoint].joint == nullptr && other.joints[otherPoint].helix == nullptr && other.joints[otherPoint].joint == nullptr);
@@ -107,6 +162,10 @@ void Helix::attach(physics & phys, Helix & other, AttachmentPoint thisPoint, Att
 	other.joints[otherPoint].joint = joint;
 }
 
+physics::vec3_type Helix::getLocalFrame(AttachmentPoint point) const {
+	return localFrame(point, bases);
+}
+
 physics::real_type Helix::getSeparation(AttachmentPoint atPoint) const {
 	const physics::vec3_type attachmentPoint0(physics::transform(physics::world_transform(*rigidBody), localFrame(atPoint, bases)));
 	const Helix & other(*joints[atPoint].helix);
@@ -114,9 +173,34 @@ physics::real_type Helix::getSeparation(AttachmentPoint atPoint) const {
 	return (attachmentPoint1 - attachmentPoint0).magnitude();
 }
 
+physics::real_type Helix::getMaxSpeed() const {
+	physics::real_type arm(0);
+	for (int point = 0; point < 4; ++point)
+		arm = std::max(arm, localFrame(AttachmentPoint(point), bases).magnitude());
+	return getLinearVelocity().magnitude() + getAngularVelocity().magnitude() * arm;
+}
+
+double Helix::getPotentialEnergy() const {
+	double energy(0);
+	for (const Connection & connection : joints) {
+		if (connection) {
+			const double length(physics::spring_length(*connection.joint));
+			energy += settings.spring_stiffness * length * length / 4;
+		}
+	}
+
+	if (fixedJoint) {
+		const double length(physics::spring_length(*fixedJoint));
+		energy += settings.fixed_spring_stiffness * length * length / 2;
+	}
+
+	return energy;
+}
+
 Helix::AttachmentPoint Helix::otherPoint(Helix::AttachmentPoint point, const Helix & other) const {
+	// Helices may be connected at both ends, so the joint has to match too.
 	for (Helix::AttachmentPoint otherPoint : opposites(point)) {
-		if (other.joints[otherPoint].helix == this)
+		if (other.joints[otherPoint].helix == this && other.joints[otherPoint].joint == joints[point].joint)
 			return otherPoint;
 	}
 
@@ -1,41 +1,100 @@
+#ifndef REFERENCE_PHYSICS
+
 #include <Utility.h>
 #include <Physics.h>
 
 const physics::quaternion_type physics::quaternion_identity(physx::PxIdentity);
 
+namespace {
+	// The foundation, SDK and CPU dispatcher shared by all physics instances, created by the first and released by the last.
+	// With one dispatcher of numcpucores() threads for all scenes, concurrent workers and structures do not oversubscribe the CPU.
+	struct shared_sdk {
+		physx::PxDefaultAllocator allocator;
+		physx::PxDefaultErrorCallback errorCallback;
+
+		physx::PxFoundation *foundation;
+		physx::PxProfileZoneManager* profileZoneManager;
+		physx::PxPhysics *pxphysics;
+		physx::PxVisualDebuggerConnection *connection;
+		physx::PxDefaultCpuDispatcher *dispatcher;
+
+		unsigned int instances = 0;
+	};
+
+	shared_sdk sdk;
+}
+
+std::mutex & physics::sdk_mutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
 physics::physics(const settings_type & settings) : settings(settings) {
-	foundation = PxCreateFoundation(PX_PHYSICS_VERSION, allocator, errorCallback);
-	profileZoneManager = &physx::PxProfileZoneManager::createProfileZoneManager(foundation);
-	pxphysics = PxCreatePhysics(PX_PHYSICS_VERSION, *foundation, physx::PxTolerancesScale(), true, profileZoneManager);
-
-	if (pxphysics->getPvdConnectionManager()) {
-		pxphysics->getVisualDebugger()->setVisualizeConstraints(true);
-		pxphysics->getVisualDebugger()->setVisualDebuggerFlag(physx::PxVisualDebuggerFlag::eTRANSMIT_CONTACTS, true);
-		pxphysics->getVisualDebugger()->setVisualDebuggerFlag(physx::PxVisualDebuggerFlag::eTRANSMIT_SCENEQUERIES, true);
-		pxphysics->getVisualDebugger()->updateCamera("default", physx::PxVec3(0, 0, -60), physx::PxVec3(0, 1, 0), physx::PxVec3(0, 0, 0));
-		connection = physx::PxVisualDebuggerExt::createConnection(pxphysics->getPvdConnectionManager(), PVD_HOST, PVD_PORT, physx::PxVisualDebuggerConnectionFlag::eDEBUG);
-	} else
-		connection = nullptr;
+	std::lock_guard<std::mutex> lock(sdk_mutex());
+
+	if (sdk.instances++ == 0) {
+		sdk.foundation = PxCreateFoundation(PX_PHYSICS_VERSION, sdk.allocator, sdk.errorCallback);
+		sdk.profileZoneManager = &physx::PxProfileZoneManager::createProfileZoneManager(sdk.foundation);
+		sdk.pxphysics = PxCreatePhysics(PX_PHYSICS_VERSION, *sdk.foundation, physx::PxTolerancesScale(), true, sdk.profileZoneManager);
+
+		if (sdk.pxphysics->getPvdConnectionManager()) {
+			sdk.pxphysics->getVisualDebugger()->setVisualizeConstraints(true);
+			sdk.pxphysics->getVisualDebugger()->setVisualDebuggerFlag(physx::PxVisualDebuggerFlag::eTRANSMIT_CONTACTS, true);
+			sdk.pxphysics->getVisualDebugger()->setVisualDebuggerFlag(physx::PxVisualDebuggerFlag::eTRANSMIT_SCENEQUERIES, true);
+			sdk.pxphysics->getVisualDebugger()->updateCamera("default", physx::PxVec3(0, 0, -60), physx::PxVec3(0, 1, 0), physx::PxVec3(0, 0, 0));
+			sdk.connection = physx::PxVisualDebuggerExt::createConnection(sdk.pxphysics->getPvdConnectionManager(), PVD_HOST, PVD_PORT, physx::PxVisualDebuggerConnectionFlag::eDEBUG);
+		} else
+			sdk.connection = nullptr;
+
+		sdk.dispatcher = physx::PxDefaultCpuDispatcherCreate(numcpucores());
+		PRINT("This CPU has %u cores.", numcpucores());
+	}
+
+	foundation = sdk.foundation;
+	profileZoneManager = sdk.profileZoneManager;
+	pxphysics = sdk.pxphysics;
+	connection = sdk.connection;
+	dispatcher = sdk.dispatcher;
 
 	physx::PxSceneDesc sceneDesc(pxphysics->getTolerancesScale());
-	PRINT("This CPU has %u cores.", numcpucores());
-	dispatcher = physx::PxDefaultCpuDispatcherCreate(numcpucores());
 	sceneDesc.cpuDispatcher = dispatcher;
 	sceneDesc.filterShader = physx::PxDefaultSimulationFilterShader;
+	sceneDesc.flags |= physx::PxSceneFlag::eENABLE_ACTIVETRANSFORMS;
 
 	scene = pxphysics->createScene(sceneDesc);
+	scene->userData = this;
 
-	material = pxphysics->createMaterial(settings.kStaticFriction, settings.kDynamicFriction, settings.kRestitution); // What about deletion upon destruction?
+	material = pxphysics->createMaterial(settings.kStaticFriction, settings.kDynamicFriction, settings.kRestitution);
 }
 
 physics::~physics() {
+	std::lock_guard<std::mutex> lock(sdk_mutex());
+
+	// The scene does not release what was created in it, so the joints, then the bodies they connect and the material they share go first.
+	for (spring_joint_type *joint : joints)
+		joint->release();
+
+	std::vector<physx::PxActor *> actors(scene->getNbActors(physx::PxActorTypeSelectionFlag::eRIGID_DYNAMIC));
+	scene->getActors(physx::PxActorTypeSelectionFlag::eRIGID_DYNAMIC, actors.data(), physx::PxU32(actors.size()));
+	for (physx::PxActor *actor : actors)
+		actor->release();
+
+	material->release();
 	scene->release();
-	dispatcher->release();
-	if (connection)
-		connection->release();
-	pxphysics->release();
-	profileZoneManager->release();
-	foundation->release();
+
+	if (--sdk.instances == 0) {
+		sdk.dispatcher->release();
+		if (sdk.connection)
+			sdk.connection->release();
+		sdk.pxphysics->release();
+		sdk.profileZoneManager->release();
+		sdk.foundation->release();
+	}
+}
+
+void physics::collect_moved_bodies(std::vector<rigid_body_type *> & moved) {
+	moved.assign(moved_bodies.begin(), moved_bodies.end());
+	moved_bodies.clear();
 }
 
 physics::sphere_geometry_type physics::create_sphere_geometry(real_type radius) {
@@ -47,11 +106,32 @@ physics::capsule_geometry_type physics::create_x_axis_capsule(real_type radius,
 }
 
 physics::spring_joint_type *physics::create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping) {
+	std::lock_guard<std::mutex> lock(sdk_mutex());
 	physx::PxDistanceJoint *joint(physx::PxDistanceJointCreate(*pxphysics, rigid_body1, transform1, rigid_body2, transform2));
 	joint->setDistanceJointFlag(physx::PxDistanceJointFlag::eSPRING_ENABLED, true);
 	joint->setDistanceJointFlag(physx::PxDistanceJointFlag::eMAX_DISTANCE_ENABLED, true);
 	joint->setStiffness(stiffness);
 	joint->setDamping(damping);
 
+	joints.insert(joint);
 	return joint;
 }
+
+void physics::destroy_rigid_body(rigid_body_type *rigid_body) {
+	std::lock_guard<std::mutex> lock(sdk_mutex());
+	for (std::unordered_set<spring_joint_type *>::iterator it(joints.begin()); it != joints.end();) {
+		physx::PxRigidActor *actor0, *actor1;
+		(*it)->getActors(actor0, actor1);
+		if (actor0 == rigid_body || actor1 == rigid_body) {
+			(*it)->release();
+			it = joints.erase(it);
+		} else
+			++it;
+	}
+
+	moved_bodies.erase(rigid_body);
+	scene->removeActor(*rigid_body);
+	rigid_body->release();
+}
+
+#endif /* N REFERENCE_PHYSICS */
@@ -0,0 +1,617 @@
+#ifdef REFERENCE_PHYSICS
+
+#include <Utility.h>
+#include <Physics.h>
+
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define REFERENCE_PHYSICS_SSE
+#endif /* N SSE2 */
+
+using namespace reference_physics;
+
+namespace {
+	const unsigned int kNoBody = 0; // The world.
+	const real_type kWakeCounterResetValue = real_type(0.4); // Seconds a body must rest before it may sleep, as in PhysX.
+	const real_type kAngularDamping = real_type(0.05), kMaxAngularVelocity = real_type(7); // PhysX rigid dynamic defaults.
+	const unsigned int kMaxSubsteps = 256;
+
+	/*
+	 * Four lanes of floats: SSE when available, otherwise plain arrays the compiler may vectorize.
+	 */
+#ifdef REFERENCE_PHYSICS_SSE
+	struct float4 {
+		__m128 v;
+
+		inline float4() {}
+		inline float4(__m128 v) : v(v) {}
+		inline float4(float f) : v(_mm_set1_ps(f)) {}
+
+		static inline float4 load(const float *p) { return _mm_loadu_ps(p); }
+		inline void store(float *p) const { _mm_storeu_ps(p, v); }
+
+		inline float4 operator+(const float4 & o) const { return _mm_add_ps(v, o.v); }
+		inline float4 operator-(const float4 & o) const { return _mm_sub_ps(v, o.v); }
+		inline float4 operator*(const float4 & o) const { return _mm_mul_ps(v, o.v); }
+		inline float4 operator/(const float4 & o) const { return _mm_div_ps(v, o.v); }
+	};
+
+	inline float4 sqrt(const float4 & a) { return _mm_sqrt_ps(a.v); }
+	inline float4 min(const float4 & a, const float4 & b) { return _mm_min_ps(a.v, b.v); }
+	inline float4 max(const float4 & a, const float4 & b) { return _mm_max_ps(a.v, b.v); }
+	// Lanes where a < b take the value of if_less, the others if_not_less.
+	inline float4 select_less(const float4 & a, const float4 & b, const float4 & if_less, const float4 & if_not_less) {
+		const __m128 mask(_mm_cmplt_ps(a.v, b.v));
+		return _mm_or_ps(_mm_and_ps(mask, if_less.v), _mm_andnot_ps(mask, if_not_less.v));
+	}
+#else
+	struct float4 {
+		float v[4];
+
+		inline float4() {}
+		inline float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+
+		static inline float4 load(const float *p) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+		inline void store(float *p) const { for (int i = 0; i < 4; ++i) p[i] = v[i]; }
+
+		inline float4 operator+(const float4 & o) const { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] + o.v[i]; return r; }
+		inline float4 operator-(const float4 & o) const { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] - o.v[i]; return r; }
+		inline float4 operator*(const float4 & o) const { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] * o.v[i]; return r; }
+		inline float4 operator/(const float4 & o) const { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = v[i] / o.v[i]; return r; }
+	};
+
+	inline float4 sqrt(const float4 & a) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]); return r; }
+	inline float4 min(const float4 & a, const float4 & b) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::min(a.v[i], b.v[i]); return r; }
+	inline float4 max(const float4 & a, const float4 & b) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = std::max(a.v[i], b.v[i]); return r; }
+	inline float4 select_less(const float4 & a, const float4 & b, const float4 & if_less, const float4 & if_not_less) {
+		float4 r;
+		for (int i = 0; i < 4; ++i)
+			r.v[i] = a.v[i] < b.v[i] ? if_less.v[i] : if_not_less.v[i];
+		return r;
+	}
+#endif /* N REFERENCE_PHYSICS_SSE */
+
+	struct vec3x4 {
+		float4 x, y, z;
+
+		inline vec3x4() {}
+		inline vec3x4(const float4 & x, const float4 & y, const float4 & z) : x(x), y(y), z(z) {}
+
+		static inline vec3x4 load(const std::vector<real_type> & x, const std::vector<real_type> & y, const std::vector<real_type> & z, size_t i) {
+			return vec3x4(float4::load(&x[i]), float4::load(&y[i]), float4::load(&z[i]));
+		}
+
+		inline void store(std::vector<real_type> & x, std::vector<real_type> & y, std::vector<real_type> & z, size_t i) const {
+			this->x.store(&x[i]); this->y.store(&y[i]); this->z.store(&z[i]);
+		}
+
+		inline vec3x4 operator+(const vec3x4 & o) const { return vec3x4(x + o.x, y + o.y, z + o.z); }
+		inline vec3x4 operator-(const vec3x4 & o) const { return vec3x4(x - o.x, y - o.y, z - o.z); }
+		inline vec3x4 operator*(const float4 & f) const { return vec3x4(x * f, y * f, z * f); }
+		inline float4 dot(const vec3x4 & o) const { return x * o.x + y * o.y + z * o.z; }
+		inline vec3x4 cross(const vec3x4 & o) const { return vec3x4(y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x); }
+	};
+
+	// Rotates v by the unit quaternion (u, w), or by its inverse for w negated.
+	inline vec3x4 rotate(const vec3x4 & u, const float4 & w, const vec3x4 & v) {
+		const vec3x4 t(u.cross(v) * float4(2));
+		return v + t * w + u.cross(t);
+	}
+
+	// Multiplies by the symmetric matrix (xx, yy, zz, xy, xz, yz).
+	inline vec3x4 multiply_symmetric(const std::vector<real_type> (&m)[6], size_t i, const vec3x4 & v) {
+		const float4 xx(float4::load(&m[0][i])), yy(float4::load(&m[1][i])), zz(float4::load(&m[2][i])), xy(float4::load(&m[3][i])), xz(float4::load(&m[4][i])), yz(float4::load(&m[5][i]));
+		return vec3x4(xx * v.x + xy * v.y + xz * v.z, xy * v.x + yy * v.y + yz * v.z, xz * v.x + yz * v.y + zz * v.z);
+	}
+
+	inline size_t padded(size_t size) {
+		return (size + 3) & ~size_t(3);
+	}
+
+	inline void resize_all(std::initializer_list<std::vector<real_type> *> arrays, size_t size) {
+		for (std::vector<real_type> *array : arrays)
+			array->resize(size, real_type(0));
+	}
+}
+
+void mass_properties::add(real_type mass, const vec3 & inertia, const transform & pose) {
+	// Rotate the diagonal inertia into the body frame: I' = R I R^T.
+	const vec3 c[3] = { pose.q.rotate(vec3(1, 0, 0)), pose.q.rotate(vec3(0, 1, 0)), pose.q.rotate(vec3(0, 0, 1)) };
+	const int rows[6] = { 0, 1, 2, 0, 0, 1 }, columns[6] = { 0, 1, 2, 1, 2, 2 };
+	const real_type *p(&pose.p.x);
+
+	for (int k = 0; k < 6; ++k) {
+		const int i(rows[k]), j(columns[k]);
+		real_type value(0);
+		for (int axis = 0; axis < 3; ++axis)
+			value += (&c[axis].x)[i] * (&c[axis].x)[j] * (&inertia.x)[axis];
+
+		// Parallel axis theorem to the body origin.
+		value += mass * ((i == j ? pose.p.magnitudeSquared() : real_type(0)) - p[i] * p[j]);
+		this->inertia[k] += value;
+	}
+
+	this->mass += mass;
+	weighted_center += pose.p * mass;
+}
+
+void mass_properties::add(const sphere_geometry & geometry, const transform & pose, real_type density) {
+	const real_type r(geometry.radius), mass(density * real_type(4.0 / 3.0 * M_PI) * r * r * r), i(real_type(2.0 / 5.0) * mass * r * r);
+	add(mass, vec3(i, i, i), pose);
+}
+
+void mass_properties::add(const capsule_geometry & geometry, const transform & pose, real_type density) {
+	// A cylinder of height 2 * halfHeight along x with two hemispheres at its ends.
+	const real_type r(geometry.radius), h(geometry.halfHeight * 2);
+	const real_type cylinder(density * real_type(M_PI) * r * r * h), sphere(density * real_type(4.0 / 3.0 * M_PI) * r * r * r);
+	const real_type axial(cylinder * r * r / 2 + sphere * real_type(2.0 / 5.0) * r * r);
+	const real_type perpendicular(cylinder * (h * h / 12 + r * r / 4) + sphere * (real_type(2.0 / 5.0) * r * r + h * h / 4 + real_type(3.0 / 8.0) * h * r));
+	add(cylinder + sphere, vec3(axial, perpendicular, perpendicular), pose);
+}
+
+const physics::quaternion_type physics::quaternion_identity(0, 0, 0, 1);
+
+void physics::body_arrays::resize(size_t size) {
+	qw.resize(size, real_type(1)); // Keeps the rotations of the padding valid.
+	resize_all({ &px, &py, &pz, &qx, &qy, &qz, &vx, &vy, &vz, &wx, &wy, &wz, &fx, &fy, &fz, &tx, &ty, &tz,
+		&inverse_mass, &inertia[0], &inertia[1], &inertia[2], &inertia[3], &inertia[4], &inertia[5],
+		&inverse_inertia[0], &inverse_inertia[1], &inverse_inertia[2], &inverse_inertia[3], &inverse_inertia[4], &inverse_inertia[5],
+		&centerx, &centery, &centerz, &wake_counter }, size);
+}
+
+void physics::spring_arrays::resize(size_t size) {
+	body1.resize(size, kNoBody);
+	body2.resize(size, kNoBody);
+	resize_all({ &anchor1x, &anchor1y, &anchor1z, &anchor2x, &anchor2y, &anchor2z, &stiffness, &damping,
+		&forcex, &forcey, &forcez, &torque1x, &torque1y, &torque1z, &torque2x, &torque2y, &torque2z }, size);
+	for (int end = 0; end < 2; ++end) {
+		for (std::vector<real_type> & state : gathered[end])
+			state.resize(size, real_type(0));
+	}
+}
+
+physics::physics(const settings_type & settings) : body_count(1), spring_count(0), all_bodies_moved(false), max_spring_rate(0), spring_rate_changed(false), sleeping(false), woken(false), settings(settings) {
+	PRINT("Using the reference physics backend.");
+	bodies.resize(padded(body_count));
+	bodies.qw[0] = 1;
+	body_handles.resize(1);
+	body_springs.resize(1);
+	body_moved.resize(1);
+}
+
+physics::~physics() {}
+
+physics::sphere_geometry_type physics::create_sphere_geometry(real_type radius) {
+	return sphere_geometry_type(radius);
+}
+
+physics::capsule_geometry_type physics::create_x_axis_capsule(real_type radius, real_type half_height) {
+	return capsule_geometry_type(radius, half_height);
+}
+
+physics::rigid_body_type *physics::create_rigid_body(const transform_type & transform, const mass_properties & properties) {
+	assert(properties.mass > 0);
+
+	unsigned int index;
+	if (free_bodies.empty()) {
+		index = (unsigned int) body_count++;
+		bodies.resize(padded(body_count));
+		body_handles.resize(body_count);
+		body_springs.resize(body_count);
+		body_moved.resize(body_count);
+	} else {
+		index = free_bodies.back();
+		free_bodies.pop_back();
+	}
+
+	bodies.centerx[index] = bodies.centery[index] = bodies.centerz[index] = 0;
+	set_mass_properties(index, properties);
+	bodies.vx[index] = bodies.vy[index] = bodies.vz[index] = bodies.wx[index] = bodies.wy[index] = bodies.wz[index] = 0;
+
+	rigid_body_type & handle(body_handles[index]);
+	handle.owner = this;
+	handle.index = index;
+	handle.user_data = NULL;
+	set_world_transform(handle, transform);
+	return &handle;
+}
+
+void physics::set_mass_properties(unsigned int index, const mass_properties & properties) {
+	assert(properties.mass > 0);
+
+	const vec3 center(properties.weighted_center / properties.mass);
+	const real_type m(properties.mass);
+	// Inertia around the center of mass.
+	const real_type I[6] = {
+		properties.inertia[0] - m * (center.y * center.y + center.z * center.z), properties.inertia[1] - m * (center.x * center.x + center.z * center.z), properties.inertia[2] - m * (center.x * center.x + center.y * center.y),
+		properties.inertia[3] + m * center.x * center.y, properties.inertia[4] + m * center.x * center.z, properties.inertia[5] + m * center.y * center.z
+	};
+	// Inverse of the symmetric matrix by its cofactors.
+	const real_type c[6] = { I[1] * I[2] - I[5] * I[5], I[0] * I[2] - I[4] * I[4], I[0] * I[1] - I[3] * I[3], I[4] * I[5] - I[3] * I[2], I[3] * I[5] - I[4] * I[1], I[3] * I[4] - I[0] * I[5] };
+	const real_type determinant(I[0] * c[0] + I[3] * c[3] + I[4] * c[4]);
+	assert(determinant > 0);
+
+	std::array<real_type, 7> inverses;
+	for (int k = 0; k < 6; ++k) {
+		bodies.inertia[k][index] = I[k];
+		inverses[k] = c[k] / determinant;
+	}
+	inverses[6] = 1 / m;
+
+	std::unordered_map<unsigned int, std::array<real_type, 7> >::iterator kinematic(kinematic_inverses.find(index));
+	if (kinematic != kinematic_inverses.end())
+		kinematic->second = inverses;
+	else {
+		for (int k = 0; k < 6; ++k)
+			bodies.inverse_inertia[k][index] = inverses[k];
+		bodies.inverse_mass[index] = inverses[6];
+	}
+
+	// The origin stays in place, so the center of mass moves with the change of the center in the body frame and the spring anchors the other way.
+	const vec3 shift(center - vec3(bodies.centerx[index], bodies.centery[index], bodies.centerz[index]));
+	const vec3 world_shift(quaternion_type(bodies.qx[index], bodies.qy[index], bodies.qz[index], bodies.qw[index]).rotate(shift));
+	bodies.px[index] += world_shift.x;
+	bodies.py[index] += world_shift.y;
+	bodies.pz[index] += world_shift.z;
+	bodies.centerx[index] = center.x;
+	bodies.centery[index] = center.y;
+	bodies.centerz[index] = center.z;
+
+	for (unsigned int s : body_springs[index]) {
+		if (springs.body1[s] == index) {
+			springs.anchor1x[s] -= shift.x; springs.anchor1y[s] -= shift.y; springs.anchor1z[s] -= shift.z;
+		} else {
+			springs.anchor2x[s] -= shift.x; springs.anchor2y[s] -= shift.y; springs.anchor2z[s] -= shift.z;
+		}
+	}
+
+	spring_rate_changed = true;
+	mark_moved(index);
+	wake_up();
+}
+
+physics::spring_joint_type *physics::create_spring_joint(rigid_body_type *rigid_body1, const transform_type & transform1, rigid_body_type *rigid_body2, const transform_type & transform2, real_type stiffness, real_type damping) {
+	unsigned int index;
+	if (free_springs.empty()) {
+		index = (unsigned int) spring_count++;
+		springs.resize(padded(spring_count));
+		spring_handles.resize(spring_count);
+	} else {
+		index = free_springs.back();
+		free_springs.pop_back();
+	}
+
+	const unsigned int body[2] = { rigid_body1 ? rigid_body1->index : kNoBody, rigid_body2 ? rigid_body2->index : kNoBody };
+	const transform_type *frame[2] = { &transform1, &transform2 };
+	std::vector<real_type> *anchor[2][3] = { { &springs.anchor1x, &springs.anchor1y, &springs.anchor1z }, { &springs.anchor2x, &springs.anchor2y, &springs.anchor2z } };
+
+	for (int i = 0; i < 2; ++i) {
+		const unsigned int b(body[i]);
+		const vec3 local(frame[i]->p - vec3(bodies.centerx[b], bodies.centery[b], bodies.centerz[b]));
+		(*anchor[i][0])[index] = local.x;
+		(*anchor[i][1])[index] = local.y;
+		(*anchor[i][2])[index] = local.z;
+
+		if (b != kNoBody)
+			body_springs[b].push_back(index);
+	}
+
+	springs.body1[index] = body[0];
+	springs.body2[index] = body[1];
+	springs.stiffness[index] = stiffness;
+	springs.damping[index] = damping;
+	max_spring_rate = std::max(max_spring_rate, spring_rate(index));
+
+	spring_joint_type & handle(spring_handles[index]);
+	handle.owner = this;
+	handle.index = index;
+	wake_up();
+	return &handle;
+}
+
+void physics::set_spring_frame(spring_joint_type *joint, const rigid_body_type *rigid_body, const transform_type & frame) {
+	const unsigned int s(joint->index), b(rigid_body ? rigid_body->index : kNoBody);
+	assert(springs.body1[s] == b || springs.body2[s] == b);
+
+	const vec3 local(frame.p - vec3(bodies.centerx[b], bodies.centery[b], bodies.centerz[b]));
+	if (springs.body1[s] == b) {
+		springs.anchor1x[s] = local.x; springs.anchor1y[s] = local.y; springs.anchor1z[s] = local.z;
+	} else {
+		springs.anchor2x[s] = local.x; springs.anchor2y[s] = local.y; springs.anchor2z[s] = local.z;
+	}
+
+	spring_rate_changed = true;
+	wake_up();
+}
+
+void physics::release_spring(unsigned int spring) {
+	for (unsigned int b : { springs.body1[spring], springs.body2[spring] }) {
+		if (b != kNoBody) {
+			std::vector<unsigned int> & attached(body_springs[b]);
+			attached.erase(std::remove(attached.begin(), attached.end(), spring), attached.end());
+		}
+	}
+
+	springs.body1[spring] = springs.body2[spring] = kNoBody;
+	springs.stiffness[spring] = springs.damping[spring] = 0;
+	free_springs.push_back(spring);
+	spring_rate_changed = true;
+}
+
+void physics::destroy_spring_joint(spring_joint_type *joint) {
+	release_spring(joint->index);
+	wake_up();
+}
+
+void physics::destroy_rigid_body(rigid_body_type *rigid_body) {
+	const unsigned int index(rigid_body->index);
+	while (!body_springs[index].empty())
+		release_spring(body_springs[index].back());
+
+	bodies.inverse_mass[index] = 0;
+	for (int k = 0; k < 6; ++k)
+		bodies.inverse_inertia[k][index] = 0;
+	bodies.vx[index] = bodies.vy[index] = bodies.vz[index] = bodies.wx[index] = bodies.wy[index] = bodies.wz[index] = 0;
+	body_moved[index] = 0;
+	kinematic_inverses.erase(index);
+	free_bodies.push_back(index);
+	wake_up();
+}
+
+physics::transform_type physics::world_transform(const rigid_body_type & rigid_body) {
+	const body_arrays & bodies(rigid_body.owner->bodies);
+	const unsigned int i(rigid_body.index);
+	const quaternion_type q(bodies.qx[i], bodies.qy[i], bodies.qz[i], bodies.qw[i]);
+	return transform_type(vec3_type(bodies.px[i], bodies.py[i], bodies.pz[i]) - q.rotate(vec3_type(bodies.centerx[i], bodies.centery[i], bodies.centerz[i])), q);
+}
+
+void physics::set_world_transform(rigid_body_type & rigid_body, const transform_type & transform) {
+	body_arrays & bodies(rigid_body.owner->bodies);
+	const unsigned int i(rigid_body.index);
+	const vec3_type center(transform.transform_point(vec3_type(bodies.centerx[i], bodies.centery[i], bodies.centerz[i])));
+	bodies.px[i] = center.x;
+	bodies.py[i] = center.y;
+	bodies.pz[i] = center.z;
+	bodies.qx[i] = transform.q.x;
+	bodies.qy[i] = transform.q.y;
+	bodies.qz[i] = transform.q.z;
+	bodies.qw[i] = transform.q.w;
+	rigid_body.owner->mark_moved(i);
+	rigid_body.owner->wake_up();
+}
+
+physics::vec3_type physics::linear_velocity(const rigid_body_type & rigid_body) {
+	const body_arrays & bodies(rigid_body.owner->bodies);
+	return vec3_type(bodies.vx[rigid_body.index], bodies.vy[rigid_body.index], bodies.vz[rigid_body.index]);
+}
+
+physics::vec3_type physics::angular_velocity(const rigid_body_type & rigid_body) {
+	const body_arrays & bodies(rigid_body.owner->bodies);
+	return vec3_type(bodies.wx[rigid_body.index], bodies.wy[rigid_body.index], bodies.wz[rigid_body.index]);
+}
+
+void physics::set_velocity(rigid_body_type & rigid_body, const vec3_type & linear, const vec3_type & angular) {
+	body_arrays & bodies(rigid_body.owner->bodies);
+	const unsigned int i(rigid_body.index);
+	if (rigid_body.owner->kinematic_inverses.count(i))
+		return;
+
+	bodies.vx[i] = linear.x;
+	bodies.vy[i] = linear.y;
+	bodies.vz[i] = linear.z;
+	bodies.wx[i] = angular.x;
+	bodies.wy[i] = angular.y;
+	bodies.wz[i] = angular.z;
+	rigid_body.owner->wake_up();
+}
+
+bool physics::is_sleeping(const rigid_body_type & rigid_body) {
+	return rigid_body.owner->sleeping;
+}
+
+void physics::set_kinematic(rigid_body_type & rigid_body, bool kinematic) {
+	physics & owner(*rigid_body.owner);
+	body_arrays & bodies(owner.bodies);
+	const unsigned int i(rigid_body.index);
+	std::unordered_map<unsigned int, std::array<real_type, 7> >::iterator it(owner.kinematic_inverses.find(i));
+
+	if (kinematic && it == owner.kinematic_inverses.end()) {
+		std::array<real_type, 7> & inverses(owner.kinematic_inverses[i]);
+		for (int k = 0; k < 6; ++k) {
+			inverses[k] = bodies.inverse_inertia[k][i];
+			bodies.inverse_inertia[k][i] = 0;
+		}
+		inverses[6] = bodies.inverse_mass[i];
+		bodies.inverse_mass[i] = 0;
+		bodies.vx[i] = bodies.vy[i] = bodies.vz[i] = bodies.wx[i] = bodies.wy[i] = bodies.wz[i] = 0;
+	} else if (!kinematic && it != owner.kinematic_inverses.end()) {
+		for (int k = 0; k < 6; ++k)
+			bodies.inverse_inertia[k][i] = it->second[k];
+		bodies.inverse_mass[i] = it->second[6];
+		owner.kinematic_inverses.erase(it);
+		owner.wake_up();
+	} else
+		return;
+
+	owner.spring_rate_changed = true;
+}
+
+physics::real_type physics::spring_length(const spring_joint_type & joint) {
+	const body_arrays & bodies(joint.owner->bodies);
+	const spring_arrays & springs(joint.owner->springs);
+	const unsigned int s(joint.index), b1(springs.body1[s]), b2(springs.body2[s]);
+	const vec3_type p1(vec3_type(bodies.px[b1], bodies.py[b1], bodies.pz[b1]) + quaternion_type(bodies.qx[b1], bodies.qy[b1], bodies.qz[b1], bodies.qw[b1]).rotate(vec3_type(springs.anchor1x[s], springs.anchor1y[s], springs.anchor1z[s])));
+	const vec3_type p2(vec3_type(bodies.px[b2], bodies.py[b2], bodies.pz[b2]) + quaternion_type(bodies.qx[b2], bodies.qy[b2], bodies.qz[b2], bodies.qw[b2]).rotate(vec3_type(springs.anchor2x[s], springs.anchor2y[s], springs.anchor2z[s])));
+	return (p2 - p1).magnitude();
+}
+
+physics::real_type physics::spring_rate(unsigned int spring) const {
+	real_type inverse_mass(0);
+	for (int end = 0; end < 2; ++end) {
+		const unsigned int b(end == 0 ? springs.body1[spring] : springs.body2[spring]);
+		const vec3_type anchor(end == 0 ? vec3_type(springs.anchor1x[spring], springs.anchor1y[spring], springs.anchor1z[spring]) : vec3_type(springs.anchor2x[spring], springs.anchor2y[spring], springs.anchor2z[spring]));
+		// The trace of the inverse inertia bounds its largest eigenvalue.
+		inverse_mass += bodies.inverse_mass[b] + anchor.magnitudeSquared() * (bodies.inverse_inertia[0][b] + bodies.inverse_inertia[1][b] + bodies.inverse_inertia[2][b]);
+	}
+	return std::sqrt(springs.stiffness[spring] * inverse_mass) + springs.damping[spring] * inverse_mass;
+}
+
+void physics::collect_moved_bodies(std::vector<rigid_body_type *> & moved) {
+	moved.clear();
+
+	if (all_bodies_moved) {
+		// Released and kinematic bodies have zero inverse mass and were not moved.
+		for (unsigned int b = 1; b < body_count; ++b) {
+			if (bodies.inverse_mass[b] > 0)
+				moved.push_back(&body_handles[b]);
+		}
+		std::fill(body_moved.begin(), body_moved.end(), 0);
+		all_bodies_moved = false;
+	} else {
+		for (unsigned int b : moved_bodies) {
+			if (body_moved[b]) {
+				moved.push_back(&body_handles[b]);
+				body_moved[b] = 0;
+			}
+		}
+	}
+
+	moved_bodies.clear();
+}
+
+void physics::mark_moved(unsigned int body) {
+	if (!body_moved[body]) {
+		body_moved[body] = 1;
+		moved_bodies.push_back(body);
+	}
+}
+
+void physics::wake_up() {
+	sleeping = false;
+	woken = true;
+}
+
+void physics::step(real_type dt) {
+	if (sleeping)
+		return;
+
+	if (woken) {
+		// Reset once per step instead of for every body or spring created or changed, which is quadratic when a large mesh is set up.
+		std::fill(bodies.wake_counter.begin(), bodies.wake_counter.end(), kWakeCounterResetValue);
+		woken = false;
+	}
+
+	if (spring_rate_changed) {
+		// Released springs may have been the stiffest ones, and changed masses or anchors change the rates.
+		max_spring_rate = 0;
+		for (unsigned int s = 0; s < spring_count; ++s)
+			max_spring_rate = std::max(max_spring_rate, spring_rate(s));
+		spring_rate_changed = false;
+	}
+
+	// Semi-implicit Euler is stable for substeps shorter than 1 / (sqrt(k / m) + c / m).
+	const unsigned int substeps(std::min(kMaxSubsteps, std::max(1u, (unsigned int) std::ceil(dt * max_spring_rate))));
+	for (unsigned int i = 0; i < substeps; ++i)
+		substep(dt / substeps);
+	all_bodies_moved = true;
+
+	// The island sleeps when every body has rested for the wake counter time.
+	sleeping = body_count == 1 || *std::max_element(bodies.wake_counter.begin() + 1, bodies.wake_counter.begin() + body_count) <= 0;
+
+	if (sleeping) {
+		for (std::vector<real_type> *velocity : { &bodies.vx, &bodies.vy, &bodies.vz, &bodies.wx, &bodies.wy, &bodies.wz })
+			std::fill(velocity->begin(), velocity->end(), real_type(0));
+	}
+}
+
+void physics::substep(real_type dt) {
+	const size_t spring_size(padded(spring_count)), body_size(padded(body_count));
+
+	// Gather the state of the bodies at both ends of every spring into spring order.
+	for (int end = 0; end < 2; ++end) {
+		const std::vector<unsigned int> & body(end == 0 ? springs.body1 : springs.body2);
+		const std::vector<real_type> *source[13] = { &bodies.px, &bodies.py, &bodies.pz, &bodies.qx, &bodies.qy, &bodies.qz, &bodies.qw, &bodies.vx, &bodies.vy, &bodies.vz, &bodies.wx, &bodies.wy, &bodies.wz };
+		for (int k = 0; k < 13; ++k) {
+			const std::vector<real_type> & from(*source[k]);
+			std::vector<real_type> & to(springs.gathered[end][k]);
+			for (size_t s = 0; s < spring_size; ++s)
+				to[s] = from[body[s]];
+		}
+	}
+
+	// Spring forces, four springs at a time. The spring force k * d and the damping along d act on the anchors.
+	for (size_t s = 0; s < spring_size; s += 4) {
+		vec3x4 position[2], velocity[2], arm[2];
+		for (int end = 0; end < 2; ++end) {
+			const std::vector<real_type> (&g)[13] = springs.gathered[end];
+			const vec3x4 anchor(end == 0 ? vec3x4::load(springs.anchor1x, springs.anchor1y, springs.anchor1z, s) : vec3x4::load(springs.anchor2x, springs.anchor2y, springs.anchor2z, s));
+			arm[end] = rotate(vec3x4::load(g[3], g[4], g[5], s), float4::load(&g[6][s]), anchor);
+			position[end] = vec3x4::load(g[0], g[1], g[2], s) + arm[end];
+			velocity[end] = vec3x4::load(g[7], g[8], g[9], s) + vec3x4::load(g[10], g[11], g[12], s).cross(arm[end]);
+		}
+
+		const vec3x4 delta(position[1] - position[0]);
+		const float4 length_squared(delta.dot(delta));
+		// Damping only along a well defined direction.
+		const float4 inverse_length_squared(select_less(length_squared, float4(real_type(1e-12)), float4(0), float4(1) / max(length_squared, float4(real_type(1e-12)))));
+		const float4 damping_factor(float4::load(&springs.damping[s]) * (velocity[1] - velocity[0]).dot(delta) * inverse_length_squared);
+		const vec3x4 force(delta * (float4::load(&springs.stiffness[s]) + damping_factor)); // On the first body, the second gets the opposite.
+
+		force.store(springs.forcex, springs.forcey, springs.forcez, s);
+		arm[0].cross(force).store(springs.torque1x, springs.torque1y, springs.torque1z, s);
+		arm[1].cross(force).store(springs.torque2x, springs.torque2y, springs.torque2z, s);
+	}
+
+	// Scatter the forces to the bodies. The world accumulates forces too but never moves.
+	for (std::vector<real_type> *accumulator : { &bodies.fx, &bodies.fy, &bodies.fz, &bodies.tx, &bodies.ty, &bodies.tz })
+		std::fill(accumulator->begin(), accumulator->end(), real_type(0));
+	for (size_t s = 0; s < spring_count; ++s) {
+		const unsigned int b1(springs.body1[s]), b2(springs.body2[s]);
+		bodies.fx[b1] += springs.forcex[s]; bodies.fy[b1] += springs.forcey[s]; bodies.fz[b1] += springs.forcez[s];
+		bodies.fx[b2] -= springs.forcex[s]; bodies.fy[b2] -= springs.forcey[s]; bodies.fz[b2] -= springs.forcez[s];
+		bodies.tx[b1] += springs.torque1x[s]; bodies.ty[b1] += springs.torque1y[s]; bodies.tz[b1] += springs.torque1z[s];
+		bodies.tx[b2] -= springs.torque2x[s]; bodies.ty[b2] -= springs.torque2y[s]; bodies.tz[b2] -= springs.torque2z[s];
+	}
+
+	// Integrate four bodies at a time and update their wake counters.
+	const float4 h(dt), half_h(dt / 2), angular_damping(std::max(real_type(0), 1 - kAngularDamping * dt)), threshold(settings.kRigidBodySleepThreshold);
+	for (size_t b = 0; b < body_size; b += 4) {
+		const vec3x4 u(vec3x4::load(bodies.qx, bodies.qy, bodies.qz, b));
+		const float4 w(float4::load(&bodies.qw[b])), inverse_mass(float4::load(&bodies.inverse_mass[b]));
+
+		const vec3x4 v(vec3x4::load(bodies.vx, bodies.vy, bodies.vz, b) + vec3x4::load(bodies.fx, bodies.fy, bodies.fz, b) * (inverse_mass * h));
+
+		// Angular acceleration from the torque in the body frame: R I^-1 R^T t.
+		const vec3x4 torque(rotate(u, float4(0) - w, vec3x4::load(bodies.tx, bodies.ty, bodies.tz, b)));
+		vec3x4 omega(vec3x4::load(bodies.wx, bodies.wy, bodies.wz, b) + rotate(u, w, multiply_symmetric(bodies.inverse_inertia, b, torque)) * h);
+		omega = omega * angular_damping;
+		const float4 omega_squared(omega.dot(omega));
+		omega = omega * min(float4(1), float4(kMaxAngularVelocity) / sqrt(max(omega_squared, float4(kMaxAngularVelocity * kMaxAngularVelocity))));
+
+		const vec3x4 p(vec3x4::load(bodies.px, bodies.py, bodies.pz, b) + v * h);
+
+		// q += h / 2 * (omega, 0) * q, then normalized.
+		vec3x4 un(u + (omega * w + omega.cross(u)) * half_h);
+		float4 wn(w - omega.dot(u) * half_h);
+		const float4 inverse_norm(float4(1) / sqrt(un.dot(un) + wn * wn));
+		un = un * inverse_norm;
+		wn = wn * inverse_norm;
+
+		// Mass normalized kinetic energy, as used by PhysX for the sleep threshold.
+		const vec3x4 omega_body(rotate(un, float4(0) - wn, omega));
+		const float4 energy((v.dot(v) + omega_body.dot(multiply_symmetric(bodies.inertia, b, omega_body)) * inverse_mass) * float4(real_type(0.5)));
+		const float4 counter(float4::load(&bodies.wake_counter[b]));
+
+		v.store(bodies.vx, bodies.vy, bodies.vz, b);
+		omega.store(bodies.wx, bodies.wy, bodies.wz, b);
+		p.store(bodies.px, bodies.py, bodies.pz, b);
+		un.store(bodies.qx, bodies.qy, bodies.qz, b);
+		wn.store(&bodies.qw[b]);
+		select_less(energy, threshold, counter - h, float4(kWakeCounterResetValue)).store(&bodies.wake_counter[b]);
+	}
+}
+
+#endif /* REFERENCE_PHYSICS */
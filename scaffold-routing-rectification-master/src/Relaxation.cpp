@@ -0,0 +1,60 @@
+#include <Definition.h>
+#include <Relaxation.h>
+
+#include <chrono>
+#include <stdexcept>
+
+parallel_evaluator::parallel_evaluator(const settings_type & settings, const relaxation_settings & relaxation, scene & mesh, physics & phys, const physics::settings_type & physics_settings, const scene::settings_type & scene_settings, const Helix::settings_type & helix_settings, const std::string & input_file) : relaxation(relaxation), local_hops(settings.local_hops) {
+	const unsigned int count(std::max(1u, std::min(settings.workers, (unsigned int) mesh.getHelixCount() * 2)));
+	workers.resize(count);
+	workers[0].mesh = &mesh;
+	workers[0].phys = &phys;
+
+	for (unsigned int i = 1; i < count; ++i) {
+		worker & w(workers[i]);
+		owned_physics.push_back(std::unique_ptr<physics>(new physics(physics_settings)));
+		owned_meshes.push_back(std::unique_ptr<scene>(new scene(scene_settings, helix_settings)));
+		w.phys = owned_physics.back().get();
+		w.mesh = owned_meshes.back().get();
+
+		if (!w.mesh->read(*w.phys, input_file) || w.mesh->getHelixCount() != mesh.getHelixCount())
+			throw std::runtime_error("Failed to read the scene for a worker");
+	}
+
+	pool.reset(new worker_pool(count - 1));
+}
+
+void parallel_evaluator::evaluate(worker & w, const relaxation_settings & relaxation, unsigned int local_hops, const scene::State & start, const candidate & c, result & r, const std::function<bool()> & running_functor) {
+	const std::chrono::steady_clock::time_point begin(std::chrono::steady_clock::now());
+	w.mesh->restoreState(*w.phys, start);
+
+	Helix & helix(w.mesh->getHelices()[c.helix]);
+	helix.setBaseCount(*w.phys, c.bases, helix.getTransform());
+
+	// The separations of the kinematic helices are still cached from the start state.
+	if (local_hops > 0)
+		w.mesh->setPatch(c.helix, local_hops);
+	r.completed = relax(*w.mesh, *w.phys, relaxation, running_functor, r.steps);
+	w.mesh->clearPatch();
+	w.mesh->getTotalSeparationMinMaxAverage(r.min, r.max, r.average, r.total);
+	r.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void parallel_evaluator::evaluate(const scene::State & start, const std::vector<candidate> & candidates, std::vector<result> & results, const std::function<bool()> & running_functor) {
+	assert(candidates.size() <= workers.size());
+	results.resize(candidates.size());
+
+	// The calling thread evaluates the first candidate.
+	pool->run(candidates.size(), [this, &start, &candidates, &results, &running_functor](size_t i) { evaluate(workers[i], relaxation, local_hops, start, candidates[i], results[i], running_functor); });
+}
+
+bool parallel_evaluator::revalidate(unsigned int index, result & r, const std::function<bool()> & running_functor) {
+	const std::chrono::steady_clock::time_point begin(std::chrono::steady_clock::now());
+	worker & w(workers[index]);
+	uint64_t steps;
+	r.completed = relax(*w.mesh, *w.phys, relaxation, running_functor, steps);
+	w.mesh->getTotalSeparationMinMaxAverage(r.min, r.max, r.average, r.total);
+	r.steps += steps;
+	r.wall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	return r.completed;
+}
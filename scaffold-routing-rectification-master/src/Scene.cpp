@@ -5,38 +5,346 @@
 
 #include <array>
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <string>
 #include <cstdio>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <iterator>
 #include <algorithm>
 
-bool scene::read_rmesh(physics & phys, std::istream & ifile) {
+namespace {
+	// Record parsing without sscanf. std::from_chars is not available with the Visual Studio 2013 toolset, so numbers are parsed by hand.
+
+	inline bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool is_digit(char c) {
+		return c >= '0' && c <= '9';
+	}
+
+	inline void skip_spaces(const char *& it, const char *end) {
+		while (it != end && is_space(*it))
+			++it;
+	}
+
+	inline void skip_line(const char *& it, const char *end) {
+		while (it != end && *it++ != '\n') {}
+	}
+
+	bool parse_unsigned(const char *& it, const char *end, unsigned int & value) {
+		skip_spaces(it, end);
+		if (it == end || !is_digit(*it))
+			return false;
+
+		uint64_t result(0);
+		for (; it != end && is_digit(*it); ++it) {
+			result = result * 10 + unsigned(*it - '0');
+			if (result > std::numeric_limits<unsigned int>::max())
+				return false;
+		}
+
+		value = (unsigned int) result;
+		return true;
+	}
+
+	// Decimal with optional sign, fraction and exponent. Up to 19 significant digits are kept, which is exact for the doubles the result is scaled in.
+	bool parse_real(const char *& it, const char *end, physics::real_type & value) {
+		static const double kPowersOf10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+		skip_spaces(it, end);
+		const bool negative(it != end && *it == '-');
+		if (it != end && (*it == '-' || *it == '+'))
+			++it;
+
+		uint64_t mantissa(0);
+		int exponent(0), digits(0);
+		for (; it != end && is_digit(*it); ++it, ++digits) {
+			if (mantissa < 1000000000000000000ull)
+				mantissa = mantissa * 10 + unsigned(*it - '0');
+			else
+				++exponent;
+		}
+		if (it != end && *it == '.') {
+			for (++it; it != end && is_digit(*it); ++it, ++digits) {
+				if (mantissa < 1000000000000000000ull) {
+					mantissa = mantissa * 10 + unsigned(*it - '0');
+					--exponent;
+				}
+			}
+		}
+		if (digits == 0)
+			return false;
+
+		if (it != end && (*it == 'e' || *it == 'E')) {
+			++it;
+			const bool negative_exponent(it != end && *it == '-');
+			if (it != end && (*it == '-' || *it == '+'))
+				++it;
+			if (it == end || !is_digit(*it))
+				return false;
+
+			int e(0);
+			for (; it != end && is_digit(*it); ++it)
+				e = std::min(e * 10 + (*it - '0'), 10000);
+			exponent += negative_exponent ? -e : e;
+		}
+
+		double result((double) mantissa);
+		if (exponent < 0)
+			result = -exponent < 23 ? result / kPowersOf10[-exponent] : result * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			result = exponent < 23 ? result * kPowersOf10[exponent] : result * std::pow(10.0, exponent);
+
+		value = physics::real_type(negative ? -result : result);
+		return true;
+	}
+
+	// True if the line at it is the record with the given one letter tag, followed by whitespace. Moves it past the tag.
+	inline bool is_record(const char *& it, const char *end, char tag) {
+		if (*it != tag || (it + 1 != end && !is_space(it[1]) && it[1] != '\n'))
+			return false;
+
+		++it;
+		return true;
+	}
+
+	// The binary formats written by the graph tools: a 32 byte header followed by native 32 bit records. A trail (.btrail, .bntrail) has count edge
+	// or node indices, an edge code (.becode) num_nodes + 1 offsets followed by the count edge indices around the vertices. The layout and the
+	// kinds are those of binary_header in boost_graph_helper.hpp of the tools, which is not part of this project.
+	const uint32_t kBinaryVersion = 1, kBinaryEdgeCodeKind = 1, kBinaryTrailKind = 2, kBinaryByteOrder = 0x01020304;
+
+	struct binary_header {
+		char magic[4]; // "BSCB"
+		uint32_t version, kind, byte_order;
+		uint64_t num_nodes, count;
+	};
+	static_assert(sizeof(binary_header) == 32, "The binary header is 32 bytes");
+
+	inline bool is_binary(const char *it, const char *end) {
+		return end - it >= (ptrdiff_t) sizeof(binary_header) && memcmp(it, "BSCB", 4) == 0;
+	}
+
+	// Reads the header of a binary file of the given kind and checks that at least words 32 bit records, given by the header, follow it.
+	// The records are 32 bit, larger counts can only come from a corrupt header and would overflow the sum in words, so they are rejected first.
+	bool read_binary_header(const char *it, const char *end, uint32_t kind, uint64_t (*words)(const binary_header &), binary_header & header) {
+		memcpy(&header, it, sizeof(header));
+		return header.version == kBinaryVersion && header.kind == kind && header.byte_order == kBinaryByteOrder
+			&& header.num_nodes <= std::numeric_limits<uint32_t>::max() && header.count <= std::numeric_limits<uint32_t>::max()
+			&& uint64_t(end - it - sizeof(header)) / sizeof(uint32_t) >= words(header);
+	}
+
+	inline void read_binary_words(const char *it, size_t count, unsigned int *words) {
+		if (count > 0)
+			memcpy(words, it, count * sizeof(uint32_t));
+	}
+
+	// A trail of node or edge indices, text or binary. Returns NULL or the reason it could not be read.
+	const char *parse_trail(const char *it, const char *end, std::vector<unsigned int> & trail) {
+		if (is_binary(it, end)) {
+			binary_header header;
+			if (!read_binary_header(it, end, kBinaryTrailKind, [](const binary_header & header) { return header.count; }, header))
+				return "Unsupported or truncated binary trail";
+
+			trail.resize((size_t) header.count);
+			read_binary_words(it + sizeof(header), trail.size(), trail.data());
+			return NULL;
+		}
+
+		unsigned int index;
+		for (;;) {
+			while (it != end && (is_space(*it) || *it == '\n'))
+				++it;
+			if (it == end)
+				return NULL;
+			if (!parse_unsigned(it, end, index))
+				return "Malformed trail";
+			trail.push_back(index);
+		}
+	}
+
+	// An edge code: the edge indices around every vertex in the order of the embedding, as offsets into the concatenated rotations of all vertices.
+	// The text form is a "p <vertices>" line followed by a line per vertex. Returns NULL or the reason it could not be read.
+	const char *parse_edge_code(const char *it, const char *end, std::vector<unsigned int> & offsets, std::vector<unsigned int> & rotations) {
+		if (is_binary(it, end)) {
+			binary_header header;
+			if (!read_binary_header(it, end, kBinaryEdgeCodeKind, [](const binary_header & header) { return header.num_nodes + 1 + header.count; }, header))
+				return "Unsupported or truncated binary edge code";
+
+			offsets.resize((size_t) header.num_nodes + 1);
+			rotations.resize((size_t) header.count);
+			read_binary_words(it + sizeof(header), offsets.size(), offsets.data());
+			read_binary_words(it + sizeof(header) + offsets.size() * sizeof(uint32_t), rotations.size(), rotations.data());
+			for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+				if (offsets[i] > offsets[i + 1])
+					return "Malformed binary edge code";
+			}
+			return offsets.front() == 0 && offsets.back() == rotations.size() ? NULL : "Malformed binary edge code";
+		}
+
+		unsigned int count;
+		skip_spaces(it, end);
+		if (it == end || !is_record(it, end, 'p') || !parse_unsigned(it, end, count))
+			return "Malformed edge code header";
+		skip_line(it, end);
+
+		offsets.assign(1, 0);
+		for (unsigned int vertex = 0; vertex < count; ++vertex, skip_line(it, end)) {
+			if (it == end)
+				return "The edge code ends before all its vertices";
+
+			for (unsigned int edge;;) {
+				skip_spaces(it, end);
+				if (it == end || *it == '\n')
+					break;
+				if (!parse_unsigned(it, end, edge))
+					return "Malformed edge code";
+				rotations.push_back(edge);
+			}
+			offsets.push_back((unsigned int) rotations.size());
+		}
+		return NULL;
+	}
+
+	// PLY header, see http://paulbourke.net/dataformats/ply/
+	struct ply_property {
+		std::string name;
+		unsigned int size, count_size; // In bytes, count_size is 0 unless it is a list.
+		bool is_float;
+	};
+
+	struct ply_element {
+		std::string name;
+		unsigned int count;
+		std::vector<ply_property> properties;
+	};
+
+	enum ply_format {
+		kPlyAscii,
+		kPlyBinaryLittleEndian,
+		kPlyBinaryBigEndian
+	};
+
+	// Size in bytes of a PLY scalar type, 0 if unknown.
+	unsigned int ply_type_size(const std::string & type, bool & is_float) {
+		is_float = type == "float" || type == "float32" || type == "double" || type == "float64";
+		if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+			return 1;
+		if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+			return 2;
+		if (type == "int" || type == "uint" || type == "int32" || type == "uint32" || type == "float" || type == "float32")
+			return 4;
+		if (type == "double" || type == "float64")
+			return 8;
+		return 0;
+	}
+
+	bool is_little_endian() {
+		const uint16_t value(1);
+		return *reinterpret_cast<const unsigned char *>(&value) == 1;
+	}
+
+	// Reads a binary scalar at it. Signedness is ignored, which is exact for the coordinates and counts read here.
+	double read_ply_binary(const char *it, unsigned int size, bool is_float, bool swap) {
+		unsigned char bytes[8];
+		for (unsigned int i = 0; i < size; ++i)
+			bytes[i] = (unsigned char) it[swap ? size - 1 - i : i];
+
+		switch (size) {
+		case 1:
+			return double(bytes[0]);
+		case 2: {
+			uint16_t value;
+			memcpy(&value, bytes, 2);
+			return double(value);
+		}
+		case 4:
+			if (is_float) {
+				float value;
+				memcpy(&value, bytes, 4);
+				return double(value);
+			} else {
+				uint32_t value;
+				memcpy(&value, bytes, 4);
+				return double(value);
+			}
+		default: {
+			double value;
+			memcpy(&value, bytes, 8);
+			return value;
+		}
+		}
+	}
+}
+
+bool scene::read(physics & phys, const std::string & filename) {
+	mapped_file file;
+	if (ends_with(filename, ".ply") || ends_with(filename, ".ntrail") || ends_with(filename, ".bntrail")) {
+		// The trail of a .ply file is read from the .ntrail file next to it, or from the .bntrail file if there is none.
+		const bool is_ply(ends_with(filename, ".ply"));
+		const std::string base(is_ply ? strip_trailing_string(filename, ".ply") : strip_trailing_string(strip_trailing_string(filename, ".bntrail"), ".ntrail"));
+		mapped_file trail_file, ecode_file, edge_trail_file;
+		if (!file.open(is_ply ? filename : base + ".ply") || !(is_ply ? trail_file.open(base + ".ntrail") || trail_file.open(base + ".bntrail") : trail_file.open(filename)))
+			return false;
+
+		// The edge code is only of use together with the edge trail, which tells the parallel edges apart.
+		if ((ecode_file.open(base + ".ecode") || ecode_file.open(base + ".becode")) && !(edge_trail_file.open(base + ".trail") || edge_trail_file.open(base + ".btrail")))
+			ecode_file.close();
+
+		return read_ply(phys, file.data(), file.end(), trail_file.data(), trail_file.end(), ecode_file.data(), ecode_file.end(), edge_trail_file.data(), edge_trail_file.end());
+	}
+
+	return file.open(filename) && read_rmesh(phys, file.data(), file.end());
+}
+
+bool scene::read_rmesh(physics & phys, const char *it, const char *end) {
+	this->phys = &phys;
 	physics::vec3_type vertex, zDirection;
 	unsigned int edge, numBases;
-	unsigned int gcount(0);
-	std::string line;
-
-	while (ifile.good()) {
-		std::getline(ifile, line);
-
-		if (sscanf(line.c_str(), "e %u", &edge) == 1) {
-			assert(edge >= 1);
-			path.push_back(edge - 1);
-		} else if (sscanf(line.c_str(), "v %f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3) {
-			vertex *= settings.initial_scaling;
-			vertices.push_back(vertex);
-		} else if (sscanf(line.c_str(), "h %u %f %f %f %f %f %f", &numBases, &vertex.x, &vertex.y, &vertex.z, &zDirection.x, &zDirection.y, &zDirection.z) == 7) {
-			const physics::vec3_type cross(kPosZAxis.cross(zDirection));
-			helices.push_back(Helix(helix_settings, phys, numBases, physics::transform_type(vertex, physics::quaternion_type(signedAngle(kPosZAxis, zDirection, cross), cross.getNormalized()))));
-		} else if (line[0] == 'g')
+	unsigned int gcount(0), line(0);
+
+	for (; it != end; skip_line(it, end)) {
+		++line;
+		skip_spaces(it, end);
+		if (it == end)
+			break;
+
+		bool valid(true);
+		if (is_record(it, end, 'e')) {
+			valid = parse_unsigned(it, end, edge) && edge >= 1;
+			if (valid)
+				path.push_back(edge - 1);
+		} else if (is_record(it, end, 'v')) {
+			valid = parse_real(it, end, vertex.x) && parse_real(it, end, vertex.y) && parse_real(it, end, vertex.z);
+			if (valid) {
+				vertex *= settings.initial_scaling;
+				vertices.push_back(vertex);
+			}
+		} else if (is_record(it, end, 'h')) {
+			valid = parse_unsigned(it, end, numBases) && parse_real(it, end, vertex.x) && parse_real(it, end, vertex.y) && parse_real(it, end, vertex.z)
+				&& parse_real(it, end, zDirection.x) && parse_real(it, end, zDirection.y) && parse_real(it, end, zDirection.z);
+			if (valid) {
+				const physics::vec3_type cross(kPosZAxis.cross(zDirection));
+				helices.push_back(Helix(helix_settings, phys, numBases, physics::transform_type(vertex, physics::quaternion_type(signedAngle(kPosZAxis, zDirection, cross), cross.getNormalized()))));
+			}
+		} else if (*it == 'g')
 			++gcount;
+
+		if (!valid) {
+			PRINT("CRITICAL: Malformed record on line %u. Aborting.", line);
+			return false;
+		}
 	}
 
 	if (gcount > 1) {
@@ -55,145 +363,358 @@ bool scene::read_rmesh(physics & phys, std::istream & ifile) {
 	return helices.empty() ? setupHelices(phys) : true;
 }
 
-bool scene::read_ply(physics & phys, std::istream & ply_file, std::istream & ntrail_file) {
-	std::string line;
-	unsigned int count(0), num_vertices(0);
-	bool has_vertex_header(false);
-	unsigned int pre_vertices_rows(0);
-	physics::vec3_type vertex;
-
-	while (ply_file.good()) {
-		std::getline(ply_file, line);
-
-		if (sscanf(line.c_str(), "element vertex %u", &num_vertices) == 1) {
-			vertices.reserve(num_vertices);
-			has_vertex_header = true;
-		} else if (sscanf(line.c_str(), "element %*s %u", &count) == 1) {
-			if (!has_vertex_header)
-				pre_vertices_rows += count;
-		} else if (line.compare(0, strlen("end_header"), "end_header") == 0) {
-			for (unsigned int i = 0; i < pre_vertices_rows; ++i)
-				std::getline(ply_file, line);
-		} else if (sscanf(line.c_str(), "%f %f %f", &vertex.x, &vertex.y, &vertex.z) == 3 && vertices.size() < num_vertices) {
-			vertex *= settings.initial_scaling;
-			vertices.push_back(vertex);
+bool scene::read_ply(physics & phys, const char *ply_it, const char *ply_end, const char *ntrail_it, const char *ntrail_end, const char *ecode_it, const char *ecode_end, const char *trail_it, const char *trail_end) {
+	this->phys = &phys;
+
+	// The header is read line by line, the elements are then read in order up to the vertices.
+	std::vector<ply_element> elements;
+	ply_format format(kPlyAscii);
+	bool has_end_header(false);
+	while (ply_it != ply_end && !has_end_header) {
+		const char *line_end(std::find(ply_it, ply_end, '\n'));
+		std::istringstream line(std::string(ply_it, line_end));
+		ply_it = line_end == ply_end ? ply_end : line_end + 1;
+
+		std::string keyword;
+		line >> keyword;
+		if (keyword == "format") {
+			std::string name;
+			line >> name;
+			if (name == "binary_little_endian")
+				format = kPlyBinaryLittleEndian;
+			else if (name == "binary_big_endian")
+				format = kPlyBinaryBigEndian;
+			else if (name != "ascii") {
+				PRINT("CRITICAL: Unknown PLY format \"%s\". Aborting.", name.c_str());
+				return false;
+			}
+		} else if (keyword == "element") {
+			ply_element element;
+			if (!(line >> element.name >> element.count))
+				return false;
+			elements.push_back(element);
+		} else if (keyword == "property") {
+			ply_property property;
+			std::string type, count_type;
+			if (!(line >> type) || elements.empty())
+				return false;
+
+			bool is_float;
+			property.count_size = 0;
+			if (type == "list") {
+				if (!(line >> count_type >> type) || (property.count_size = ply_type_size(count_type, is_float)) == 0 || is_float)
+					return false;
+			}
+			if (!(line >> property.name) || (property.size = ply_type_size(type, property.is_float)) == 0)
+				return false;
+			elements.back().properties.push_back(property);
+		} else if (keyword == "end_header")
+			has_end_header = true;
+	}
+
+	std::vector<ply_element>::const_iterator vertex_element(elements.begin());
+	for (; vertex_element != elements.end() && vertex_element->name != "vertex"; ++vertex_element) {}
+	if (!has_end_header || vertex_element == elements.end()) {
+		PRINT("CRITICAL: The PLY file has no vertices. Aborting.");
+		return false;
+	}
+
+	// Indices of the coordinates among the properties of the vertices.
+	unsigned int coordinates[] = { UINT_MAX, UINT_MAX, UINT_MAX };
+	for (unsigned int i = 0; i < vertex_element->properties.size(); ++i) {
+		const std::string & name(vertex_element->properties[i].name);
+		if (name.size() == 1 && name[0] >= 'x' && name[0] <= 'z' && vertex_element->properties[i].count_size == 0)
+			coordinates[name[0] - 'x'] = i;
+	}
+	if (coordinates[0] == UINT_MAX || coordinates[1] == UINT_MAX || coordinates[2] == UINT_MAX) {
+		PRINT("CRITICAL: The PLY vertices have no x, y and z coordinates. Aborting.");
+		return false;
+	}
+
+	vertices.reserve(vertex_element->count);
+	std::vector<physics::real_type> values(vertex_element->properties.size());
+	if (format == kPlyAscii) {
+		for (std::vector<ply_element>::const_iterator element(elements.begin()); element != vertex_element; ++element) {
+			for (unsigned int i = 0; i < element->count; ++i)
+				skip_line(ply_it, ply_end);
+		}
+
+		for (unsigned int i = 0; i < vertex_element->count && ply_it != ply_end; skip_line(ply_it, ply_end), ++i) {
+			// Every property must be on the line, a short line would otherwise leave the coordinates of the previous vertex in values.
+			bool complete(true);
+			for (unsigned int j = 0; complete && j < values.size(); ++j) {
+				physics::real_type count;
+				complete = parse_real(ply_it, ply_end, vertex_element->properties[j].count_size == 0 ? values[j] : count);
+				for (unsigned int k = 0; complete && vertex_element->properties[j].count_size != 0 && k < (unsigned int) count; ++k)
+					complete = parse_real(ply_it, ply_end, values[j]);
+			}
+			if (!complete) {
+				PRINT("CRITICAL: Vertex %u of the PLY file has fewer than its %u properties. Aborting.", i, (unsigned int) values.size());
+				return false;
+			}
+
+			vertices.push_back(physics::vec3_type(values[coordinates[0]], values[coordinates[1]], values[coordinates[2]]) * settings.initial_scaling);
+		}
+	} else {
+		const bool swap(is_little_endian() != (format == kPlyBinaryLittleEndian));
+		// Every property is checked to fit before it is read, lists need their count first.
+		const auto read_element([&ply_it, &ply_end, &swap, &values](const ply_element & element, bool store) {
+			for (unsigned int j = 0; j < element.properties.size(); ++j) {
+				const ply_property & property(element.properties[j]);
+				uint64_t count(1);
+				if (property.count_size != 0) {
+					if (unsigned(ply_end - ply_it) < property.count_size)
+						return false;
+					count = uint64_t(read_ply_binary(ply_it, property.count_size, false, swap));
+					ply_it += property.count_size;
+				}
+				if (uint64_t(ply_end - ply_it) < count * property.size)
+					return false;
+				if (store && property.count_size == 0)
+					values[j] = physics::real_type(read_ply_binary(ply_it, property.size, property.is_float, swap));
+				ply_it += count * property.size;
+			}
+			return true;
+		});
+
+		for (std::vector<ply_element>::const_iterator element(elements.begin()); element != vertex_element; ++element) {
+			for (unsigned int i = 0; i < element->count; ++i) {
+				if (!read_element(*element, false))
+					break;
+			}
 		}
+
+		for (unsigned int i = 0; i < vertex_element->count && read_element(*vertex_element, true); ++i)
+			vertices.push_back(physics::vec3_type(values[coordinates[0]], values[coordinates[1]], values[coordinates[2]]) * settings.initial_scaling);
+	}
+
+	if (vertices.size() != vertex_element->count) {
+		PRINT("CRITICAL: The PLY file ends after %u of %u vertices. Aborting.", (unsigned int) vertices.size(), vertex_element->count);
+		return false;
+	}
+
+	// Binary trails start with the magic "BSCB", text trails are whitespace separated node indices.
+	if (const char *error = parse_trail(ntrail_it, ntrail_end, path)) {
+		PRINT("CRITICAL: %s. Aborting.", error);
+		return false;
+	}
+
+	if (path.size() < 2 || std::find_if(path.begin(), path.end(), [this](unsigned int node) { return node >= vertices.size(); }) != path.end()) {
+		PRINT("CRITICAL: The trail does not fit the vertices. Aborting.");
+		return false;
 	}
 
-	std::copy(std::istream_iterator<unsigned int>(ntrail_file), std::istream_iterator<unsigned int>(), std::back_inserter(path));
+	if (ecode_it && trail_it)
+		read_embedding(ecode_it, ecode_end, trail_it, trail_end);
+
 	path.pop_back(); // Because .ntrail stores the last and the first as the same index, this is implied in the rectification algorithm.
 
 	return setupHelices(phys);
 }
 
-std::hash<unsigned int> scene::Edge::hasher;
-
-bool scene::setupHelices(physics & phys) {
-	// Find duplicate edges.
-	std::unordered_map<Edge, int, std::function<size_t(const Edge &)>> duplicates(path.size() - 1, std::mem_fun_ref(&Edge::hash));
+bool scene::read_embedding(const char *ecode_it, const char *ecode_end, const char *trail_it, const char *trail_end) {
+	std::vector<unsigned int> offsets, rotations, trail;
+	const char *error(parse_edge_code(ecode_it, ecode_end, offsets, rotations));
+	if (!error)
+		error = parse_trail(trail_it, trail_end, trail);
+	if (!error && (offsets.size() != vertices.size() + 1 || trail.size() + 1 != path.size()))
+		error = "The edge code or edge trail does not fit the mesh";
+
+	// The position in the path of every edge of the graph, an Eulerian trail visits each of them once.
+	std::vector<unsigned int> positions(error ? 0 : trail.size(), UINT_MAX);
+	for (unsigned int i = 0; !error && i < trail.size(); ++i) {
+		if (trail[i] >= trail.size() || positions[trail[i]] != UINT_MAX || path[i] == path[i + 1])
+			error = "The edge trail does not visit every edge of the edge code once";
+		else
+			positions[trail[i]] = i;
+	}
 
-	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
-		++duplicates[Edge(*it, *circular_increment(it, path))];
-		edges.push_back(Edge(*it, *circular_increment(it, path)));
-	}	
+	// Every edge must be around both vertices it connects in the path, the rotations are translated to the edge positions in the path.
+	std::vector<unsigned char> ends(positions.size(), 0);
+	for (unsigned int vertex = 0; !error && vertex < vertices.size(); ++vertex) {
+		for (unsigned int k = offsets[vertex]; k < offsets[vertex + 1]; ++k) {
+			const unsigned int edge(rotations[k] < positions.size() ? positions[rotations[k]] : UINT_MAX);
+			if (edge == UINT_MAX || (path[edge] != vertex && path[edge + 1] != vertex) || ++ends[edge] > 2) {
+				error = "The edge trail does not follow the edges of the edge code";
+				break;
+			}
+			rotations[k] = edge;
+		}
+	}
+	if (!error && (size_t) std::count(ends.begin(), ends.end(), 2) != ends.size())
+		error = "The edge trail does not follow the edges of the edge code";
 
-	for (std::vector<Edge>::const_iterator it(edges.begin()); it != edges.end(); ++it) {
-		for (int i = 0; i < 2; ++i)
-			vertices[it->vertices[i]].neighbor_edges.push_back(Vertex::Edge(unsigned int(std::distance(edges.cbegin(), it))));
+	if (error) {
+		PRINT("WARNING: %s, the edges are ordered around the vertices as they are visited.", error);
+		return false;
 	}
 
-	// Calculate vertex normal and edge angles.
-	for (std::vector<Vertex>::iterator vertex_it(vertices.begin()); vertex_it != vertices.end(); ++vertex_it) {
-		Vertex & vertex(*vertex_it);
-		const unsigned int vertexIndex(unsigned int(std::distance(vertices.begin(), vertex_it)));
+	embedding.offsets.swap(offsets);
+	embedding.edges.swap(rotations);
+	return true;
+}
 
-		vertex.normal = kZeroVec;
-		for (Vertex::NeighborContainer::const_iterator it(vertex.neighbor_edges.begin()); it != vertex.neighbor_edges.end(); ++it) {
-			const physics::vec3_type edge1(vertex.position - vertices[edges[circular_increment(it, vertex.neighbor_edges)->index].other(vertexIndex)].position);
-			const physics::vec3_type edge2(vertex.position - vertices[edges[it->index].other(vertexIndex)].position);
-			vertex.normal += edge1.getNormalized().cross(edge2.getNormalized());
+bool scene::setupRotations() {
+	std::vector<unsigned char> ends(edges.size(), 0); // Bit per end of the edges that are placed.
+	for (unsigned int vertex = 0; vertex < vertices.size(); ++vertex) {
+		Vertex::NeighborContainer & neighbor_edges(vertices[vertex].neighbor_edges);
+		for (unsigned int k = embedding.offsets[vertex]; k < embedding.offsets[vertex + 1]; ++k) {
+			const unsigned int index(embedding.edges[k]);
+			const int end(edges[index].vertices[0] == vertex ? 0 : 1);
+			if (ends[index] & (1 << end))
+				return false;
+
+			ends[index] |= 1 << end;
+			edges[index].slots[end] = (unsigned int) neighbor_edges.size();
+			neighbor_edges.push_back(Vertex::Edge(index));
 		}
+	}
 
-		vertex.normal.normalize();
+	// The staple of an edge is on the other side of it than the next edge of the trail, so they must be neighbors around the vertex between them.
+	for (unsigned int index = 0; index < edges.size(); ++index) {
+		const unsigned int count((unsigned int) vertices[edges[index].vertices[1]].neighbor_edges.size());
+		const unsigned int from(edges[index].slots[1]), to(edges[circular_index(index + 1, edges.size())].slots[0]);
+		if ((from + 1) % count != to && (to + 1) % count != from)
+			return false;
+	}
 
-		//std::cerr << "vertex " << vertexIndex << " position: " << vertex.position.x << ' ' << vertex.position.y << ' ' << vertex.position.z << std::endl;
+	return true;
+}
 
-		physics::vec3_type tangent((vertices[edges[vertex.neighbor_edges.front().index].other(vertexIndex)].position - vertex.position).getNormalized());
-		tangent -= proj(tangent, vertex.normal);
+physics::vec3_type scene::parallelEdgeSide(unsigned int index, unsigned int duplicates) const {
+	// Parallel edges are neighbors around their vertices. Around the lower numbered one, counting back from the edge tells its rank among them.
+	const Edge & edge(edges[index]);
+	const int end(edge.vertices[0] < edge.vertices[1] ? 0 : 1);
+	const unsigned int other(edge.vertices[end ^ 1]);
+	const Vertex & vertex(vertices[edge.vertices[end]]);
+	const unsigned int count((unsigned int) vertex.neighbor_edges.size());
+
+	unsigned int rank(0);
+	while (rank + 1 < duplicates && edges[vertex.neighbor_edges[(edge.slots[end] + count - rank - 1) % count].index].other(edge.vertices[end]) == other)
+		++rank;
+
+	// The vertex normal is summed from the crosses of the edges in the order of the embedding, which is clockwise around it. Later edges are
+	// therefore on the side of the direction crossed with the normal.
+	const physics::vec3_type direction(vertices[other].position - vertex.position);
+	physics::vec3_type side(direction.cross(vertex.normal));
+	if (side.magnitudeSquared() < physics::real_type(1e-12) * direction.magnitudeSquared())
+		side = direction.cross(std::abs(direction.x) < std::abs(direction.y) ? kPosXAxis : kPosYAxis);
+	side.normalize();
+
+	// From -1 for the first to 1 for the last, evenly spaced.
+	return side * (physics::real_type(2 * int(rank) + 1 - int(duplicates)) / physics::real_type(duplicates - 1));
+}
+
+namespace {
+	// Vertices per thread below which fewer threads compute the vertex normals and edge angles.
+	const size_t kMinVerticesPerThread = 4096;
+}
 
-		for (Vertex::Edge & edge : vertex.neighbor_edges) {
-			const physics::vec3_type delta(vertices[edges[edge.index].other(vertexIndex)].position - vertex.position);
-			//edge.angle = signedAngle(delta - proj(delta, vertex.normal), tangent, vertex.normal);
-			edge.angle = signedAngle(tangent, delta - proj(delta, vertex.normal), vertex.normal);
+bool scene::setupHelices(physics & phys) {
+	edges.reserve(path.size());
+	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it)
+		edges.push_back(Edge(*it, *circular_increment(it, path)));
+
+	if (!embedding.offsets.empty()) {
+		if (setupRotations())
+			PRINT("Using the order of the edges around the vertices of the edge code.");
+		else {
+			PRINT("WARNING: The trail does not turn to a neighboring edge of the edge code at every vertex, the edges are ordered around the vertices as they are visited.");
+			embedding = Embedding();
+			for (Vertex & vertex : vertices)
+				vertex.neighbor_edges.clear();
 		}
 	}
 
-	// Correct angles for edges visited multiple times.
-	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
-		const std::vector<unsigned int>::const_iterator next_it(circular_increment(it, path));
-		const Edge edge(*it, *next_it);
-		const unsigned int it_offset(unsigned int(std::distance(path.cbegin(), it)));
-		assert(duplicates[edge] >= 1);
+	// Without an embedding, the edges are ordered around the vertices as they are visited. Every edge remembers its position in the neighbor_edges
+	// of both its vertices, so the vertices need no lookup tables.
+	if (embedding.offsets.empty()) {
+		for (unsigned int index = 0; index < edges.size(); ++index) {
+			for (int i = 0; i < 2; ++i) {
+				Vertex::NeighborContainer & neighbor_edges(vertices[edges[index].vertices[i]].neighbor_edges);
+				edges[index].slots[i] = (unsigned int) neighbor_edges.size();
+				neighbor_edges.push_back(Vertex::Edge(index));
+			}
+		}
+	}
 
-		if (duplicates[edge] > 1) {
-			Vertex *vertices_[] = { &vertices[edge.vertices[0]], &vertices[edge.vertices[1]] };
+	// Find duplicate edges: sorted by their vertex pairs, the visits of the same edge are adjacent.
+	std::vector<std::pair<uint64_t, unsigned int> > sorted_edges;
+	sorted_edges.reserve(edges.size());
+	for (unsigned int i = 0; i < edges.size(); ++i)
+		sorted_edges.push_back(std::make_pair(edges[i].key(), i));
+	std::sort(sorted_edges.begin(), sorted_edges.end());
+
+	std::vector<unsigned int> duplicates(edges.size()); // By edge index.
+	for (size_t first = 0, last; first < sorted_edges.size(); first = last) {
+		for (last = first + 1; last < sorted_edges.size() && sorted_edges[last].first == sorted_edges[first].first; ++last);
+		for (size_t i = first; i < last; ++i)
+			duplicates[sorted_edges[i].second] = (unsigned int) (last - first);
+	}
 
-			const physics::vec3_type direction(vertices_[1]->position - vertices_[0]->position);
+	// Calculate vertex normal, edge angles and the number of distinct neighbors. Every vertex only writes to itself, so ranges of them are done in parallel.
+	const std::function<void(size_t, size_t)> setup_vertices([this](size_t first, size_t last) {
+		std::vector<unsigned int> neighbors;
+		for (size_t index = first; index < last; ++index) {
+			Vertex & vertex(vertices[index]);
+			const unsigned int vertexIndex((unsigned int) index);
 
-			const unsigned int connecting_vertex_indices[] = { *circular_increment(next_it, path), *circular_decrement(it, path) };
+			vertex.normal = kZeroVec;
+			if (vertex.neighbor_edges.empty())
+				continue;
 
-			physics::vec3_type tangent(kZeroVec);
-			for (int i = 0; i < 2; ++i) {
-				if (connecting_vertex_indices[i] != edge.vertices[i]) {
-					const physics::vec3_type upcoming_direction(vertices[connecting_vertex_indices[i]].position - vertices_[i ^ 1]->position);
-					tangent += upcoming_direction - proj(upcoming_direction, direction);
-				}
+			for (Vertex::NeighborContainer::const_iterator it(vertex.neighbor_edges.begin()); it != vertex.neighbor_edges.end(); ++it) {
+				const physics::vec3_type edge1(vertex.position - vertices[edges[circular_increment(it, vertex.neighbor_edges)->index].other(vertexIndex)].position);
+				const physics::vec3_type edge2(vertex.position - vertices[edges[it->index].other(vertexIndex)].position);
+				vertex.normal += edge1.getNormalized().cross(edge2.getNormalized());
 			}
 
-			const Vertex::NeighborContainer::iterator neighbor_edge_it(std::find(vertices_[0]->neighbor_edges.begin(), vertices_[0]->neighbor_edges.end(), it_offset));
-			assert(neighbor_edge_it != vertices_[0]->neighbor_edges.end());
+			vertex.normal.normalize();
 
-			//neighbor_edge_it->angle += sgn_nozero(direction.cross(vertices_[0]->normal).dot(tangent)) * physics::real_type(ANGLE_EPSILON);
-			//neighbor_edge_it->angle -= sgn_nozero(direction.cross(vertices_[0]->normal).dot(tangent)) * physics::real_type(ANGLE_EPSILON);
-		}
-	}
+			neighbors.clear();
+			for (const Vertex::Edge & edge : vertex.neighbor_edges)
+				neighbors.push_back(edges[edge.index].other(vertexIndex));
+
+			// The angles only place parallel edges when there is no embedding.
+			if (embedding.offsets.empty()) {
+				physics::vec3_type tangent((vertices[neighbors.front()].position - vertex.position).getNormalized());
+				tangent -= proj(tangent, vertex.normal);
+
+				for (size_t k = 0; k < neighbors.size(); ++k) {
+					const physics::vec3_type delta(vertices[neighbors[k]].position - vertex.position);
+					vertex.neighbor_edges[k].angle = signedAngle(tangent, delta - proj(delta, vertex.normal), vertex.normal);
+				}
+			}
 
-	// Validate angles for debugging
-	for (const Edge & edge : edges) {
-		const Vertex & vertex(vertices[edge.vertices[1]]);
-		for (Vertex::NeighborContainer::const_iterator nit(vertex.neighbor_edges.begin()); nit != vertex.neighbor_edges.end() - 1; ++nit) {
-			//if (nit->angle == (nit + 1)->angle)
-				//PRINT("Angles are the same for edges %u and %u at vertex %u leading to vertices %u and %u. Vertex normal: %f, %f, %f", 1 + nit->index, 1 + (nit + 1)->index, 1 + edge.vertices[1], 1 + edges[nit->index].other(edge.vertices[1]), 1 + edges[(nit + 1)->index].other(edge.vertices[1]), vertices[edge.vertices[1]].normal.x, vertices[edge.vertices[1]].normal.y, vertices[edge.vertices[1]].normal.z);
-			//assert(nit->angle != (nit + 1)->angle);
+			std::sort(neighbors.begin(), neighbors.end());
+			vertex.unique_neighbors = (unsigned int) (std::unique(neighbors.begin(), neighbors.end()) - neighbors.begin());
 		}
-	}
+	});
+
+	const size_t thread_count(std::max(size_t(1), std::min(size_t(numcpucores()), vertices.size() / kMinVerticesPerThread)));
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < thread_count; ++i)
+		threads.push_back(std::thread(setup_vertices, vertices.size() * i / thread_count, vertices.size() * (i + 1) / thread_count));
+	setup_vertices(0, vertices.size() / thread_count);
+	for (std::thread & thread : threads)
+		thread.join();
 
 	for (const Vertex & vertex : vertices)
 		assert(vertex.neighbor_edges.size() % 2 == 0);
 
-	// Sort edges by angle and create the edge lookup.
-	std::for_each(vertices.begin(), vertices.end(), std::mem_fun_ref(&Vertex::generate_lookup));
-
 	for (std::vector<unsigned int>::const_iterator it(path.begin()); it != path.end(); ++it) {
 		const std::vector<unsigned int>::const_iterator next_it(circular_increment(it, path));
-		const Edge edge(*it, *next_it);
+		const unsigned int it_offset((unsigned int) (std::distance(path.cbegin(), it)));
+		const Edge & edge(edges[it_offset]);
 		Vertex *vertices_[] = { &vertices[edge.vertices[0]], &vertices[edge.vertices[1]] };
-		const Vertex::NeighborContainer::iterator neighbor_edge_it(std::find_if(vertices_[0]->neighbor_edges.begin(), vertices_[0]->neighbor_edges.end(), [this, &edge](const Vertex::Edge & vertex_edge) { return edges[vertex_edge.index].other(edge.vertices[0]) == edge.vertices[1]; }));
-		assert(neighbor_edge_it != vertices_[0]->neighbor_edges.end());
 
 		const physics::vec3_type origo((vertices_[0]->position + vertices_[1]->position) / 2), direction(vertices_[1]->position - vertices_[0]->position);
 
-		std::set<unsigned int> vertices_unique_neighbors[2];
-		for (int i = 0; i < 2; ++i) {
-			for (const Vertex::Edge & vertex_edge : vertices_[i]->neighbor_edges)
-				vertices_unique_neighbors[i].insert(edges[vertex_edge.index].other(edge.vertices[i]));
-		}
-
 		physics::vec3_type tangent(kZeroVec);
 		const unsigned int connecting_vertex_indices[] = { *circular_increment(next_it, path), *circular_decrement(it, path) };
 		bool cross(false);
 
-		if (duplicates[edge] > 1) {
+		if (duplicates[it_offset] > 1) {
 			for (int i = 0; i < 2; ++i) {
 				if (connecting_vertex_indices[i] != edge.vertices[i]) {
 					//const physics::vec3_type upcoming_direction(vertices[connecting_vertex_indices[i]].position - vertices_[i ^ 1]->position);
@@ -229,45 +750,43 @@ bool scene::setupHelices(physics & phys) {
 				} else
 					cross = true;
 			}
-			physics::real_type alpha, betha, gamma, diff_ang;
-			for (Vertex::NeighborContainer::const_iterator nit(vertices_[0]->neighbor_edges.begin()); nit != vertices_[0]->neighbor_edges.end(); ++nit) {
-				if (nit->index == std::distance<std::vector<unsigned int>::const_iterator>(path.begin(), it))
+			if (!embedding.offsets.empty())
+				tangent = parallelEdgeSide(it_offset, duplicates[it_offset]);
+			else {
+				physics::real_type alpha, betha, gamma, diff_ang;
+				// The edge is found directly by its position among the neighbor edges of its first vertex.
+				const Vertex::NeighborContainer::const_iterator nit(vertices_[0]->neighbor_edges.begin() + edge.slots[0]);
+				alpha = nit->angle;
+
+				if (edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].other(*it) != edges[nit->index].other(*it))
 				{
-					alpha = nit->angle;
-					
-					if (edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].other(*it) != edges[nit->index].other(*it))
-					{
-						betha = circular_decrement(nit, vertices_[0]->neighbor_edges)->angle;
-						gamma = circular_increment(circular_increment(nit, vertices_[0]->neighbor_edges), vertices_[0]->neighbor_edges)->angle;
-						tangent = (vertices[edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].vertices[0]].position
-							+ vertices[edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].vertices[1]].position) / 2 - origo;
-
-					}
-					else if (edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].other(*it) != edges[nit->index].other(*it))
-					{
-						betha = circular_increment(nit, vertices_[0]->neighbor_edges)->angle;
-						gamma = circular_decrement(circular_decrement(nit, vertices_[0]->neighbor_edges), vertices_[0]->neighbor_edges)->angle;
-						tangent = (vertices[edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].vertices[0]].position
-							+ vertices[edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].vertices[1]].position) / 2 - origo;
-					
-					}
-					
-					if (alpha > gamma && gamma > betha) diff_ang = (M_PI - alpha) + (betha + M_PI);
-					else if (betha > gamma && gamma > alpha) diff_ang = (M_PI - betha) + (alpha + M_PI);
-					else  diff_ang = (betha - alpha) > 0 ? (betha - alpha) : alpha - betha;
-					if (diff_ang >= M_PI)
-						tangent *= -1;
+					betha = circular_decrement(nit, vertices_[0]->neighbor_edges)->angle;
+					gamma = circular_increment(circular_increment(nit, vertices_[0]->neighbor_edges), vertices_[0]->neighbor_edges)->angle;
+					tangent = (vertices[edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].vertices[0]].position
+						+ vertices[edges[circular_decrement(nit, vertices_[0]->neighbor_edges)->index].vertices[1]].position) / 2 - origo;
 
-					break;
 				}
-				
+				else if (edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].other(*it) != edges[nit->index].other(*it))
+				{
+					betha = circular_increment(nit, vertices_[0]->neighbor_edges)->angle;
+					gamma = circular_decrement(circular_decrement(nit, vertices_[0]->neighbor_edges), vertices_[0]->neighbor_edges)->angle;
+					tangent = (vertices[edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].vertices[0]].position
+						+ vertices[edges[circular_increment(nit, vertices_[0]->neighbor_edges)->index].vertices[1]].position) / 2 - origo;
+			
+				}
+			
+				if (alpha > gamma && gamma > betha) diff_ang = (M_PI - alpha) + (betha + M_PI);
+				else if (betha > gamma && gamma > alpha) diff_ang = (M_PI - betha) + (alpha + M_PI);
+				else  diff_ang = (betha - alpha) > 0 ? (betha - alpha) : alpha - betha;
+				if (diff_ang >= M_PI)
+					tangent *= -1;
+
+				tangent.normalize();
 			}
-
-			tangent.normalize();
 		} else
 			cross = (vertices[connecting_vertex_indices[0]].position - vertices_[1]->position).dot(vertices[connecting_vertex_indices[1]].position - vertices_[0]->position) < 0;
 
-		double length(direction.magnitude() - apothem(2 * DNA::RADIUS, vertices_unique_neighbors[0].size()) - apothem(2 * DNA::RADIUS, vertices_unique_neighbors[1].size()));
+		double length(direction.magnitude() - apothem(2 * DNA::RADIUS, vertices_[0]->unique_neighbors) - apothem(2 * DNA::RADIUS, vertices_[1]->unique_neighbors));
 
 		if (settings.discretize_lengths) {
 			const double num_half_turns(length / DNA::HALF_TURN_LENGTH);
@@ -280,7 +799,7 @@ bool scene::setupHelices(physics & phys) {
 		helices.emplace_back(
 			helix_settings,
 			phys, DNA::DistanceToBaseCount(length),
-			physics::transform_type((origo +  tangent * physics::real_type((duplicates[edge] - 1) * (DNA::RADIUS + DNA::SPHERE_RADIUS))), rotationFromTo(kPosZAxis, direction)));
+			physics::transform_type((origo +  tangent * physics::real_type((duplicates[it_offset] - 1) * (DNA::RADIUS + DNA::SPHERE_RADIUS))), rotationFromTo(kPosZAxis, direction)));
 	}
 
 	// Connect the scaffold.
@@ -291,24 +810,17 @@ bool scene::setupHelices(physics & phys) {
 
 	for (std::vector<Edge>::const_iterator it(edges.begin()); it != edges.end(); ++it) {
 		const Vertex & vertex(vertices[it->vertices[1]]);
-		const unsigned int it_offset(unsigned int(std::distance(edges.cbegin(), it)));
-		const unsigned int next_it_offset(unsigned int(circular_index(it_offset + 1, edges.size())));
-		const Vertex::NeighborContainer::const_iterator edge_it(vertex.edges_lookup.at(it_offset));
-		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.edges_lookup.at(next_it_offset));
-		assert(edge_it != vertex.neighbor_edges.end() && next_edge_it != vertex.neighbor_edges.end());
-
-		for (Vertex::NeighborContainer::const_iterator nit(vertex.neighbor_edges.begin()); nit != vertex.neighbor_edges.end() - 1; ++nit) {
-			//if (nit->angle == (nit + 1)->angle)
-				//PRINT("Angles are the same for edges %u and %u at vertex %u leading to vertices %u and %u. Vertex normal: %f, %f, %f", 1 + nit->index, 1 + (nit + 1)->index, 1 + it->vertices[1], 1 + edges[nit->index].other(it->vertices[1]), 1 + edges[(nit + 1)->index].other(it->vertices[1]), vertices[it->vertices[1]].normal.x, vertices[it->vertices[1]].normal.y, vertices[it->vertices[1]].normal.z);
-			//assert(nit->angle != (nit + 1)->angle);
-		}
+		const unsigned int it_offset((unsigned int) (std::distance(edges.cbegin(), it)));
+		const unsigned int next_it_offset((unsigned int) (circular_index(it_offset + 1, edges.size())));
+		const Vertex::NeighborContainer::const_iterator edge_it(vertex.neighbor_edges.begin() + it->slots[1]);
+		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.neighbor_edges.begin() + edges[next_it_offset].slots[0]);
 
 		const int delta(int(next_edge_it - edge_it));
 		assert(std::abs(delta) == 1 || std::abs(delta) == int(vertex.neighbor_edges.size() - 1));
 		const ptrdiff_t edge_it_offset(std::distance(vertex.neighbor_edges.cbegin(), edge_it));
 		const size_t staple_edge(circular_index(edge_it_offset + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1), vertex.neighbor_edges.size()));
 		
-		assert(unsigned int((edge_it_offset + vertex.neighbor_edges.size() + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1)) % vertex.neighbor_edges.size()) == staple_edge);
+		assert((unsigned int) ((edge_it_offset + vertex.neighbor_edges.size() + sgn_nozero(delta) * ((std::abs(delta) > 1) * 2 - 1)) % vertex.neighbor_edges.size()) == staple_edge);
 
 		helices[it_offset].attach(phys, helices[(vertex.neighbor_edges.begin() + staple_edge)->index], Helix::kBackwardFivePrime, Helix::kBackwardThreePrime);
 	}
@@ -320,8 +832,8 @@ bool scene::setupHelices(physics & phys) {
 		const std::vector<Edge>::const_iterator next_it(circular_increment(prev_it, edges));
 		const size_t next_it_offset(std::distance(edges.cbegin(), next_it));
 
-		const Vertex::NeighborContainer::const_iterator prev_edge_it(vertex.edges_lookup.at(unsigned int(prev_it_offset)));
-		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.edges_lookup.at(unsigned int(next_it_offset)));
+		const Vertex::NeighborContainer::const_iterator prev_edge_it(vertex.neighbor_edges.begin() + prev_it->slots[1]);
+		const Vertex::NeighborContainer::const_iterator next_edge_it(vertex.neighbor_edges.begin() + next_it->slots[0]);
 
 		const ptrdiff_t delta(next_edge_it - prev_edge_it);
 		assert(std::abs(delta) == 1 || size_t(std::abs(delta)) == vertex.neighbor_edges.size() - 1);
@@ -334,32 +846,177 @@ bool scene::setupHelices(physics & phys) {
 	return true;
 }
 
-void scene::getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) const {
-	min = std::numeric_limits<physics::real_type>::infinity();
-	max = physics::real_type(0);
-	total = physics::real_type(0);
-	size_t helix_offset = 0; // DEBUG
-	for (const Helix & helix : helices) {
+void scene::getTotalSeparationMinMaxAverage(physics::real_type & min, physics::real_type & max, physics::real_type & average, physics::real_type & total) {
+	updateSeparations();
+
+	min = sorted_separations.empty() ? std::numeric_limits<physics::real_type>::infinity() : *sorted_separations.begin();
+	max = sorted_separations.empty() ? physics::real_type(0) : *sorted_separations.rbegin();
+	average = physics::real_type(total_separation / (helices.size() * 4));
+	total = physics::real_type(total_separation / 2);
+	if (non_finite_separations > 0)
+		min = max = average = total = std::numeric_limits<physics::real_type>::quiet_NaN();
+}
+
+void scene::getResidual(physics::real_type & max_speed, double & energy) const {
+	max_speed = 0;
+	energy = 0;
+	if (patch.empty()) {
+		for (const Helix & helix : helices) {
+			max_speed = std::max(max_speed, helix.getMaxSpeed());
+			energy += helix.getPotentialEnergy();
+		}
+	} else {
+		for (HelixContainer::size_type i : patch) {
+			max_speed = std::max(max_speed, helices[i].getMaxSpeed());
+			energy += helices[i].getPotentialEnergy();
+		}
+	}
+}
+
+void scene::setPatch(HelixContainer::size_type helix, unsigned int hops) {
+	clearPatch();
+
+	// Breadth first through the joints, the helices of one hop distance after another.
+	std::vector<unsigned char> in_patch(helices.size(), 0);
+	patch.push_back(helix);
+	in_patch[helix] = 1;
+	for (size_t begin = 0, hop = 0; hop < hops && begin < patch.size(); ++hop) {
+		const size_t end(patch.size());
+		for (; begin < end; ++begin) {
+			for (const Helix::Connection & connection : helices[patch[begin]].getJoints()) {
+				if (!connection)
+					continue;
+
+				const HelixContainer::size_type other(connection.helix - &helices.front());
+				if (!in_patch[other]) {
+					in_patch[other] = 1;
+					patch.push_back(other);
+				}
+			}
+		}
+	}
+
+	for (HelixContainer::size_type i = 0; i < helices.size(); ++i) {
+		if (!in_patch[i])
+			helices[i].setKinematic(true);
+	}
+}
+
+void scene::clearPatch() {
+	if (patch.empty())
+		return;
+
+	std::vector<unsigned char> in_patch(helices.size(), 0);
+	for (HelixContainer::size_type i : patch)
+		in_patch[i] = 1;
+	for (HelixContainer::size_type i = 0; i < helices.size(); ++i) {
+		if (!in_patch[i])
+			helices[i].setKinematic(false);
+	}
+
+	patch.clear();
+}
+
+void scene::updateSeparations() {
+	if (helices.empty())
+		return;
+
+	if (separations.size() != helices.size() * 4) {
+		// Measure every joint the first time. The helices were copied into the container after their bodies were created.
+		for (Helix & helix : helices)
+			helix.bindRigidBody();
+		phys->collect_moved_bodies(moved_bodies);
+
+		separations.assign(helices.size() * 4, physics::real_type(0));
+		sorted_separations.clear();
+		total_separation = 0;
+		non_finite_separations = 0;
+
+		for (size_t i = 0; i < helices.size(); ++i) {
+			const Helix::ConnectionContainer & connections(helices[i].getJoints());
+			for (size_t j = 0; j < connections.size(); ++j) {
+				if (connections[j].joint == nullptr) { // DEBUG ONLY
+					PRINT("WARNING: Joint is null, should not happen! connection: %u, helix: %u", (unsigned int) j, (unsigned int) i);
+					continue;
+				}
+
+				separations[i * 4 + j] = physics::spring_length(*connections[j].joint);
+				if (std::isfinite(separations[i * 4 + j])) {
+					sorted_separations.insert(separations[i * 4 + j]);
+					total_separation += separations[i * 4 + j];
+				} else
+					++non_finite_separations;
+			}
+		}
+
+		return;
+	}
+
+	// A moved helix changes the separation of its joints, which are also cached at the helices on their other ends.
+	phys->collect_moved_bodies(moved_bodies);
+	for (physics::rigid_body_type *rigid_body : moved_bodies) {
+		const Helix & helix(*static_cast<const Helix *>(physics::user_data(*rigid_body)));
+		const size_t index(&helix - &helices.front());
 		const Helix::ConnectionContainer & connections(helix.getJoints());
-		size_t connection_offset = 0; // DEBUG
-		for (const Helix::Connection & connection : connections) {
-			if (connection.joint == nullptr) { // DEBUG ONLY
-				PRINT("WARNING: Joint is null, should not happen! connection: %u, helix: %u", connection_offset, helix_offset);
+
+		for (size_t j = 0; j < connections.size(); ++j) {
+			if (!connections[j])
 				continue;
-			}
-			const physics::real_type separation(connection.joint->getDistance());
-			min = std::min(min, separation);
-			max = std::max(max, separation);
-			total += separation;
 
-			connection_offset++; // DEBUG
+			const physics::real_type separation(physics::spring_length(*connections[j].joint));
+			setSeparation(index * 4 + j, separation);
+
+			const Helix::ConnectionContainer & other(connections[j].helix->getJoints());
+			for (size_t k = 0; k < other.size(); ++k) {
+				if (other[k].joint == connections[j].joint)
+					setSeparation((connections[j].helix - &helices.front()) * 4 + k, separation);
+			}
 		}
+	}
+}
+
+void scene::setSeparation(size_t slot, physics::real_type separation) {
+	physics::real_type & cached(separations[slot]);
+	const bool was_finite(std::isfinite(cached)), is_finite(std::isfinite(separation));
+	if (was_finite)
+		sorted_separations.erase(sorted_separations.find(cached));
+	else
+		--non_finite_separations;
+
+	if (is_finite)
+		sorted_separations.insert(separation);
+	else
+		++non_finite_separations;
+
+	total_separation += (is_finite ? separation : 0) - (was_finite ? cached : 0);
+	cached = separation;
+}
+
+scene::State scene::saveState() const {
+	State state;
+	state.helices.reserve(helices.size());
+	for (const Helix & helix : helices) {
+		const State::HelixState helix_state = { helix.getTransform(), helix.getLinearVelocity(), helix.getAngularVelocity(), helix.getBaseCount() };
+		state.helices.push_back(helix_state);
+	}
+
+	return state;
+}
+
+void scene::restoreState(physics & phys, const State & state) {
+	assert(state.helices.size() == helices.size());
+	clearPatch();
 
-		helix_offset++; // DEBUG
+	for (size_t i = 0; i < helices.size(); ++i) {
+		const State::HelixState & helix_state(state.helices[i]);
+		if (helices[i].getBaseCount() != helix_state.bases)
+			helices[i].setBaseCount(phys, helix_state.bases, helix_state.transform);
 	}
 
-	average = total / (helices.size() * 4);
-	total /= 2;
+	for (size_t i = 0; i < helices.size(); ++i) {
+		helices[i].setTransform(state.helices[i].transform);
+		helices[i].setVelocity(state.helices[i].linear_velocity, state.helices[i].angular_velocity);
+	}
 }
 
 SceneDescription::SceneDescription(scene & scene) : totalSeparation(scene.getTotalSeparation()) {
@@ -0,0 +1,290 @@
+#include <Definition.h>
+#include <Service.h>
+#include <Utility.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifdef _WINDOWS
+
+bool service::serve(const settings_type & settings, unsigned int concurrent_jobs, const handler_type & handler, const std::atomic<bool> & interrupted) {
+	std::cerr << "ERROR! --serve needs UNIX domain sockets, which are not supported on Windows" << std::endl;
+	return false;
+}
+
+bool service::route(const settings_type & settings, const std::string & ply_file, const std::string & work_directory, std::string & routed_ply, std::string & message) {
+	message = "routing is not supported on Windows, use bscor.bat";
+	return false;
+}
+
+#else
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+	const size_t kMaxRequestLength = 1 << 16;
+	const int kAcceptPollMs = 200; // How often the accepting threads check for ^C.
+	const int kRequestTimeoutSeconds = 30; // A client must send its request line within this time.
+
+	bool make_address(const std::string & path, sockaddr_un & address) {
+		if (path.size() >= sizeof(address.sun_path))
+			return false;
+
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strcpy(address.sun_path, path.c_str());
+		return true;
+	}
+
+	bool send_all(int fd, const char *data, size_t length) {
+		while (length > 0) {
+			const ssize_t sent(send(fd, data, length, 0));
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent <= 0)
+				return false;
+			data += sent;
+			length -= size_t(sent);
+		}
+		return true;
+	}
+
+	// Reads up to the first newline, or the end of the stream if the client shuts down its side instead.
+	bool receive_line(int fd, std::string & line) {
+		char buffer[4096];
+		while (line.size() < kMaxRequestLength) {
+			const ssize_t received(recv(fd, buffer, sizeof(buffer), 0));
+			if (received < 0 && errno == EINTR)
+				continue;
+			if (received < 0)
+				return false;
+			if (received == 0)
+				return !line.empty();
+
+			line.append(buffer, size_t(received));
+			const size_t newline(line.find('\n'));
+			if (newline != std::string::npos) {
+				line.erase(newline);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void reply(int fd, const std::string & status, const std::string & reply_file) {
+		const std::string line(status + "\n");
+		if (!send_all(fd, line.data(), line.size()) || reply_file.empty())
+			return;
+
+		std::ifstream infile(reply_file, std::ios::binary);
+		char buffer[1 << 16];
+		while (infile.read(buffer, sizeof(buffer)) || infile.gcount() > 0) {
+			if (!send_all(fd, buffer, size_t(infile.gcount())))
+				return;
+		}
+	}
+
+	// Creates a directory that only the daemon can access, for the files of one request.
+	bool make_work_directory(std::string & directory) {
+		const char *temporary(getenv("TMPDIR"));
+		std::string path(std::string(temporary != NULL && *temporary != '\0' ? temporary : "/tmp") + "/bscord-XXXXXX");
+		if (mkdtemp(&path[0]) == NULL)
+			return false;
+
+		directory = path;
+		return true;
+	}
+
+	// Removes the files of a request and its work directory. The tools only write files, never directories, into it.
+	void remove_work_directory(const std::string & directory) {
+		if (DIR *dir = opendir(directory.c_str())) {
+			while (const dirent *entry = readdir(dir)) {
+				if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+					unlink((directory + "/" + entry->d_name).c_str());
+			}
+			closedir(dir);
+		}
+		rmdir(directory.c_str());
+	}
+
+	bool copy_file(const std::string & from, const std::string & to) {
+		std::ifstream infile(from, std::ios::binary);
+		std::ofstream outfile(to, std::ios::binary);
+		if (!infile || !outfile)
+			return false;
+
+		// Inserting an empty stream buffer sets the failbit.
+		if (infile.peek() != std::ifstream::traits_type::eof())
+			outfile << infile.rdbuf();
+		outfile.close();
+		return !outfile.fail();
+	}
+
+	// Reads the request of the connection, handles it and replies. Messages never span lines.
+	void handle_connection(int fd, unsigned int index, const service::handler_type & handler) {
+		timeval timeout = { kRequestTimeoutSeconds, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		std::string line;
+		if (!receive_line(fd, line)) {
+			reply(fd, "ERROR Expected a request line", "");
+			return;
+		}
+
+		std::vector<std::string> arguments;
+		std::istringstream ss(line);
+		for (std::string argument; ss >> argument;)
+			arguments.push_back(argument);
+
+		std::string work_directory;
+		if (!make_work_directory(work_directory)) {
+			reply(fd, std::string("ERROR Failed to create a work directory: ") + strerror(errno), "");
+			return;
+		}
+
+		std::string output_file, reply_file, message;
+		if (handler(index, arguments, work_directory, output_file, reply_file, message) == 0)
+			reply(fd, "OK " + output_file, reply_file);
+		else {
+			std::replace(message.begin(), message.end(), '\n', ' ');
+			reply(fd, "ERROR " + (message.empty() ? std::string("Failed to rectify the mesh") : message), "");
+		}
+		remove_work_directory(work_directory);
+	}
+
+	// Runs the tool with the arguments and waits for it, its output goes to the log of the daemon.
+	bool run_tool(const service::settings_type & settings, const std::string & tool, std::vector<std::string> arguments, std::string & message) {
+		const std::string path(settings.tools.empty() ? tool : settings.tools + "/" + tool);
+		if (!settings.cache.empty())
+			arguments.push_back("--cache=" + settings.cache);
+
+		// Built before forking, only exec may be called in the child of a threaded process.
+		std::vector<char *> argv;
+		argv.push_back(const_cast<char *>(path.c_str()));
+		for (std::string & argument : arguments)
+			argv.push_back(&argument[0]);
+		argv.push_back(NULL);
+
+		const pid_t pid(fork());
+		if (pid < 0) {
+			message = "failed to start " + tool + ": " + strerror(errno);
+			return false;
+		}
+		if (pid == 0) {
+			execvp(argv[0], &argv[0]);
+			_exit(127);
+		}
+
+		int status;
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				message = "failed to wait for " + tool;
+				return false;
+			}
+		}
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			std::ostringstream ss;
+			ss << tool << " failed";
+			if (WIFEXITED(status))
+				ss << " with exit code " << WEXITSTATUS(status) << (WEXITSTATUS(status) == 127 ? ", check --tools" : "");
+			message = ss.str();
+			return false;
+		}
+
+		return true;
+	}
+}
+
+bool service::serve(const settings_type & settings, unsigned int concurrent_jobs, const handler_type & handler, const std::atomic<bool> & interrupted) {
+	sockaddr_un address;
+	if (!make_address(settings.socket, address)) {
+		std::cerr << "ERROR! The socket path \"" << settings.socket << "\" is too long" << std::endl;
+		return false;
+	}
+
+	// A socket file nobody accepts on is left behind by a daemon that was killed, and is replaced.
+	const int probe(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+	const bool in_use(probe >= 0 && connect(probe, (const sockaddr *) &address, sizeof(address)) == 0);
+	if (probe >= 0)
+		close(probe);
+	if (in_use) {
+		std::cerr << "ERROR! Another daemon is listening on \"" << settings.socket << "\"" << std::endl;
+		return false;
+	}
+	unlink(settings.socket.c_str());
+
+	// Only the user of the daemon may connect, requests read and write files with its permissions. The socket is accessible before chmod, but not listening.
+	// Non blocking, so that the threads that lose the race for a connection go back to polling. The graph tools, which other requests may start at any
+	// time, must not inherit the sockets, so they are created close on exec.
+	const int listener(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+	if (listener < 0 || bind(listener, (const sockaddr *) &address, sizeof(address)) != 0 || chmod(settings.socket.c_str(), S_IRUSR | S_IWUSR) != 0 || listen(listener, SOMAXCONN) != 0) {
+		std::cerr << "ERROR! Failed to listen on \"" << settings.socket << "\": " << strerror(errno) << std::endl;
+		if (listener >= 0)
+			close(listener);
+		return false;
+	}
+	signal(SIGPIPE, SIG_IGN); // Clients that hang up before the reply must not stop the daemon.
+
+	std::cerr << "INFO: Listening on \"" << settings.socket << "\", handling " << concurrent_jobs << " requests at a time." << std::endl;
+
+	std::atomic<unsigned int> next_index(0);
+	const auto accept_loop([&]() {
+		while (!interrupted) {
+			pollfd pfd = { listener, POLLIN, 0 };
+			if (poll(&pfd, 1, kAcceptPollMs) <= 0)
+				continue;
+
+			// The connection is blocking, accept4 does not pass O_NONBLOCK on from the listener.
+			const int fd(accept4(listener, NULL, NULL, SOCK_CLOEXEC));
+			if (fd < 0)
+				continue;
+
+			handle_connection(fd, next_index++, handler);
+			close(fd);
+		}
+	});
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < concurrent_jobs; ++i)
+		threads.push_back(std::thread(accept_loop));
+	accept_loop();
+	for (std::thread & thread : threads)
+		thread.join();
+
+	close(listener);
+	unlink(settings.socket.c_str());
+	std::cerr << "INFO: Handled " << next_index << " requests." << std::endl;
+	return true;
+}
+
+bool service::route(const settings_type & settings, const std::string & ply_file, const std::string & work_directory, std::string & routed_ply, std::string & message) {
+	const size_t slash(ply_file.find_last_of('/'));
+	routed_ply = work_directory + "/" + (slash == std::string::npos ? ply_file : ply_file.substr(slash + 1));
+	if (!copy_file(ply_file, routed_ply)) {
+		message = "failed to read it or to copy it to the work directory";
+		return false;
+	}
+
+	const std::string base(strip_trailing_string(routed_ply, ".ply"));
+	return run_tool(settings, "ply_to_dimacs", { routed_ply, base + ".dimacs" }, message)
+		&& run_tool(settings, "postman_tour", { base + ".dimacs", base + "-multi.dimacs" }, message)
+		&& run_tool(settings, "ply_to_embedding", { routed_ply, base + ".vcode" }, message)
+		&& run_tool(settings, "make_embedding_eulerian", { base + ".vcode", base + "-multi.dimacs", base + ".ecode" }, message)
+		&& run_tool(settings, "Atrail_search", { base + ".ecode", base + ".trail", base + ".ntrail" }, message);
+}
+
+#endif /* N _WINDOWS */
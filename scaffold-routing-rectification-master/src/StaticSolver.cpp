@@ -0,0 +1,356 @@
+#include <Definition.h>
+#include <StaticSolver.h>
+#include <Statistics.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+namespace {
+	struct dvec3 {
+		double x, y, z;
+
+		inline dvec3() : x(0), y(0), z(0) {}
+		inline dvec3(double x, double y, double z) : x(x), y(y), z(z) {}
+		inline explicit dvec3(const physics::vec3_type & v) : x(v.x), y(v.y), z(v.z) {}
+
+		inline dvec3 operator+(const dvec3 & v) const { return dvec3(x + v.x, y + v.y, z + v.z); }
+		inline dvec3 operator-(const dvec3 & v) const { return dvec3(x - v.x, y - v.y, z - v.z); }
+		inline dvec3 operator*(double f) const { return dvec3(x * f, y * f, z * f); }
+		inline dvec3 & operator+=(const dvec3 & v) { x += v.x; y += v.y; z += v.z; return *this; }
+		inline dvec3 & operator-=(const dvec3 & v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+
+		inline double dot(const dvec3 & v) const { return x * v.x + y * v.y + z * v.z; }
+		inline dvec3 cross(const dvec3 & v) const { return dvec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x); }
+		inline double magnitude() const { return std::sqrt(dot(*this)); }
+	};
+
+	struct dquat {
+		double x, y, z, w;
+
+		inline dquat() : x(0), y(0), z(0), w(1) {}
+		inline dquat(double x, double y, double z, double w) : x(x), y(y), z(z), w(w) {}
+		inline explicit dquat(const physics::quaternion_type & q) : x(q.x), y(q.y), z(q.z), w(q.w) {}
+
+		// The rotation by the rotation vector v, by |v| radians around v.
+		static inline dquat exp(const dvec3 & v) {
+			const double angle(v.magnitude());
+			if (angle < 1e-12)
+				return dquat(v.x / 2, v.y / 2, v.z / 2, 1).normalized();
+			const double s(std::sin(angle / 2) / angle);
+			return dquat(v.x * s, v.y * s, v.z * s, std::cos(angle / 2));
+		}
+
+		inline dquat operator*(const dquat & q) const {
+			return dquat(w * q.x + q.w * x + y * q.z - q.y * z, w * q.y + q.w * y + z * q.x - q.z * x, w * q.z + q.w * z + x * q.y - q.x * y, w * q.w - x * q.x - y * q.y - z * q.z);
+		}
+
+		inline dquat normalized() const {
+			const double m(std::sqrt(x * x + y * y + z * z + w * w));
+			return dquat(x / m, y / m, z / m, w / m);
+		}
+
+		inline dquat conjugate() const { return dquat(-x, -y, -z, w); }
+
+		inline dvec3 rotate(const dvec3 & v) const {
+			const dvec3 u(x, y, z), t(u.cross(v) * 2);
+			return v + t * w + u.cross(t);
+		}
+	};
+
+	struct pose {
+		dvec3 position;
+		dquat orientation;
+
+		inline dvec3 apply(const dvec3 & v) const { return orientation.rotate(v) + position; }
+		inline pose operator*(const pose & p) const { pose r; r.position = apply(p.position); r.orientation = (orientation * p.orientation).normalized(); return r; }
+		inline pose inverse() const { pose r; r.orientation = orientation.conjugate(); r.position = r.orientation.rotate(position) * -1; return r; }
+	};
+
+	// A spring between anchors given in the frames of the bodies. A body of -1 is the world, where the anchor is a world position.
+	struct spring {
+		int body[2];
+		dvec3 anchor[2];
+		double stiffness;
+	};
+
+	/*
+	 * Returns the potential energy of the springs. The gradient has six entries per body: the derivative by its position, which is minus the spring
+	 * forces on it, and by a rotation vector applied to its orientation in the world frame, which is minus the torque around its origin.
+	 */
+	double energy(const std::vector<spring> & springs, const std::vector<pose> & poses, std::vector<double> & gradient) {
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		double e(0);
+
+		for (const spring & s : springs) {
+			dvec3 arm[2], position[2];
+			for (int end = 0; end < 2; ++end) {
+				if (s.body[end] < 0)
+					position[end] = s.anchor[end];
+				else {
+					const pose & p(poses[s.body[end]]);
+					arm[end] = p.orientation.rotate(s.anchor[end]);
+					position[end] = p.position + arm[end];
+				}
+			}
+
+			const dvec3 delta(position[1] - position[0]);
+			e += s.stiffness / 2 * delta.dot(delta);
+
+			// The derivative by the position of the second anchor, the first gets the opposite.
+			const dvec3 derivative(delta * s.stiffness);
+			for (int end = 0; end < 2; ++end) {
+				if (s.body[end] < 0)
+					continue;
+
+				const dvec3 d(end == 0 ? derivative * -1 : derivative), torque(arm[end].cross(d));
+				double *g(&gradient[s.body[end] * 6]);
+				g[0] += d.x; g[1] += d.y; g[2] += d.z;
+				g[3] += torque.x; g[4] += torque.y; g[5] += torque.z;
+			}
+		}
+
+		return e;
+	}
+
+	// Moves every body by step times its six entries in direction.
+	void advance(const std::vector<pose> & from, const std::vector<double> & direction, double step, std::vector<pose> & to) {
+		for (size_t i = 0; i < from.size(); ++i) {
+			const double *d(&direction[i * 6]);
+			to[i].position = from[i].position + dvec3(d[0], d[1], d[2]) * step;
+			to[i].orientation = (dquat::exp(dvec3(d[3], d[4], d[5]) * step) * from[i].orientation).normalized();
+		}
+	}
+
+	inline double dot(const std::vector<double> & a, const std::vector<double> & b) {
+		double sum(0);
+		for (size_t i = 0; i < a.size(); ++i)
+			sum += a[i] * b[i];
+		return sum;
+	}
+
+	/*
+	 * L-BFGS over the poses of the bodies. Returns true if the residual criterion of the settings was met.
+	 */
+	bool minimize(const std::vector<spring> & springs, std::vector<pose> & poses, const static_solver::settings_type & settings, const std::function<bool()> & running_functor, uint64_t & iterations, uint64_t & evaluations) {
+		double max_stiffness(0), max_arm(1);
+		for (const spring & s : springs) {
+			max_stiffness = std::max(max_stiffness, s.stiffness);
+			for (int end = 0; end < 2; ++end) {
+				if (s.body[end] >= 0)
+					max_arm = std::max(max_arm, s.anchor[end].magnitude());
+			}
+		}
+
+		const size_t n(poses.size() * 6);
+		std::vector<pose> trial(poses.size());
+		std::vector<double> gradient(n), trial_gradient(n), direction(n), alpha;
+		std::deque< std::vector<double> > s_history, y_history;
+		std::deque<double> rho_history;
+		evaluations = 1;
+		double e(energy(springs, poses, gradient));
+		// Start with steps a spring on its own could not overshoot.
+		const double initial_scale(max_stiffness > 0 ? 1 / (4 * max_stiffness) : 1);
+
+		bool converged(false);
+		unsigned int iteration(0);
+		for (; iteration < settings.max_iterations && running_functor(); ++iteration) {
+			double residual(0);
+			for (size_t i = 0; i < n; ++i)
+				residual = std::max(residual, std::abs(gradient[i]) / (i % 6 < 3 ? 1 : max_arm));
+			if (residual <= settings.tolerance * max_stiffness) {
+				converged = true;
+				break;
+			}
+
+			// Two loop recursion for the L-BFGS direction.
+			for (size_t i = 0; i < n; ++i)
+				direction[i] = -gradient[i];
+			alpha.resize(s_history.size());
+			for (size_t k = s_history.size(); k-- > 0;) {
+				alpha[k] = rho_history[k] * dot(s_history[k], direction);
+				for (size_t i = 0; i < n; ++i)
+					direction[i] -= alpha[k] * y_history[k][i];
+			}
+			const double scale(s_history.empty() ? initial_scale : 1 / (rho_history.back() * dot(y_history.back(), y_history.back())));
+			for (size_t i = 0; i < n; ++i)
+				direction[i] *= scale;
+			for (size_t k = 0; k < s_history.size(); ++k) {
+				const double beta(rho_history[k] * dot(y_history[k], direction));
+				for (size_t i = 0; i < n; ++i)
+					direction[i] += (alpha[k] - beta) * s_history[k][i];
+			}
+
+			double slope(dot(gradient, direction));
+			if (slope >= 0) {
+				// Not a descent direction, start over with steepest descent.
+				s_history.clear();
+				y_history.clear();
+				rho_history.clear();
+				for (size_t i = 0; i < n; ++i)
+					direction[i] = -gradient[i] * initial_scale;
+				slope = dot(gradient, direction);
+			}
+
+			// Backtracking line search for sufficient decrease.
+			double step(1), trial_e(0);
+			bool decreased(false);
+			for (int k = 0; k < 40; ++k, step /= 2) {
+				advance(poses, direction, step, trial);
+				trial_e = energy(springs, trial, trial_gradient);
+				++evaluations;
+				if (trial_e <= e + 1e-4 * step * slope) {
+					decreased = true;
+					break;
+				}
+			}
+
+			if (!decreased) {
+				if (!s_history.empty()) {
+					// Retry with steepest descent.
+					s_history.clear();
+					y_history.clear();
+					rho_history.clear();
+					continue;
+				}
+
+				// No further progress in floating point, converged as far as the energy can tell.
+				converged = true;
+				break;
+			}
+
+			std::vector<double> s(n), y(n);
+			for (size_t i = 0; i < n; ++i) {
+				s[i] = step * direction[i];
+				y[i] = trial_gradient[i] - gradient[i];
+			}
+
+			const double sy(dot(s, y));
+			if (sy > 1e-12 * std::sqrt(dot(s, s) * dot(y, y))) {
+				if (s_history.size() == settings.history) {
+					s_history.pop_front();
+					y_history.pop_front();
+					rho_history.pop_front();
+				}
+				s_history.push_back(std::move(s));
+				y_history.push_back(std::move(y));
+				rho_history.push_back(1 / sy);
+			}
+
+			poses.swap(trial);
+			gradient.swap(trial_gradient);
+			e = trial_e;
+		}
+
+		iterations = iteration;
+		return converged;
+	}
+
+	/*
+	 * Minimizes with chains of chain_length consecutive helices along the scaffold path as rigid bodies, then moves the helices with their chains.
+	 * While the mesh has a patch, only its helices move, one per body, and the kinematic helices around it anchor their joints in place.
+	 * Returns true if it converged.
+	 */
+	bool minimize_chains(scene & mesh, unsigned int chain_length, const static_solver::settings_type & settings, const std::function<bool()> & running_functor, uint64_t & iterations, uint64_t & evaluations) {
+		scene::HelixContainer & helices(mesh.getHelices());
+		const Helix::settings_type & helix_settings(mesh.getHelixSettings());
+		const std::vector<scene::HelixContainer::size_type> & patch(mesh.getPatch());
+		assert(patch.empty() || chain_length == 1);
+
+		// The body of every helix, -1 for the kinematic ones.
+		std::vector<int> body(helices.size(), -1);
+		size_t body_count(0);
+		if (patch.empty()) {
+			for (size_t i = 0; i < helices.size(); ++i)
+				body[i] = int(i / chain_length);
+			body_count = (helices.size() + chain_length - 1) / chain_length;
+		} else {
+			for (scene::HelixContainer::size_type i : patch)
+				body[i] = int(body_count++);
+		}
+
+		// Every chain moves with the frame of its first helix, the helices keep their poses relative to it. The offsets of the kinematic helices are their world poses.
+		std::vector<pose> poses(body_count), offsets(helices.size());
+		for (size_t i = 0; i < helices.size(); ++i) {
+			const physics::transform_type transform(helices[i].getTransform());
+			pose helix_pose;
+			helix_pose.position = dvec3(transform.p);
+			helix_pose.orientation = dquat(transform.q);
+
+			if (body[i] < 0) {
+				offsets[i] = helix_pose;
+				continue;
+			}
+
+			if (i % chain_length == 0)
+				poses[body[i]] = helix_pose;
+			offsets[i] = poses[body[i]].inverse() * helix_pose;
+		}
+
+		// Every joint between different bodies once, from the helix with the lower index. Joints between kinematic helices are left out.
+		std::vector<spring> springs;
+		for (size_t i = 0; i < helices.size(); ++i) {
+			for (int p = 0; p < 4; ++p) {
+				const Helix::AttachmentPoint point = Helix::AttachmentPoint(p);
+				const Helix::Connection & connection(helices[i].getJoint(point));
+				if (!connection)
+					continue;
+
+				const size_t j(connection.helix - &helices.front());
+				const Helix::AttachmentPoint other(helices[i].getConnectedPoint(point));
+				if (j < i || (j == i && other < point) || body[j] == body[i])
+					continue;
+
+				const spring s = { { body[i], body[j] }, { offsets[i].apply(dvec3(helices[i].getLocalFrame(point))), offsets[j].apply(dvec3(helices[j].getLocalFrame(other))) }, helix_settings.spring_stiffness };
+				springs.push_back(s);
+			}
+
+			if (helix_settings.attach_fixed && body[i] >= 0) {
+				const spring s = { { body[i], -1 }, { offsets[i].position, dvec3(helices[i].getInitialTransform().p) }, helix_settings.fixed_spring_stiffness };
+				springs.push_back(s);
+			}
+		}
+
+		const bool converged(minimize(springs, poses, settings, running_functor, iterations, evaluations));
+
+		for (size_t i = 0; i < helices.size(); ++i) {
+			if (body[i] < 0)
+				continue;
+
+			const pose p(poses[body[i]] * offsets[i]);
+			helices[i].setTransform(physics::transform_type(physics::vec3_type(physics::real_type(p.position.x), physics::real_type(p.position.y), physics::real_type(p.position.z)),
+				physics::quaternion_type(physics::real_type(p.orientation.x), physics::real_type(p.orientation.y), physics::real_type(p.orientation.z), physics::real_type(p.orientation.w))));
+		}
+
+		return converged;
+	}
+}
+
+bool static_solver::minimize(scene & mesh, const settings_type & settings, const std::function<bool()> & running_functor, uint64_t & iterations) {
+	iterations = 0;
+	if (mesh.getHelices().empty())
+		return true;
+
+	uint64_t evaluations;
+	const bool converged(minimize_chains(mesh, 1, settings, running_functor, iterations, evaluations));
+
+	statistics & stats(statistics::instance());
+	stats.add_counter("static_iterations", iterations);
+	stats.add_counter("energy_evaluations", evaluations);
+	return converged;
+}
+
+bool static_solver::minimize_coarse(scene & mesh, unsigned int chain_length, const settings_type & settings, const std::function<bool()> & running_functor) {
+	if (mesh.getHelices().empty())
+		return true;
+
+	uint64_t iterations, evaluations;
+	const bool converged(minimize_chains(mesh, chain_length, settings, running_functor, iterations, evaluations));
+
+	statistics & stats(statistics::instance());
+	stats.add_counter("coarse_iterations", iterations);
+	stats.add_counter("energy_evaluations", evaluations);
+	return converged;
+}
@@ -0,0 +1,146 @@
+#include <Definition.h>
+#include <Statistics.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif /* N _WINDOWS */
+
+statistics::usage_type statistics::current_usage() {
+	usage_type usage;
+	usage.wall = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#ifdef _WINDOWS
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time);
+	ULARGE_INTEGER kernel, user;
+	kernel.LowPart = kernel_time.dwLowDateTime;
+	kernel.HighPart = kernel_time.dwHighDateTime;
+	user.LowPart = user_time.dwLowDateTime;
+	user.HighPart = user_time.dwHighDateTime;
+	usage.cpu = (kernel.QuadPart + user.QuadPart) * 1e-7; // 100 ns ticks.
+	PROCESS_MEMORY_COUNTERS memory;
+	usage.peak_rss_kb = GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory)) ? uint64_t(memory.PeakWorkingSetSize / 1024) : 0;
+#else
+	struct rusage self;
+	getrusage(RUSAGE_SELF, &self);
+	usage.cpu = self.ru_utime.tv_sec + self.ru_stime.tv_sec + (self.ru_utime.tv_usec + self.ru_stime.tv_usec) * 1e-6;
+#ifdef __APPLE__
+	usage.peak_rss_kb = uint64_t(self.ru_maxrss / 1024); // Bytes on OS X.
+#else
+	usage.peak_rss_kb = uint64_t(self.ru_maxrss);
+#endif /* N __APPLE__ */
+#endif /* N _WINDOWS */
+	return usage;
+}
+
+statistics::statistics() : start(current_usage()) {}
+
+statistics & statistics::instance() {
+	static statistics stats;
+	return stats;
+}
+
+size_t statistics::begin_stage(const std::string & name) {
+	stage s;
+	s.name = name;
+	s.begin = s.end = current_usage();
+	s.open = true;
+
+	std::lock_guard<std::mutex> lock(stages_mutex);
+	open_stages.push_back(stages.size());
+	stages.push_back(s);
+	return stages.size() - 1;
+}
+
+void statistics::end_stage() {
+	std::lock_guard<std::mutex> lock(stages_mutex);
+	if (open_stages.empty())
+		return;
+
+	stage & s(stages[open_stages.back()]);
+	s.end = current_usage();
+	s.open = false;
+	open_stages.pop_back();
+}
+
+void statistics::end_stage(size_t index) {
+	std::lock_guard<std::mutex> lock(stages_mutex);
+	const std::vector<size_t>::iterator it(std::find(open_stages.begin(), open_stages.end(), index));
+	if (it == open_stages.end())
+		return;
+
+	stage & s(stages[index]);
+	s.end = current_usage();
+	s.open = false;
+	open_stages.erase(it);
+}
+
+namespace {
+	std::string json_string(const std::string & str) {
+		std::string quoted("\"");
+		for (char c : str) {
+			if (c == '"' || c == '\\')
+				quoted.push_back('\\');
+			if ((unsigned char) c >= 0x20)
+				quoted.push_back(c);
+		}
+		quoted.push_back('"');
+		return quoted;
+	}
+
+	void write_usage(std::ostream & os, const statistics::usage_type & begin, const statistics::usage_type & end) {
+		os << "\"wall_ms\":" << (end.wall - begin.wall) * 1000 << ",\"cpu_ms\":" << (end.cpu - begin.cpu) * 1000 << ",\"peak_rss_kb\":" << end.peak_rss_kb;
+	}
+}
+
+std::string statistics::to_json(const std::string & tool) const {
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(3);
+	const usage_type now(current_usage());
+
+	os << "{\"tool\":" << json_string(tool) << ",\"stages\":[";
+	std::unique_lock<std::mutex> stages_lock(stages_mutex);
+	for (std::vector<stage>::const_iterator it(stages.begin()); it != stages.end(); ++it) {
+		os << (it == stages.begin() ? "" : ",") << "{\"name\":" << json_string(it->name) << ',';
+		write_usage(os, it->begin, it->open ? now : it->end); // A stage still open, e.g. when interrupted, ends now.
+		os << '}';
+	}
+	stages_lock.unlock();
+	os << "],\"counters\":{";
+	std::lock_guard<std::mutex> lock(counters_mutex);
+	for (std::map<std::string, uint64_t>::const_iterator it(counters.begin()); it != counters.end(); ++it)
+		os << (it == counters.begin() ? "" : ",") << json_string(it->first) << ':' << it->second;
+	os << "},\"total\":{";
+	write_usage(os, start, now);
+	os << "}}";
+	return os.str();
+}
+
+bool statistics::write(const std::string & tool) const {
+	if (!isEnabled())
+		return true;
+
+	if (output == "json") {
+		std::cout << "STATS: " << to_json(tool) << std::endl;
+		return true;
+	}
+
+	std::ofstream outfile(output);
+	if (!outfile) {
+		std::cerr << "Failed to write statistics to \"" << output << "\"" << std::endl;
+		return false;
+	}
+	outfile << to_json(tool) << std::endl;
+	return bool(outfile);
+}
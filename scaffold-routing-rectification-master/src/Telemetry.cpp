@@ -0,0 +1,107 @@
+#include <Definition.h>
+#include <Telemetry.h>
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+
+namespace {
+	double now() {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// JSON has no NaN or infinity, the separation of a relaxation that diverged is written as null.
+	struct json_number {
+		double value;
+	};
+
+	std::ostream & operator<<(std::ostream & os, const json_number & n) {
+		if (std::isfinite(n.value))
+			os << n.value;
+		else
+			os << "null";
+		return os;
+	}
+}
+
+telemetry::telemetry() : enabled(false), next_index(0), start(0), stopping(false) {}
+
+telemetry::~telemetry() {
+	close();
+}
+
+telemetry & telemetry::instance() {
+	static telemetry stream;
+	return stream;
+}
+
+bool telemetry::open(const std::string & filename) {
+	outfile.open(filename);
+	if (!outfile)
+		return false;
+
+	start = now();
+	stopping = false;
+	enabled = true;
+	writer = std::thread([this]() { write_loop(); });
+	return true;
+}
+
+void telemetry::close() {
+	if (!enabled)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stopping = true;
+	}
+	queue_changed.notify_one();
+	writer.join();
+	outfile.close();
+	enabled = false;
+}
+
+void telemetry::record(const event & e) {
+	if (!enabled)
+		return;
+
+	const queued_event q = { e, 0, now() - start };
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		queue.push_back(q);
+		queue.back().index = next_index++;
+	}
+	queue_changed.notify_one();
+}
+
+void telemetry::write_loop() {
+	std::vector<queued_event> batch;
+	std::ostringstream os;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+
+			batch.swap(queue);
+		}
+
+		// Formatted without the lock, the optimizers keep queueing in the meantime.
+		os.str("");
+		for (const queued_event & q : batch) {
+			const event & e(q.e);
+			os << "{\"index\":" << q.index << ",\"time\":" << q.time << ",\"search\":\"" << e.search << "\",\"job\":" << e.job << ",\"worker\":" << e.worker
+				<< ",\"helix\":" << e.helix << ",\"bases\":" << e.bases << ",\"separation\":" << json_number{ e.separation }
+				<< ",\"completed\":" << (e.completed ? "true" : "false") << ",\"accepted\":" << (e.accepted ? "true" : "false")
+				<< ",\"steps\":" << e.steps << ",\"wall_ms\":" << json_number{ e.wall_ms };
+			if (e.temperature >= 0)
+				os << ",\"temperature\":" << json_number{ e.temperature };
+			os << "}\n";
+		}
+		batch.clear();
+
+		outfile << os.str();
+		outfile.flush();
+	}
+}
@@ -1,5 +1,14 @@
 #include <Utility.h>
 
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif /* N _WINDOWS */
+
 // Code from https://bitbucket.org/sinbad/ogre/src/9db75e3ba05c/OgreMain/include/OgreVector3.h#cl-651
 physics::quaternion_type rotationFromTo(physics::vec3_type from, physics::vec3_type to) {
 	// Based on Stan Melax's article in Game Programming Gems
@@ -30,3 +39,141 @@ physics::quaternion_type rotationFromTo(physics::vec3_type from, physics::vec3_t
 		return q.getNormalized();
 	}
 }
+
+#ifdef _WINDOWS
+
+bool mapped_file::open(const std::string & filename) {
+	close();
+
+	const HANDLE file(CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		return false;
+	}
+
+	length = size_t(file_size.QuadPart);
+	if (length > 0) {
+		// The view keeps the mapping and the file open.
+		const HANDLE mapping(CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL));
+		address = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : NULL;
+		if (mapping)
+			CloseHandle(mapping);
+	}
+	CloseHandle(file);
+
+	if (length > 0 && !address) {
+		length = 0;
+		return false;
+	}
+	return true;
+}
+
+void mapped_file::close() {
+	if (address)
+		UnmapViewOfFile(address);
+	address = NULL;
+	length = 0;
+}
+
+#else
+
+bool mapped_file::open(const std::string & filename) {
+	close();
+
+	const int file(::open(filename.c_str(), O_RDONLY));
+	if (file < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0) {
+		::close(file);
+		return false;
+	}
+
+	length = size_t(status.st_size);
+	if (length > 0) {
+		void *mapping(mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0));
+		if (mapping == MAP_FAILED) {
+			::close(file);
+			length = 0;
+			return false;
+		}
+
+		madvise(mapping, length, MADV_SEQUENTIAL);
+		address = static_cast<const char *>(mapping);
+	}
+	::close(file);
+	return true;
+}
+
+void mapped_file::close() {
+	if (address)
+		munmap(const_cast<char *>(address), length);
+	address = NULL;
+	length = 0;
+}
+
+#endif /* N _WINDOWS */
+
+worker_pool::worker_pool(unsigned int thread_count) : task(NULL), count(0), pending(0), round(0), stopping(false) {
+	for (unsigned int i = 0; i < thread_count; ++i)
+		threads.push_back(std::thread([this, i]() { loop(i); }));
+}
+
+worker_pool::~worker_pool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	start_condition.notify_all();
+	for (std::thread & thread : threads)
+		thread.join();
+}
+
+void worker_pool::run(size_t task_count, const std::function<void(size_t)> & task_functor) {
+	assert(task_count <= threads.size() + 1);
+	if (task_count == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = &task_functor;
+		count = task_count;
+		pending = task_count - 1;
+		++round;
+	}
+	if (task_count > 1)
+		start_condition.notify_all();
+
+	task_functor(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_condition.wait(lock, [this]() { return pending == 0; });
+	task = NULL;
+}
+
+// Thread i runs task i + 1 of every round that has one for it.
+void worker_pool::loop(size_t thread) {
+	uint64_t taken(0);
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		start_condition.wait(lock, [this, taken]() { return stopping || round != taken; });
+		if (stopping)
+			return;
+
+		taken = round;
+		if (thread + 1 >= count)
+			continue;
+
+		const std::function<void(size_t)> & task_functor(*task);
+		lock.unlock();
+		task_functor(thread + 1);
+		lock.lock();
+		if (--pending == 0)
+			done_condition.notify_one();
+	}
+}
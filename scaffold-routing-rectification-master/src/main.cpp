@@ -1,16 +1,30 @@
 #include <Definition.h>
+#include <Checkpoint.h>
 #include <DNA.h>
 #include <Utility.h>
 #include <ParseSettings.h>
+#include <Relaxation.h>
 #include <Scene.h>
+#include <Service.h>
 #include <SimulatedAnnealing.h>
+#include <Statistics.h>
+#include <Telemetry.h>
 
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <Physics.h>
@@ -19,39 +33,33 @@
  * Increases/decreases the base counts of individual helices with min(minbasecount, basecount + [ -baserange, baserange ]), and evaluates the new energy level of the system by simulated annealing.
  */
 template<typename StoreBestFunctorT, typename RunningFunctorT>
-void simulated_annealing(scene & mesh, physics & phys, int kmax, float emax, unsigned int minbasecount, int baserange,
+void simulated_annealing(scene & mesh, physics & phys, const relaxation_settings & relaxation, int kmax, float emax, unsigned int minbasecount, int baserange,
 		StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
 
-	int modifiedHelix, previousBaseCount;
-	physics::transform_type previousTransform;
+	scene::State previousState;
 
 	scene::HelixContainer & helices(mesh.getHelices());
 	const scene::HelixContainer::size_type helixCount(helices.size());
 
+	// Every neighbor starts from the relaxed state of the previously accepted one.
+	relax_multilevel(mesh, phys, relaxation, running_functor);
+
 	simulated_annealing(mesh,
 		[](scene & mesh) { return mesh.getTotalSeparation(); },
 		[&helixCount](float k) { return float(std::max(0., (exp(-k) - 1 / M_E) / (1 - 1 / M_E))) * helixCount; },
-		[&modifiedHelix, &helices, &helixCount, &previousBaseCount, &previousTransform, &phys, &minbasecount, &baserange, &running_functor](scene & mesh) {
-			for (Helix & helix : helices)
-				helix.setTransform(helix.getInitialTransform());
-
-			modifiedHelix = rand() % helixCount;
-			Helix & helix(helices[modifiedHelix]);
-			previousBaseCount = helix.getBaseCount();
-			previousTransform = helix.getTransform();
+		[&helices, &helixCount, &previousState, &phys, &relaxation, &minbasecount, &baserange, &running_functor](scene & mesh) {
+			previousState = mesh.saveState();
 
-			helix.recreateRigidBody(
-				phys, std::max(minbasecount, helix.getInitialBaseCount() + (rand() % 2 * 2 - 1) * (1 + rand() % (baserange))), helix.getInitialTransform());
+			Helix & helix(helices[rand() % helixCount]);
+			helix.setBaseCount(
+				phys, std::max(minbasecount, helix.getInitialBaseCount() + (rand() % 2 * 2 - 1) * (1 + rand() % (baserange))), helix.getTransform());
 
-			while (!mesh.isSleeping() && running_functor()) {
-				phys.scene->simulate(1.0f / 60.0f);
-				phys.scene->fetchResults(true);
-			}
+			relax(mesh, phys, relaxation, running_functor);
+			statistics::instance().add_counter("candidates_evaluated");
 		},
 		probability_functor<float, float>(),
-		[&modifiedHelix, &helices, &previousBaseCount, &previousTransform, &phys](scene & mesh) {
-			Helix & helix(helices[modifiedHelix]);
-			helix.recreateRigidBody(phys, previousBaseCount, helix.getInitialTransform());
+		[&previousState, &phys](scene & mesh) {
+			mesh.restoreState(phys, previousState);
 		},
 		store_best_functor,
 		running_functor,
@@ -60,88 +68,257 @@ void simulated_annealing(scene & mesh, physics & phys, int kmax, float emax, uns
 
 /*
  * Simple gradient descent implementation: Energy lower? Choose it, if not don't.
+ * Each helix is tried with one base less and one more than initially. The evaluator tries as many of these candidates at once as it has workers,
+ * and the best improvement of every such round is kept. Candidates start from the relaxed state of the best mesh so far.
+ * The telemetry of the candidates is tagged with job. The search starts at candidate first, and progress_functor is given the index of the next candidate to try after every completed round.
  */
-template<typename StoreBestFunctorT, typename RunningFunctorT>
-void gradient_descent(scene & mesh, physics & phys, int minbasecount, StoreBestFunctorT store_best_functor, RunningFunctorT running_functor) {
+template<typename StoreBestFunctorT, typename ProgressFunctorT, typename RunningFunctorT>
+void gradient_descent(scene & mesh, physics & phys, const relaxation_settings & relaxation, parallel_evaluator & evaluator, unsigned int job, int minbasecount, size_t first,
+		StoreBestFunctorT store_best_functor, ProgressFunctorT progress_functor, RunningFunctorT running_functor) {
 	scene::HelixContainer & helices(mesh.getHelices());
 
-	while (!mesh.isSleeping() && running_functor()) {
-		phys.scene->simulate(1.0f / 60.0f);
-		phys.scene->fetchResults(true);
-	}
+	relax_multilevel(mesh, phys, relaxation, running_functor);
 
 	//physics::real_type separation(mesh.getTotalSeparation());
 	physics::real_type min, max, average, total;
 	mesh.getTotalSeparationMinMaxAverage(min, max, average, total);
 	store_best_functor(mesh, min, max, average, total);
 
-	for (Helix & helix : helices) {
-		for (int i = 0; i < 2; ++i) {
-			if (!running_functor())
-				return;
+	scene::State best_state(mesh.saveState());
+	std::vector<parallel_evaluator::candidate> candidates;
+	for (size_t i = 0; i < helices.size(); ++i) {
+		for (int j = 0; j < 2; ++j) {
+			const parallel_evaluator::candidate c = { i, std::max(minbasecount, int(helices[i].getInitialBaseCount() + (j * 2 - 1))) };
+			candidates.push_back(c);
+		}
+	}
+
+	std::vector<parallel_evaluator::candidate> round;
+	std::vector<parallel_evaluator::result> results;
+	for (size_t next = first; next < candidates.size() && running_functor();) {
+		// Candidates that would not change the best state are skipped.
+		const size_t round_first(next);
+		round.clear();
+		for (; next < candidates.size() && round.size() < evaluator.getWorkerCount(); ++next) {
+			if (int(best_state.helices[candidates[next].helix].bases) != candidates[next].bases)
+				round.push_back(candidates[next]);
+		}
 
-			helix.recreateRigidBody(phys, std::max(minbasecount, int(helix.getInitialBaseCount() + (i * 2 - 1))), helix.getInitialTransform());
+		if (round.empty())
+			break;
 
-			while (!mesh.isSleeping() && running_functor()) {
-				phys.scene->simulate(1.0f / 60.0f);
-				phys.scene->fetchResults(true);
-			}
+		evaluator.evaluate(best_state, round, results, running_functor);
+
+		// An interrupted round is evaluated again when resuming.
+		if (!running_functor()) {
+			progress_functor(round_first);
+			break;
+		}
 
-			//const physics::real_type newseparation(mesh.getTotalSeparation());
-			physics::real_type newtotal;
-			mesh.getTotalSeparationMinMaxAverage(min, max, average, newtotal);
+		statistics::instance().add_counter("candidates_evaluated", round.size());
+		statistics::instance().add_counter("evaluation_rounds");
+		telemetry & stream(telemetry::instance());
 
-			if (newtotal < total) {
-				total = newtotal;
-				store_best_functor(mesh, min, max, average, total);
-			} else
-				helix.recreateRigidBody(phys, helix.getInitialBaseCount(), helix.getInitialTransform());
+		size_t best(round.size());
+		for (size_t i = 0; i < round.size(); ++i) {
+			if (results[i].completed && results[i].total < total && (best == round.size() || results[i].total < results[best].total))
+				best = i;
+		}
+
+		// Local evaluations only relaxed a patch, the whole scene has to confirm the improvement.
+		if (best != round.size() && evaluator.isLocal()) {
+			statistics::instance().add_counter("revalidations");
+			if (!evaluator.revalidate((unsigned int) best, results[best], running_functor) || results[best].total >= total) {
+				statistics::instance().add_counter("revalidations_rejected");
+				best = round.size();
+			}
+		}
 
-			for (Helix & helix : helices)
-				helix.setTransform(helix.getInitialTransform());
+		if (best != round.size()) {
+			const parallel_evaluator::result & r(results[best]);
+			best_state = evaluator.getScene((unsigned int) best).saveState();
+			total = r.total;
+			store_best_functor(evaluator.getScene((unsigned int) best), r.min, r.max, r.average, r.total);
 		}
+
+		for (size_t i = 0; i < round.size(); ++i) {
+			const telemetry::event e = { "descent", job, (unsigned int) i, round[i].helix, round[i].bases, results[i].total, results[i].completed, i == best, results[i].steps, results[i].wall_ms, -1.0f };
+			stream.record(e);
+		}
+
+		progress_functor(next);
+	}
+}
+
+/*
+ * Parallel tempering with one replica per worker of the evaluator, each relaxing its own scene. A move changes the base count of a random helix like
+ * the simulated annealing above, using the random number generator of the replica. All replicas start from the relaxed state of the mesh of the first worker.
+ * progress_functor is called after every sweep, while no replica moves.
+ */
+template<typename StoreBestFunctorT, typename ProgressFunctorT, typename RunningFunctorT>
+void parallel_tempering(parallel_evaluator & evaluator, const relaxation_settings & relaxation, const parallel_tempering_settings & settings, unsigned int job, unsigned int minbasecount, int baserange,
+		StoreBestFunctorT store_best_functor, ProgressFunctorT progress_functor, RunningFunctorT running_functor) {
+
+	// The move of the replica is kept for the telemetry.
+	struct replica {
+		scene *mesh;
+		physics *phys;
+		scene::State previousState;
+		unsigned int index;
+		size_t helix;
+		int bases;
+		bool completed;
+		uint64_t steps;
+		double wall_ms;
+	};
+
+	std::vector<replica> replicas(evaluator.getWorkerCount());
+	for (unsigned int i = 0; i < replicas.size(); ++i) {
+		replicas[i].mesh = &evaluator.getScene(i);
+		replicas[i].phys = &evaluator.getPhysics(i);
+		replicas[i].index = i;
 	}
+
+	relax_multilevel(*replicas[0].mesh, *replicas[0].phys, relaxation, running_functor);
+	const scene::State start(replicas[0].mesh->saveState());
+	for (size_t i = 1; i < replicas.size(); ++i)
+		replicas[i].mesh->restoreState(*replicas[i].phys, start);
+
+	const float helixCount(float(replicas[0].mesh->getHelixCount()));
+	std::vector<float> temperatures(replicas.size());
+	for (size_t i = 0; i < temperatures.size(); ++i) {
+		const float f(temperatures.size() > 1 ? float(i) / (temperatures.size() - 1) : 0.0f);
+		temperatures[i] = helixCount * settings.min_temperature * std::pow(settings.max_temperature / settings.min_temperature, f);
+	}
+
+	const uint64_t swaps(parallel_tempering(replicas, temperatures,
+		[](replica & r) { return r.mesh->getTotalSeparation(); },
+		[&relaxation, &minbasecount, &baserange, &running_functor](replica & r, std::mt19937 & generator) {
+			const std::chrono::steady_clock::time_point begin(std::chrono::steady_clock::now());
+			r.previousState = r.mesh->saveState();
+
+			scene::HelixContainer & helices(r.mesh->getHelices());
+			r.helix = std::uniform_int_distribution<size_t>(0, helices.size() - 1)(generator);
+			Helix & helix(helices[r.helix]);
+			const int change((std::uniform_int_distribution<int>(0, 1)(generator) * 2 - 1) * std::uniform_int_distribution<int>(1, baserange)(generator));
+			r.bases = (int) std::max(minbasecount, helix.getInitialBaseCount() + change);
+			helix.setBaseCount(*r.phys, r.bases, helix.getTransform());
+
+			r.completed = relax(*r.mesh, *r.phys, relaxation, running_functor, r.steps);
+			r.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+			statistics::instance().add_counter("candidates_evaluated");
+			return r.completed;
+		},
+		probability_functor<physics::real_type, float>(),
+		[](replica & r) {
+			r.mesh->restoreState(*r.phys, r.previousState);
+		},
+		[&store_best_functor](replica & r, physics::real_type e) {
+			store_best_functor(*r.mesh, e);
+		},
+		[&job](replica & r, physics::real_type e, float temperature, bool accepted) {
+			const telemetry::event event = { "tempering", job, r.index, r.helix, r.bases, e, r.completed, accepted, r.steps, r.wall_ms, temperature };
+			telemetry::instance().record(event);
+		},
+		[&evaluator](size_t count, const std::function<void(size_t)> & chain) { evaluator.run(count, chain); },
+		progress_functor,
+		running_functor,
+		settings.sweeps, settings.sweep_length, (unsigned int) rand()));
+
+	statistics::instance().add_counter("replica_exchanges", swaps);
 }
 
-volatile bool running = true;
+// Set by ^C. The rectifications only see it through the reference they are given.
+std::atomic<bool> interrupted(false);
 
 void handle_exit() {
-	running = false;
+	interrupted = true;
 }
 
 /*
  * Does a simple rectification of the structure without modification.
  */
 template<typename RunningFunctorT>
-SceneDescription simulated_rectification(scene & mesh, physics & phys, RunningFunctorT running_functor) {
-	while (!mesh.isSleeping() && running_functor()) {
-		phys.scene->simulate(1.0f / 60.0f);
-		phys.scene->fetchResults(true);
-	}
+SceneDescription simulated_rectification(scene & mesh, physics & phys, const relaxation_settings & relaxation, RunningFunctorT running_functor) {
+	relax_multilevel(mesh, phys, relaxation, running_functor);
 
 	return SceneDescription(mesh);
 }
 
-int main(int argc, const char **argv) {
-	seed();
-
+/*
+ * The settings shared by all structures rectified by this process.
+ */
+struct rectification_settings {
 	physics::settings_type physics_settings;
 	scene::settings_type scene_settings;
 	Helix::settings_type helix_settings;
 
+	parallel_evaluator::settings_type evaluator_settings;
+	relaxation_settings relaxation;
+	parallel_tempering_settings tempering_settings;
+	bool tempering;
+};
+
+/*
+ * A structure to rectify, the only one, a line of the --batch manifest or a request to the daemon. The stages of batch jobs and requests are named after their input files.
+ */
+struct rectification_job {
+	unsigned int index;
 	std::string input_file, output_file;
-	parse_settings::parse(argc, argv, physics_settings, scene_settings, helix_settings, input_file, output_file);
+	std::string scene_file; // Read instead of the input file if not empty, such as the copy of a PLY routed by the daemon.
+	checkpoint::settings_type checkpoint_settings;
+	bool batch;
+};
 
-	if (input_file.empty() || output_file.empty() || argc < 3) {
-		std::cerr << parse_settings::usage(argv[0]) << std::endl;
-		return 0;
+/*
+ * Reads the manifest of a batch: one job per line with its input file, output file and optionally its checkpoint file, separated by whitespace.
+ * Empty lines and lines starting with # are skipped. The other checkpoint settings are the given ones.
+ */
+bool read_manifest(const std::string & filename, const checkpoint::settings_type & checkpoint_settings, std::vector<rectification_job> & jobs) {
+	std::ifstream infile(filename);
+	if (!infile)
+		return false;
+
+	std::string line;
+	while (std::getline(infile, line)) {
+		std::istringstream ss(line);
+		rectification_job job;
+		if (!(ss >> job.input_file) || job.input_file[0] == '#')
+			continue;
+
+		if (!(ss >> job.output_file)) {
+			std::cerr << "ERROR! No output file for \"" << job.input_file << "\" in \"" << filename << "\"" << std::endl;
+			return false;
+		}
+
+		job.index = (unsigned int) jobs.size();
+		job.checkpoint_settings = checkpoint_settings;
+		if (!(ss >> job.checkpoint_settings.filename))
+			job.checkpoint_settings.filename.clear();
+		job.batch = true;
+		jobs.push_back(job);
 	}
 
-	scene mesh(scene_settings, helix_settings);
-	physics phys(physics_settings);
+	return true;
+}
+
+/*
+ * Reads, relaxes and writes one structure with its own scenes. Returns the exit code of the job.
+ */
+int rectify(const rectification_job & job, const rectification_settings & settings, const std::atomic<bool> & interrupted) {
+	const std::string & input_file(job.input_file), & output_file(job.output_file), & scene_file(job.scene_file.empty() ? input_file : job.scene_file);
+	const checkpoint::settings_type & checkpoint_settings(job.checkpoint_settings);
+	const std::string stage_prefix(job.batch ? input_file + ":" : "");
+	relaxation_settings relaxation(settings.relaxation);
+
+	statistics & stats(statistics::instance());
+
+	scene mesh(settings.scene_settings, settings.helix_settings);
+	physics phys(settings.physics_settings);
 
+	const size_t read_stage(stats.begin_stage(stage_prefix + "read"));
 	try {
-		if (!mesh.read(phys, input_file)) {
+		if (!mesh.read(phys, scene_file)) {
 			std::cerr << "Failed to read scene \"" << input_file << "\"" << std::endl;
 			return 1;
 		}
@@ -150,46 +327,272 @@ int main(int argc, const char **argv) {
 		std::cerr << "Failed to read scene \"" << input_file << "\": " << e.what() << std::endl;
 		return 1;
 	}
+	stats.end_stage(read_stage);
+	stats.add_counter("helices", mesh.getHelixCount());
 
 	physics::real_type initialmin, initialmax, initialaverage, initialtotal, min, max, average, total;
 	mesh.getTotalSeparationMinMaxAverage(initialmin, initialmax, initialaverage, initialtotal);
 
-	std::cerr << "Running simulation for scene loaded from \"" << input_file << " outputting to " << output_file << "\"." << std::endl
-		<< "Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << std::endl
-		<< "Connect with NVIDIA PhysX Visual Debugger to " << PVD_HOST << ':' << PVD_PORT << " to visualize the progress. " << std::endl
-		<< "Press ^C to stop the relaxation...." << std::endl;
+	// A resumed mesh is already relaxed, and the coarse levels would only disturb it.
+	checkpoint progress;
+	progress.position = 0;
+	if (!checkpoint_settings.filename.empty() && progress.read(checkpoint_settings.filename)) {
+		if (progress.state.helices.size() != mesh.getHelixCount()) {
+			std::cerr << "ERROR! Checkpoint \"" << checkpoint_settings.filename << "\" does not match the scene" << std::endl;
+			return 1;
+		}
 
-	setinterrupthandler<handle_exit>();
+		mesh.restoreState(phys, progress.state);
+		relaxation.coarsening = 0;
+		std::cerr << "INFO: Resuming from checkpoint \"" << checkpoint_settings.filename << "\" at candidate " << progress.position << ", total: " << progress.total << " nm" << std::endl;
+	}
+
+	std::cerr << "Running simulation for scene loaded from \"" << input_file << " outputting to " << output_file << "\"." << std::endl
+		<< "Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << std::endl;
 
 	SceneDescription best_scene;
+
+	// The relaxation stops on ^C, when the time limit runs out or when the target separation is reached.
+	typedef std::chrono::steady_clock clock_type;
+	const clock_type::time_point start_time(clock_type::now());
+	clock_type::time_point last_snapshot(start_time);
+	std::atomic<bool> target_reached(false);
+	const auto elapsed([&start_time]() { return std::chrono::duration<double>(clock_type::now() - start_time).count(); });
+	const auto keep_running([&interrupted, &target_reached, &checkpoint_settings, &elapsed]() { return !interrupted && !target_reached && (checkpoint_settings.time_limit <= 0 || elapsed() < checkpoint_settings.time_limit); });
+
+	const auto write_output([&](std::ostream & outfile) {
+		outfile << "# Relaxation of original " << input_file << " file. " << mesh.getHelixCount() << " helices." << std::endl
+			<< "# Total separation: Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << ", final: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+
+		return best_scene.write(outfile);
+	});
+
+	// Nothing is checkpointed before the first relaxed mesh has been stored.
+	const auto write_checkpoint([&progress, &checkpoint_settings]() {
+		if (!checkpoint_settings.filename.empty() && !progress.state.helices.empty() && !progress.write(checkpoint_settings.filename))
+			std::cerr << "ERROR! Failed to write checkpoint to \"" << checkpoint_settings.filename << "\"" << std::endl;
+	});
+
+	// Every snapshot_interval seconds, the best mesh so far is written to the output file and the checkpoint, both replacing their previous versions.
+	const auto save_progress([&]() {
+		if (std::chrono::duration<double>(clock_type::now() - last_snapshot).count() < checkpoint_settings.interval)
+			return;
+
+		last_snapshot = clock_type::now();
+		if (!write_atomically(output_file, write_output))
+			std::cerr << "ERROR! Failed to write snapshot to \"" << output_file << "\"" << std::endl;
+		write_checkpoint();
+		stats.add_counter("snapshots");
+	});
+
+	const size_t relaxation_stage(stats.begin_stage(stage_prefix + "relaxation"));
 #if 0
-	best_scene = simulated_rectification(mesh, phys, []() { return running; });
+	best_scene = simulated_rectification(mesh, phys, relaxation, keep_running);
 #else
 #if 0
-	simulated_annealing(mesh, phys, 100, 0, 7, 1,
+	simulated_annealing(mesh, phys, relaxation, 100, 0, 7, 1,
 		[&best_scene](scene & mesh, float e) { std::cerr << "Store best energy: " << e << std::endl; best_scene = SceneDescription(mesh); },
-		[]() { return running; });
+		keep_running);
 #else
-	gradient_descent(mesh, phys, 7,
-		[&best_scene, &min, &max, &average, &total](scene & mesh, physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) { min = min_; max = max_; average = average_; total = total_; std::cerr << "State: min: " << min << ", max: " << max << ", average: " << average << " total: " << total << " nm" << std::endl; best_scene = SceneDescription(mesh); },
-		[]() { return running; });
+	std::unique_ptr<parallel_evaluator> evaluator;
+	try {
+		evaluator.reset(new parallel_evaluator(settings.evaluator_settings, relaxation, mesh, phys, settings.physics_settings, settings.scene_settings, settings.helix_settings, scene_file));
+	}
+	catch (const std::runtime_error & e) {
+		std::cerr << "Failed to set up the workers: " << e.what() << std::endl;
+		return 1;
+	}
+	std::cerr << "Evaluating candidates with " << evaluator->getWorkerCount() << " workers." << std::endl;
+
+	const auto store_best([&best_scene, &min, &max, &average, &total, &progress, &target_reached, &checkpoint_settings](scene & mesh, physics::real_type min_, physics::real_type max_, physics::real_type average_, physics::real_type total_) {
+		min = min_; max = max_; average = average_; total = total_;
+		std::cerr << "State: min: " << min << ", max: " << max << ", average: " << average << " total: " << total << " nm" << std::endl;
+		best_scene = SceneDescription(mesh);
+		progress.state = mesh.saveState();
+		progress.total = total;
+		if (total <= checkpoint_settings.target_separation)
+			target_reached = true;
+	});
+
+	if (settings.tempering) {
+		parallel_tempering(*evaluator, relaxation, settings.tempering_settings, job.index, 7, 1,
+			[&store_best](scene & mesh, physics::real_type) { physics::real_type min_, max_, average_, total_; mesh.getTotalSeparationMinMaxAverage(min_, max_, average_, total_); store_best(mesh, min_, max_, average_, total_); },
+			save_progress,
+			keep_running);
+		progress.position = 0;
+	} else {
+		gradient_descent(mesh, phys, relaxation, *evaluator, job.index, 7, (size_t) progress.position, store_best,
+			[&progress, &save_progress](size_t next) { progress.position = next; save_progress(); },
+			keep_running);
+	}
 #endif
 #endif
 
-	std::cerr << "Result: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+	stats.end_stage(relaxation_stage);
 
-	{
-		std::ofstream outfile(output_file);
-		outfile << "# Relaxation of original " << input_file << " file. " << mesh.getHelixCount() << " helices." << std::endl
-			<< "# Total separation: Initial: min: " << initialmin << ", max: " << initialmax << ", average: " << initialaverage << ", total: " << initialtotal << " nm" << ", final: min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
+	if (target_reached)
+		std::cerr << "INFO: Reached the target separation of " << checkpoint_settings.target_separation << " nm" << std::endl;
+	else if (!interrupted && checkpoint_settings.time_limit > 0 && elapsed() >= checkpoint_settings.time_limit)
+		std::cerr << "INFO: Stopped after the time limit of " << checkpoint_settings.time_limit << " s" << std::endl;
 
-		if (!best_scene.write(outfile))
-			std::cerr << "Failed to write resulting mesh to \"" << output_file << "\"" << std::endl;
+	std::cerr << "Result: " << (job.batch ? input_file + ": " : "") << "min: " << min << ", max: " << max << ", average: " << average << ", total: " << total << " nm" << std::endl;
 
-		outfile.close();
+	if (!write_atomically(output_file, write_output)) {
+		std::cerr << "Failed to write resulting mesh to \"" << output_file << "\"" << std::endl;
+		return 1;
 	}
+	write_checkpoint();
+
+	return 0;
+}
+
+/*
+ * Handles a request to the daemon: its arguments are parsed after those of the daemon, so that they override them. The output file defaults to the input
+ * file with the extension .rpoly, and a PLY mesh is routed by the graph tools in the work directory of the request first. The process wide --jobs, --workers, --stats and --telemetry are kept.
+ * The statistics are not reset between the requests, they are written once when the daemon stops and add up all the requests it handled.
+ */
+int rectify_request(int argc, const char **argv, const rectification_settings & settings, const service::settings_type & service_settings, unsigned int index,
+		const std::vector<std::string> & arguments, const std::string & work_directory, std::string & output_file, std::string & reply_file, std::string & message) {
+	std::vector<const char *> request_argv(argv, argv + argc);
+	for (const std::string & argument : arguments)
+		request_argv.push_back(argument.c_str());
+
+	rectification_settings request_settings;
+	rectification_job request;
+	std::string batch_file, stats_output, telemetry_output;
+	unsigned int concurrent_jobs;
+	service::settings_type ignored_service_settings;
+	parse_settings::parse(int(request_argv.size()), &request_argv[0], request_settings.physics_settings, request_settings.scene_settings, request_settings.helix_settings, request_settings.evaluator_settings, request_settings.relaxation, request_settings.tempering, request_settings.tempering_settings, request.checkpoint_settings, request.input_file, request.output_file, batch_file, concurrent_jobs, stats_output, telemetry_output, ignored_service_settings);
+	request_settings.evaluator_settings.workers = settings.evaluator_settings.workers;
+
+	if (request.input_file.empty()) {
+		message = "No --input=<filename> in the request";
+		return 1;
+	}
+	const std::string & input_file(request.input_file);
+	request.index = index;
+	request.batch = true;
+
+	// Concurrent requests for the same mesh must not share the routed files, nor the default rpoly, which is written in the work directory
+	// and then copied next to the input, while the reply is sent from the copy of this request.
+	if (ends_with(input_file, ".ply") && !service::route(service_settings, input_file, work_directory, request.scene_file, message)) {
+		message = "Failed to route \"" + input_file + "\": " + message;
+		return 1;
+	}
+
+	output_file = request.output_file.empty() ? input_file.substr(0, input_file.find_last_of('.')) + ".rpoly" : request.output_file;
+	if (request.output_file.empty())
+		request.output_file = work_directory + "/result.rpoly";
+	reply_file = request.output_file;
 
-	sleepms(2000);
+	const int code(rectify(request, request_settings, interrupted));
+	if (code != 0) {
+		message = "Failed to rectify \"" + input_file + "\", see the log of the daemon";
+		return code;
+	}
 
+	if (output_file != reply_file && !write_atomically(output_file, [&reply_file](std::ostream & out) { std::ifstream infile(reply_file); out << infile.rdbuf(); return bool(out); })) {
+		message = "Failed to write \"" + output_file + "\"";
+		return 1;
+	}
 	return 0;
 }
+
+int main(int argc, const char **argv) {
+	seed();
+
+	rectification_settings settings;
+	rectification_job job;
+	std::string batch_file, stats_output, telemetry_output;
+	unsigned int concurrent_jobs;
+	service::settings_type service_settings;
+	parse_settings::parse(argc, argv, settings.physics_settings, settings.scene_settings, settings.helix_settings, settings.evaluator_settings, settings.relaxation, settings.tempering, settings.tempering_settings, job.checkpoint_settings, job.input_file, job.output_file, batch_file, concurrent_jobs, stats_output, telemetry_output, service_settings);
+	const bool serving(!service_settings.socket.empty());
+
+	if (batch_file.empty() && !serving && (job.input_file.empty() || job.output_file.empty() || argc < 3)) {
+		std::cerr << parse_settings::usage(argv[0]) << std::endl;
+		return 0;
+	}
+
+	std::vector<rectification_job> jobs;
+	if (serving) {
+		// The graph tools are installed next to the rectifier.
+		const std::string executable(argv[0]);
+		if (service_settings.tools.empty() && executable.find_last_of("/\\") != std::string::npos)
+			service_settings.tools = executable.substr(0, executable.find_last_of("/\\"));
+		concurrent_jobs = concurrent_jobs > 0 ? concurrent_jobs : numcpucores();
+	} else if (batch_file.empty()) {
+		job.index = 0;
+		job.batch = false;
+		jobs.push_back(job);
+	} else if (!read_manifest(batch_file, job.checkpoint_settings, jobs)) {
+		std::cerr << "ERROR! Failed to read batch manifest \"" << batch_file << "\"" << std::endl;
+		return 1;
+	}
+
+	// The workers of the concurrent jobs share the cores, and all scenes share one PhysX dispatcher with a thread per core.
+	if (!serving)
+		concurrent_jobs = std::max(1u, std::min(concurrent_jobs > 0 ? concurrent_jobs : numcpucores(), (unsigned int) jobs.size()));
+	if (settings.evaluator_settings.workers == 0)
+		settings.evaluator_settings.workers = std::max(1u, numcpucores() / concurrent_jobs);
+
+	statistics & stats(statistics::instance());
+	stats.setOutput(stats_output);
+
+	if (!telemetry_output.empty() && !telemetry::instance().open(telemetry_output)) {
+		std::cerr << "ERROR! Failed to open telemetry file \"" << telemetry_output << "\"" << std::endl;
+		return 1;
+	}
+
+	if (!batch_file.empty())
+		std::cerr << "INFO: Rectifying " << jobs.size() << " structures from \"" << batch_file << "\", " << concurrent_jobs << " at a time." << std::endl;
+	std::cerr
+#ifndef REFERENCE_PHYSICS
+		<< "Connect with NVIDIA PhysX Visual Debugger to " << PVD_HOST << ':' << PVD_PORT << " to visualize the progress. " << std::endl
+#endif /* N REFERENCE_PHYSICS */
+		<< "Press ^C to stop the relaxation...." << std::endl;
+
+	setinterrupthandler<handle_exit>();
+
+	if (serving) {
+		// Keeps the PhysX foundation, SDK and CPU dispatcher alive between the requests, they are released with the last physics instance.
+		physics sdk(settings.physics_settings);
+		const bool served(service::serve(service_settings, concurrent_jobs,
+			[argc, argv, &settings, &service_settings](unsigned int index, const std::vector<std::string> & arguments, const std::string & work_directory, std::string & output_file, std::string & reply_file, std::string & message) {
+				return rectify_request(argc, argv, settings, service_settings, index, arguments, work_directory, output_file, reply_file, message);
+			}, interrupted));
+
+		telemetry::instance().close();
+		stats.write("scaffold-routing-rectification");
+		return served ? 0 : 1;
+	}
+
+	// Every thread takes the next job until none are left or ^C was pressed. The calling thread is one of them.
+	std::atomic<size_t> next_job(0);
+	std::atomic<unsigned int> rectified_jobs(0), failed_jobs(0);
+	const auto run_jobs([&jobs, &settings, &next_job, &rectified_jobs, &failed_jobs]() {
+		for (size_t i; !interrupted && (i = next_job++) < jobs.size();) {
+			if (rectify(jobs[i], settings, interrupted) == 0)
+				++rectified_jobs;
+			else
+				++failed_jobs;
+		}
+	});
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < concurrent_jobs; ++i)
+		threads.push_back(std::thread(run_jobs));
+	run_jobs();
+	for (std::thread & thread : threads)
+		thread.join();
+
+	telemetry::instance().close();
+	if (!batch_file.empty()) {
+		stats.set_counter("jobs_rectified", rectified_jobs);
+		stats.set_counter("jobs_failed", failed_jobs);
+		std::cerr << "INFO: " << rectified_jobs << " of " << jobs.size() << " structures rectified, " << failed_jobs << " failed." << std::endl;
+	}
+	stats.write("scaffold-routing-rectification");
+
+	return failed_jobs > 0 ? 1 : 0;
+}
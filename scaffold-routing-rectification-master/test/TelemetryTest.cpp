@@ -0,0 +1,61 @@
+/*
+ * Records telemetry events, one of them with a diverged separation, and checks that every line written is valid JSON. Exits with 0 on success.
+ * Built and run from scaffold-routing-rectification-master with:
+ *
+ * g++ -std=c++11 -O2 -DREFERENCE_PHYSICS -pthread -Iinclude test/TelemetryTest.cpp src/Telemetry.cpp -o telemetry_test && ./telemetry_test
+ */
+
+#include <Definition.h>
+#include <Telemetry.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+	int failures = 0;
+
+	void check(bool condition, const std::string & what) {
+		if (!condition) {
+			std::cerr << "FAILED: " << what << std::endl;
+			++failures;
+		}
+	}
+}
+
+int main() {
+	const std::string filename("telemetry_test.jsonl");
+	telemetry & stream(telemetry::instance());
+	check(stream.open(filename), "opening " + filename);
+
+	const telemetry::event diverged = { "descent", 0, 1, 2, 7, std::numeric_limits<double>::quiet_NaN(), false, false, 100, 1.5, -1 };
+	const telemetry::event relaxed = { "tempering", 0, 0, 3, 8, 33.25, true, true, 200, 2.5, 0.5f };
+	const telemetry::event infinite = { "descent", 0, 2, 4, 9, std::numeric_limits<double>::infinity(), true, false, 300, 3.5, -1 };
+	stream.record(diverged);
+	stream.record(relaxed);
+	stream.record(infinite);
+	stream.close();
+
+	std::ifstream infile(filename);
+	std::vector<std::string> lines;
+	for (std::string line; std::getline(infile, line);)
+		lines.push_back(line);
+	std::remove(filename.c_str());
+
+	check(lines.size() == 3, "three lines are written");
+	for (const std::string & line : lines) {
+		check(line.find("nan") == std::string::npos && line.find("inf") == std::string::npos, "no NaN or infinity in " + line);
+		check(!line.empty() && line.front() == '{' && line.back() == '}', "one object per line in " + line);
+	}
+	if (lines.size() == 3) {
+		check(lines[0].find("\"separation\":null,") != std::string::npos, "a NaN separation is null in " + lines[0]);
+		check(lines[1].find("\"separation\":33.25,") != std::string::npos, "a finite separation is kept in " + lines[1]);
+		check(lines[2].find("\"separation\":null,") != std::string::npos, "an infinite separation is null in " + lines[2]);
+	}
+
+	std::cerr << (failures == 0 ? "PASSED" : "FAILED") << std::endl;
+	return failures == 0 ? 0 : 1;
+}